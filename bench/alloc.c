@@ -0,0 +1,87 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/runtime/rt.h"
+
+//===---------------------------------------------------------------------===//
+// Alloc benchmark - Compares the Anx runtime allocator against system malloc.
+//
+// Each thread keeps a sliding window of live blocks with pseudo-random sizes
+// and replaces one block per iteration, which exercises both the alloc and
+// free paths with a realistic mix of reuse.
+//===---------------------------------------------------------------------===//
+
+#define WINDOW 4096
+#define ITERS 4000000
+
+typedef struct {
+  void *(*alloc)(size_t);
+  void (*free)(void *);
+  size_t max;
+} bench_t;
+
+static void *rt_alloc(size_t n) { return anx_alloc(n); }
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *churn(void *arg) {
+  bench_t *b = arg;
+  void *live[WINDOW] = {0};
+  uint64_t x = (uintptr_t)&live | 1;
+
+  for (long i = 0; i < ITERS; i++) {
+    x ^= x << 13, x ^= x >> 7, x ^= x << 17; // xorshift64
+    size_t slot = x % WINDOW, size = 1 + (x >> 32) % b->max;
+
+    b->free(live[slot]);
+    live[slot] = b->alloc(size);
+    *(char *)live[slot] = (char)i;
+  }
+
+  for (int i = 0; i < WINDOW; i++)
+    b->free(live[i]);
+
+  return NULL;
+}
+
+static double run(bench_t *b, int threads) {
+  pthread_t t[64];
+  double start = now();
+
+  for (int i = 0; i < threads; i++)
+    pthread_create(&t[i], NULL, churn, b);
+  for (int i = 0; i < threads; i++)
+    pthread_join(t[i], NULL);
+
+  return (now() - start) * 1e9 / ((double)ITERS * threads);
+}
+
+int main(int argc, char **argv) {
+  int threads = argc > 1 ? atoi(argv[1]) : 4;
+  if (threads < 1 || threads > 64)
+    threads = 4;
+
+  size_t sizes[] = {64, 512, 4096, 32768};
+
+  printf("%-10s %-8s %14s %14s\n", "max size", "threads", "malloc ns/op",
+         "anx ns/op");
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    for (int n = 1; n <= threads; n *= threads > 1 ? threads : 2) {
+      bench_t sys = {malloc, free, sizes[i]};
+      bench_t anx = {rt_alloc, anx_free, sizes[i]};
+
+      double s = run(&sys, n), a = run(&anx, n);
+      printf("%-10zu %-8d %14.1f %14.1f\n", sizes[i], n, s, a);
+    }
+  }
+
+  anx_alloc_stats_print();
+  return 0;
+}
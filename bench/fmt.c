@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/runtime/rt.h"
+
+//===---------------------------------------------------------------------===//
+// Fmt benchmark - Compares runtime number formatting and parsing against libc.
+//
+// Integers are formatted with snprintf("%ld") and anx_fmt_i64. Doubles are
+// formatted with snprintf("%.17g"), the shortest format that always round
+// trips in libc, and with the shortest representation from anx_fmt_f64. The
+// same strings are then parsed back with strtoll/strtod and anx_parse_*.
+//===---------------------------------------------------------------------===//
+
+#define NUMBERS 4000000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t state = 88172645463325252ull;
+
+static uint64_t next(void) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+static void report(const char *what, double libc, double anx) {
+  fprintf(stderr, "%-12s %12.2f %12.2f %9.2fx\n", what, libc * 1e9 / NUMBERS,
+          anx * 1e9 / NUMBERS, libc / anx);
+}
+
+int main(void) {
+  int64_t *ints = malloc(NUMBERS * sizeof(int64_t));
+  double *doubles = malloc(NUMBERS * sizeof(double));
+  anx_str_t *strs = malloc(NUMBERS * sizeof(anx_str_t));
+  char (*text)[ANX_FMT_MAX] = malloc(NUMBERS * ANX_FMT_MAX);
+
+  // integers of every length, doubles with a mix of short and long digits
+  for (uint64_t i = 0; i < NUMBERS; i++) {
+    ints[i] = (int64_t)next() >> (next() % 64);
+    doubles[i] = i % 2 ? (double)(next() % 1000000) / 100
+                       : (double)next() / (double)next();
+  }
+
+  fprintf(stderr, "%-12s %12s %12s %10s\n", "", "libc ns", "anx ns",
+          "speedup");
+
+  uint64_t sink = 0;
+  double t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sink += snprintf(text[i], ANX_FMT_MAX, "%ld", (long)ints[i]);
+  double libc = now() - t;
+
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sink += anx_fmt_i64(text[i], ints[i]);
+  report("fmt i64", libc, now() - t);
+
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sink += snprintf(text[i], ANX_FMT_MAX, "%.17g", doubles[i]);
+  libc = now() - t;
+
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sink += anx_fmt_f64(text[i], doubles[i]);
+  report("fmt f64", libc, now() - t);
+
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    anx_str_from(&strs[i], text[i], anx_fmt_i64(text[i], ints[i]));
+
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sink += strtoll(text[i], NULL, 10);
+  libc = now() - t;
+
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sink += anx_parse_i64(&strs[i]);
+  report("parse i64", libc, now() - t);
+
+  for (uint64_t i = 0; i < NUMBERS; i++) {
+    uint64_t n = anx_fmt_f64(text[i], doubles[i]);
+    text[i][n] = 0;
+    anx_str_free(&strs[i]);
+    anx_str_from(&strs[i], text[i], n);
+  }
+
+  double sum = 0;
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sum += strtod(text[i], NULL);
+  libc = now() - t;
+
+  t = now();
+  for (uint64_t i = 0; i < NUMBERS; i++)
+    sum -= anx_parse_f64(&strs[i]);
+  report("parse f64", libc, now() - t);
+
+  return sink == 42 && sum == 42;
+}
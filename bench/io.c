@@ -0,0 +1,75 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/runtime/rt.h"
+
+//===---------------------------------------------------------------------===//
+// IO benchmark - Compares buffered runtime output against libc putchar.
+//
+// Every variant prints the same run of decimal numbers to /dev/null one byte
+// at a time, the way compiled code does through @out. The inline variant
+// mirrors the fast path the code generator emits.
+//===---------------------------------------------------------------------===//
+
+#define NUMBERS 10000000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void out_inline(int c) {
+  if (anx_out.pos < anx_out.end)
+    *anx_out.pos++ = (char)c;
+  else
+    anx_io_putc(c);
+}
+
+#define PRINT(out)                                                             \
+  do {                                                                         \
+    for (uint64_t i = 0; i < NUMBERS; i++) {                                   \
+      char digits[20];                                                         \
+      int n = 0;                                                               \
+      uint64_t x = i;                                                          \
+      do                                                                       \
+        digits[n++] = '0' + x % 10;                                            \
+      while (x /= 10);                                                         \
+      while (n)                                                                \
+        out(digits[--n]);                                                      \
+      out('\n');                                                               \
+    }                                                                          \
+  } while (0)
+
+int main(void) {
+  int null = open("/dev/null", O_WRONLY);
+  if (null < 0 || dup2(null, 1) < 0) {
+    perror("/dev/null");
+    return 1;
+  }
+
+  double t = now();
+  PRINT(putchar);
+  fflush(stdout);
+  double libc = now() - t;
+
+  t = now();
+  PRINT(anx_io_putc);
+  anx_io_flush();
+  double call = now() - t;
+
+  t = now();
+  PRINT(out_inline);
+  anx_io_flush();
+  double inl = now() - t;
+
+  fprintf(stderr, "%-10s %12s\n", "output", "ns/number");
+  fprintf(stderr, "%-10s %12.2f\n", "putchar", libc * 1e9 / NUMBERS);
+  fprintf(stderr, "%-10s %12.2f\n", "anx call", call * 1e9 / NUMBERS);
+  fprintf(stderr, "%-10s %12.2f\n", "anx inline", inl * 1e9 / NUMBERS);
+
+  return 0;
+}
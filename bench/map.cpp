@@ -0,0 +1,117 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/runtime/rt.h"
+
+//===---------------------------------------------------------------------===//
+// Map benchmark - Compares the Anx runtime maps against std::unordered_map.
+//
+// Keys are hashed inline with anx_hash_int exactly like compiled code does for
+// integer keys. Each table size is measured for inserts, successful and
+// failed lookups, and a full iteration over the entries.
+//===---------------------------------------------------------------------===//
+
+static double now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static std::vector<uint64_t> keys(size_t n, uint64_t seed) {
+  std::vector<uint64_t> k(n);
+  uint64_t x = seed | 1;
+
+  for (size_t i = 0; i < n; i++) {
+    x ^= x << 13, x ^= x >> 7, x ^= x << 17; // xorshift64
+    k[i] = x;
+  }
+
+  return k;
+}
+
+struct result {
+  double insert, hit, miss, iter;
+  uint64_t check;
+};
+
+static result bench_std(const std::vector<uint64_t> &k,
+                        const std::vector<uint64_t> &absent) {
+  result r = {};
+  std::unordered_map<uint64_t, uint64_t> m;
+
+  double t = now();
+  for (size_t i = 0; i < k.size(); i++)
+    m[k[i]] = i;
+  r.insert = now() - t;
+
+  t = now();
+  for (uint64_t key : k)
+    r.check += m.find(key)->second;
+  r.hit = now() - t;
+
+  t = now();
+  for (uint64_t key : absent)
+    r.check += m.count(key);
+  r.miss = now() - t;
+
+  t = now();
+  for (auto &e : m)
+    r.check += e.second;
+  r.iter = now() - t;
+
+  return r;
+}
+
+static result bench_anx(const std::vector<uint64_t> &k,
+                        const std::vector<uint64_t> &absent) {
+  result r = {};
+  anx_map_t *m = anx_map_new(8, 8, 0);
+
+  double t = now();
+  for (size_t i = 0; i < k.size(); i++)
+    *(uint64_t *)anx_map_insert(m, &k[i], anx_hash_int(k[i])) = i;
+  r.insert = now() - t;
+
+  t = now();
+  for (uint64_t key : k)
+    r.check += *(uint64_t *)anx_map_find(m, &key, anx_hash_int(key));
+  r.hit = now() - t;
+
+  t = now();
+  for (uint64_t key : absent)
+    r.check += anx_map_find(m, &key, anx_hash_int(key)) != nullptr;
+  r.miss = now() - t;
+
+  t = now();
+  for (int64_t i = anx_map_next(m, -1); i >= 0; i = anx_map_next(m, i))
+    r.check += *(uint64_t *)anx_map_val(m, i);
+  r.iter = now() - t;
+
+  anx_map_free(m);
+  return r;
+}
+
+int main(int argc, char **argv) {
+  size_t max = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1 << 22;
+
+  printf("%-10s %-6s %12s %12s %12s %12s\n", "entries", "table", "insert ns",
+         "hit ns", "miss ns", "iter ns");
+
+  for (size_t n = 1 << 10; n <= max; n <<= 4) {
+    std::vector<uint64_t> k = keys(n, n), absent = keys(n, ~n);
+
+    result s = bench_std(k, absent), a = bench_anx(k, absent);
+    if (s.check != a.check)
+      fprintf(stderr, "mismatched results for %zu entries\n", n);
+
+    for (auto [name, r] : {std::make_pair("std", s), std::make_pair("anx", a)})
+      printf("%-10zu %-6s %12.1f %12.1f %12.1f %12.1f\n", n, name,
+             r.insert * 1e9 / n, r.hit * 1e9 / n, r.miss * 1e9 / n,
+             r.iter * 1e9 / n);
+  }
+
+  return 0;
+}
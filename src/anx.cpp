@@ -1,4 +1,6 @@
 #include <ctype.h>
+#include <getopt.h>
+#include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
@@ -6,6 +8,7 @@
 
 #include "anx.h"
 #include "assembly/printer.h"
+#include "codegen/iface.h"
 #include "codegen/ir.h"
 #include "frontend/ast.h"
 #include "frontend/lexer.h"
@@ -20,32 +23,120 @@
 // 3. (codegen/ir.cpp) Generate LLVM IR from AST
 // 4. (codegen/opti.cpp) Optimize LLVM IR
 // 5. (assembly/printer.cpp) Assemble executable from IR
-// utils.cpp holds a few misc. large functions used in these steps.
+// utils.cpp holds a few misc. large functions used in these steps, diag.cpp
+// reports errors, and session.cpp embeds these steps in other programs.
 //
 //===---------------------------------------------------------------------===//
 
-std::istream *anx::stream = nullptr;
-std::string src;
+// parse the comma separated flags given to --fast-math
+llvm::FastMathFlags fast_math(std::string flags) {
+  llvm::FastMathFlags FMF;
+  std::stringstream ss(flags);
+
+  for (std::string flag; std::getline(ss, flag, ',');) {
+    if (flag == "fast")
+      FMF.setFast();
+    else if (flag == "reassoc")
+      FMF.setAllowReassoc();
+    else if (flag == "nnan")
+      FMF.setNoNaNs();
+    else if (flag == "ninf")
+      FMF.setNoInfs();
+    else if (flag == "nsz")
+      FMF.setNoSignedZeros();
+    else if (flag == "arcp")
+      FMF.setAllowReciprocal();
+    else if (flag == "contract")
+      FMF.setAllowContract();
+    else if (flag == "afn")
+      FMF.setApproxFunc();
+    else
+      anx::perr("unknown fast-math flag '" + flag + "' (use -h for help)");
+  }
+
+  return FMF;
+}
 
 int main(int argc, char **argv) {
-  std::string outfile = "a.out";
+  std::string outfile;
+  bool debug = false;
+
+  static const option longopts[] = {
+      {"fast-math", optional_argument, nullptr, 'F'},
+      {"no-overflow", no_argument, nullptr, 'N'},
+      {"frame-pointers", no_argument, nullptr, 'P'},
+      {"instrument", no_argument, nullptr, 'I'},
+      {"report-escapes", no_argument, nullptr, 'E'},
+      {nullptr, 0, nullptr, 0}};
 
   opterr = 0;
 
   int c;
-  while ((c = getopt(argc, argv, "ho:")) != -1) {
+  while ((c = getopt_long(argc, argv, "cgho:l:L:", longopts, nullptr)) !=
+         -1) {
     switch (c) {
     case 'o':
       outfile = optarg;
       break;
+    case 'c':
+      ir::is_module = true;
+      break;
+    case 'l':
+    case 'L':
+      printer::libs.push_back("-" + std::string(1, c) + optarg);
+      break;
+    case 'F':
+      ir::fmf = fast_math(optarg ? optarg : "fast");
+      iface::flags += " --fast-math=" + std::string(optarg ? optarg : "fast");
+      break;
+    case 'N':
+      ir::nsw = true;
+      iface::flags += " --no-overflow";
+      break;
+    case 'g':
+      debug = true;
+      iface::flags += " -g";
+      break;
+    case 'P':
+      ir::frame_pointers = true;
+      iface::flags += " --frame-pointers";
+      break;
+    case 'I':
+      ir::instrument = true;
+      break;
+    case 'E':
+      ir::report_escapes = true;
+      break;
     case '?':
-      anx::perr(std::string("unknown compiler option '-") + (char)optopt +
+      anx::perr("unknown compiler option '" +
+                (optopt ? std::string("-") + (char)optopt
+                        : std::string(argv[optind - 1])) +
                 "' (use -h for help)");
     case 'h':
       std::cerr << "USAGE: anx [options] file\n";
       std::cerr << "OPTIONS:\n";
       std::cerr << "  -v    Verbose mode\n";
       std::cerr << "  -h    Print this help message\n";
+      std::cerr << "  -g    Emit DWARF line tables, functions and variables\n";
+      std::cerr << "  -c    Compile a module to import: its object file, and\n";
+      std::cerr << "        its interface (.anxi) next to its source\n";
+      std::cerr << "  -l lib, -L dir\n";
+      std::cerr << "        Link with a C library, or look for them in dir\n";
+      std::cerr << "  --fast-math[=flags]\n";
+      std::cerr << "        Let float arithmetic break IEEE semantics, with\n";
+      std::cerr << "        any of reassoc, nnan, ninf, nsz, arcp, contract\n";
+      std::cerr << "        and afn, or all of them\n";
+      std::cerr << "  --no-overflow\n";
+      std::cerr << "        Assume signed integer arithmetic never overflows\n";
+      std::cerr << "  --frame-pointers\n";
+      std::cerr << "        Keep frame pointers, for profilers that unwind\n";
+      std::cerr << "        through them\n";
+      std::cerr << "  --instrument\n";
+      std::cerr << "        Time functions and count their calls and the trips\n";
+      std::cerr << "        of loops, reported when the program exits\n";
+      std::cerr << "  --report-escapes\n";
+      std::cerr << "        Explain why each object that is not moved onto\n";
+      std::cerr << "        the stack may outlive its function\n";
     default:
       exit(1);
     }
@@ -53,6 +144,9 @@ int main(int argc, char **argv) {
 
   if (argc - optind != 1) {
     // shell JIT mode
+    //
+    // nothing is executed yet. code compiled here can be run by an
+    // anx::CompilerSession, whose perf map lets perf name it
 
     anx::stream = &std::cin;
 
@@ -62,62 +156,45 @@ int main(int argc, char **argv) {
   } else {
     // compiler mode
 
-    src = argv[optind];
+    std::string src = anx::file = argv[optind];
+
+    // the profiler numbers the functions of a single module
+    if (ir::is_module && ir::instrument)
+      anx::perr("--instrument applies to programs, not to modules compiled "
+                "with -c");
+
+    // modules are compiled into an object file named after their source
+    if (outfile.empty())
+      outfile = ir::is_module ? src.substr(0, src.rfind(".anx")) + ".o"
+                              : "a.out";
 
     std::ifstream f(src);
     if (!f.is_open())
       anx::perr("could not open file '" + src + "'");
 
     anx::stream = &f;
+    iface::init(src);
 
     lex::eat(); // generate the first token
     auto prog = ast::unit();
 
-    ir::init();
+    printer::init();
+    ir::init(printer::machine.get());
+    if (debug)
+      ir::dwarf(src);
 
     prog->codegen();
 
-    printer::init();
-    printer::print();
-    printer::link(outfile);
-    printer::clean();
+    if (ir::is_module) {
+      std::string image = iface::image(*prog, outfile);
+      printer::print(outfile);
+      iface::write(image);
+    } else {
+      printer::print("out.o");
+      printer::link(outfile);
+      printer::clean();
+    }
   }
 
   return 0;
 }
-
-void anx::perr(std::string msg, Pos pos, size_t size) {
-  std::string line = lex::src[pos.r - 1], ep0;
-  size_t p = pos.c, begin = line.find_first_not_of(" \t\n"),
-         end = line.find_last_not_of(" \t\n");
-  if (begin != std::string::npos) {
-    ep0 = line.substr(0, begin);
-    line = line.substr(begin, end - begin + 1);
-    if (p > begin)
-      p -= begin;
-    else
-      p = 0;
-  }
-
-  size_t len = std::max(line.size(), p + size);
-
-  std::string ep1(p, '~'), ep2(size, '^'), ep3(len - size - p, '~');
-
-  std::cerr << "\033[0;31merror: \033[0m" << msg << '\n';
-
-  std::cerr << "  --> " << src << ':' << pos.r << ':' << pos.c + 1;
-  if (size > 1)
-    std::cerr << '-' << pos.c + size;
-  std::cerr << '\n';
-
-  std::cerr << "   | " << ep0 << line << '\n';
-  std::cerr << "   | " << ep0 << ep1 << "\033[0;31m" << ep2 << "\033[0m" << ep3
-            << '\n';
-
-  exit(1);
-}
-
-void anx::perr(std::string msg) {
-  std::cerr << "\033[0;31merror: \033[0m" << msg << '\n';
-  exit(1);
-}
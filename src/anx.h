@@ -15,6 +15,7 @@
 #include "llvm/Analysis/Passes.h"
 
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/BuiltinGCs.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
@@ -27,6 +28,8 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include "session.h"
+
 namespace anx {
 struct Pos {
   size_t r, c;
@@ -34,6 +37,13 @@ struct Pos {
 
 [[noreturn]] void perr(std::string msg);
 [[noreturn]] void perr(std::string msg, Pos pos, size_t size = 1);
+void warn(std::string msg, Pos pos, size_t size = 1);
+void note(std::string msg, Pos pos, size_t size = 1);
+
+extern thread_local std::istream *stream;
 
-extern std::istream *stream;
+// the name of the file being compiled, and the diagnostics reported while a
+// session compiles, which are collected instead of printed
+extern thread_local std::string file;
+extern thread_local std::vector<Diagnostic> *diagnostics;
 } // namespace anx
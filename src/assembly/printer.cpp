@@ -1,21 +1,35 @@
+#include <mutex>
+
 #include "printer.h"
+#include "../codegen/iface.h"
 #include "../codegen/ir.h"
+#include "../codegen/opti.h"
 
 //===---------------------------------------------------------------------===//
 // Printer - This module houses the assembly and linking stages.
 //===---------------------------------------------------------------------===//
 
-void printer::init() {
-  llvm::InitializeAllTargetInfos();
-  llvm::InitializeAllTargets();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmParsers();
-  llvm::InitializeAllAsmPrinters();
+thread_local std::unique_ptr<llvm::TargetMachine> printer::machine;
+thread_local std::vector<std::string> printer::libs;
+
+// register the targets, once for all the threads that compile
+void printer::targets() {
+  static std::once_flag registered;
+  std::call_once(registered, [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
+  });
 }
 
-void printer::print() {
+// set up the machine code is generated for. it exists before any IR does, so
+// that the optimizer can consult the target's costs and vector widths.
+void printer::init() {
+  targets();
+
   auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-  ir::mod->setTargetTriple(TargetTriple);
 
   std::string Error;
 
@@ -27,32 +41,66 @@ void printer::print() {
   auto Features = "";
 
   llvm::TargetOptions opt;
-  auto RM = std::optional<llvm::Reloc::Model>();
-  auto TheTargetMachine =
-      Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM,
-                                  std::nullopt, llvm::CodeGenOpt::Aggressive);
-
-  ir::mod->setDataLayout(TheTargetMachine->createDataLayout());
-
-  auto Filename = "out.o";
-  std::error_code EC;
-  llvm::raw_fd_ostream dest(Filename, EC, llvm::sys::fs::OF_None);
+  auto RM = std::optional<llvm::Reloc::Model>(llvm::Reloc::PIC_);
+  machine.reset(Target->createTargetMachine(TargetTriple, CPU, Features, opt,
+                                            RM, std::nullopt,
+                                            llvm::CodeGenOpt::Aggressive));
+}
 
-  if (EC)
-    anx::perr("could not open file '" + EC.message() + "'");
+// finish optimizing the module and write its object code to dest
+void printer::emit(llvm::raw_pwrite_stream &dest) {
+  opti::coro(*ir::mod, machine.get());
 
   llvm::legacy::PassManager pass;
   auto FileType = llvm::CGFT_ObjectFile;
 
-  if (TheTargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType))
+  opti::late(pass);
+
+  if (machine->addPassesToEmitFile(pass, dest, nullptr, FileType))
     anx::perr("targetmachine cannot emit a file of this type");
 
   pass.run(*ir::mod);
+  opti::check();
+}
+
+void printer::print(std::string filename) {
+  std::error_code EC;
+  llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::OF_None);
+
+  if (EC)
+    anx::perr("could not open file '" + EC.message() + "'");
+
+  emit(dest);
   dest.flush();
 }
 
+// location of the runtime library, overridable through the environment
+std::string runtime() {
+  const char *env = getenv("ANX_RUNTIME");
+  if (env && *env)
+    return env;
+
+  return ANX_RUNTIME;
+}
+
 void printer::link(std::string filename) {
-  std::string linkercmd = "cc -O3 out.o -o" + filename;
+  std::string flags = " -lpthread";
+
+  // stack maps hold absolute code addresses, which would otherwise need text
+  // relocations in a position independent executable
+  if (ir::mod->getFunction("anx_gc_new") || iface::gc)
+    flags += " -no-pie";
+
+  // the modules imported and the libraries asked for, which come before the
+  // runtime they call into
+  std::string objects;
+  for (std::string &o : iface::objects)
+    objects += " " + o;
+  for (std::string &l : libs)
+    objects += " " + l;
+
+  std::string linkercmd =
+      "cc -O3 out.o" + objects + " " + runtime() + flags + " -o" + filename;
   system(linkercmd.c_str());
 }
 
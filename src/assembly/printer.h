@@ -3,8 +3,16 @@
 #include "../anx.h"
 
 namespace printer {
+extern thread_local std::unique_ptr<llvm::TargetMachine> machine;
+
+// the -l and -L options given, for the libraries that extern functions are
+// defined in
+extern thread_local std::vector<std::string> libs;
+
+void targets();
 void init();
-void print();
+void emit(llvm::raw_pwrite_stream &dest);
+void print(std::string filename);
 void link(std::string filename);
 void clean();
 } // namespace printer
@@ -0,0 +1,388 @@
+#include "abi.h"
+#include "ir.h"
+
+//===---------------------------------------------------------------------===//
+// ABI - This module lowers calls to C functions to the C calling convention.
+//
+// LLVM leaves it to frontends to decide how C passes a value: the backend only
+// knows how to pass the types of its own, which are not what C code compiled
+// by another compiler expects for an aggregate. Values are passed as the
+// x86-64 System V ABI says C passes the types they stand for, the same way
+// clang lowers them:
+//   - scalars are passed directly, bools and integers of less than 32 bits
+//     extended by the caller as their signedness says
+//   - structs, strings and arrays of up to 16 bytes are split into eight byte
+//     parts, passed in an SSE register if they only hold floats and in an
+//     integer register otherwise. they are copied to the stack if there are
+//     not enough registers left for all of their parts.
+//   - larger ones are copied to the stack, or returned through memory that
+//     the caller provides
+//   - empty ones are not passed at all
+// Variadic arguments get the default promotions of C: floats are passed as
+// doubles, and bools and integers of less than 32 bits as 32 bit integers.
+// Aggregates are split and rebuilt in registers, so that only those copied to
+// memory go through it.
+//===---------------------------------------------------------------------===//
+
+// how a value is passed: as it is, split into parts, through a pointer to a
+// copy of it, or not at all
+struct Lowering {
+  enum { direct, split, memory, ignore } kind;
+  llvm::Type *T;
+  std::vector<llvm::Type *> parts;
+  unsigned gprs = 0, sses = 0; // the registers it takes
+};
+
+// a scalar field of an aggregate, by the indices that reach it
+struct Leaf {
+  std::vector<unsigned> path;
+  uint64_t off; // in bytes
+  llvm::Type *T;
+};
+
+bool sysv() {
+  llvm::Triple T(ir::mod->getTargetTriple());
+  return T.getArch() == llvm::Triple::x86_64 && !T.isOSWindows();
+}
+
+void leaves(llvm::Type *T, uint64_t off, std::vector<unsigned> &path,
+            std::vector<Leaf> &out) {
+  auto *ST = llvm::dyn_cast<llvm::StructType>(T);
+  if (!ST) {
+    out.push_back({path, off, T});
+    return;
+  }
+
+  const llvm::StructLayout *SL = ir::mod->getDataLayout().getStructLayout(ST);
+  for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i) {
+    path.push_back(i);
+    leaves(ST->getElementType(i), off + SL->getElementOffset(i), path, out);
+    path.pop_back();
+  }
+}
+
+std::vector<Leaf> leaves(llvm::Type *T) {
+  std::vector<Leaf> out;
+  std::vector<unsigned> path;
+  leaves(T, 0, path, out);
+  return out;
+}
+
+// the bits a leaf takes in memory
+uint64_t bits(llvm::Type *T) {
+  return ir::mod->getDataLayout().getTypeStoreSizeInBits(T);
+}
+
+Lowering lower(ty::Type t) {
+  Lowering l;
+  l.T = ty::toLLVM(t, true);
+  l.kind = Lowering::direct;
+
+  if (l.T->isVoidTy())
+    return l;
+
+  if (!l.T->isStructTy()) {
+    if (l.T->isFloatingPointTy())
+      l.sses = 1;
+    else
+      l.gprs = l.T->isIntegerTy(128) ? 2 : 1;
+    return l;
+  }
+
+  uint64_t size = ir::mod->getDataLayout().getTypeAllocSize(l.T);
+  if (!size) {
+    l.kind = Lowering::ignore;
+    return l;
+  }
+  if (size > 16) {
+    l.kind = Lowering::memory;
+    return l;
+  }
+
+  // an eight byte part holding anything but floats goes in an integer
+  // register
+  bool sse[2] = {true, true};
+  unsigned floats[2] = {0, 0};
+  for (const Leaf &f : leaves(l.T))
+    for (uint64_t i = f.off / 8; i <= (f.off * 8 + bits(f.T) - 1) / 64; i++) {
+      sse[i] &= f.T->isFloatingPointTy();
+      floats[i] += f.T->isFloatTy();
+    }
+
+  l.kind = Lowering::split;
+  for (uint64_t i = 0; i < (size + 7) / 8; i++) {
+    uint64_t bytes = std::min<uint64_t>(8, size - i * 8);
+    if (!sse[i]) {
+      l.parts.push_back(llvm::IntegerType::get(*ir::ctx, bytes * 8));
+      l.gprs++;
+      continue;
+    }
+
+    llvm::Type *Float = llvm::Type::getFloatTy(*ir::ctx);
+    if (floats[i] == 2)
+      l.parts.push_back(llvm::FixedVectorType::get(Float, 2));
+    else if (bytes <= 4)
+      l.parts.push_back(Float);
+    else
+      l.parts.push_back(llvm::Type::getDoubleTy(*ir::ctx));
+    l.sses++;
+  }
+
+  return l;
+}
+
+// how the arguments and the result of a call are passed, and the parameters
+// and attributes that they take
+struct Plan {
+  Lowering ret;
+  std::vector<Lowering> args;
+  std::vector<llvm::Type *> params;
+  llvm::AttributeList attrs;
+};
+
+llvm::Attribute::AttrKind extension(ty::Type t) {
+  if (ty::isBool(t) || ((ty::isUInt(t) || ty::isSInt(t)) && ty::width(t) < 32))
+    return ty::isSInt(t) ? llvm::Attribute::SExt : llvm::Attribute::ZExt;
+  return llvm::Attribute::None;
+}
+
+llvm::Align alignment(llvm::Type *T) {
+  return std::max(llvm::Align(8), ir::mod->getDataLayout().getABITypeAlign(T));
+}
+
+Plan plan(ty::Type ret, std::vector<ty::Type> types) {
+  llvm::LLVMContext &C = *ir::ctx;
+  llvm::Type *P = llvm::PointerType::get(C, 0);
+  unsigned gprs = 6, sses = 8;
+
+  Plan p;
+  p.ret = lower(ret);
+  if (p.ret.kind == Lowering::memory) {
+    p.params.push_back(P);
+    p.attrs = p.attrs.addParamAttribute(
+        C, 0, llvm::Attribute::getWithStructRetType(C, p.ret.T));
+    p.attrs = p.attrs.addParamAttribute(
+        C, 0, llvm::Attribute::getWithAlignment(C, alignment(p.ret.T)));
+    gprs--;
+  } else if (extension(ret) != llvm::Attribute::None)
+    p.attrs = p.attrs.addRetAttribute(C, extension(ret));
+
+  for (ty::Type t : types) {
+    Lowering l = lower(t);
+    if (l.kind == Lowering::split && (l.gprs > gprs || l.sses > sses))
+      l.kind = Lowering::memory;
+
+    unsigned i = p.params.size();
+    if (l.kind == Lowering::direct) {
+      p.params.push_back(l.T);
+      if (extension(t) != llvm::Attribute::None)
+        p.attrs = p.attrs.addParamAttribute(C, i, extension(t));
+    } else if (l.kind == Lowering::split)
+      p.params.insert(p.params.end(), l.parts.begin(), l.parts.end());
+    else if (l.kind == Lowering::memory) {
+      p.params.push_back(P);
+      p.attrs = p.attrs.addParamAttribute(
+          C, i, llvm::Attribute::getWithByValType(C, l.T));
+      p.attrs = p.attrs.addParamAttribute(
+          C, i, llvm::Attribute::getWithAlignment(C, alignment(l.T)));
+    }
+
+    if (l.kind == Lowering::direct || l.kind == Lowering::split) {
+      gprs -= std::min(gprs, l.gprs);
+      sses -= std::min(sses, l.sses);
+    }
+    p.args.push_back(l);
+  }
+
+  return p;
+}
+
+llvm::Type *result(const Lowering &l) {
+  if (l.kind == Lowering::direct)
+    return l.T;
+  if (l.kind == Lowering::split)
+    return l.parts.size() == 1 ? l.parts[0]
+                               : llvm::StructType::get(*ir::ctx, l.parts);
+  return llvm::Type::getVoidTy(*ir::ctx);
+}
+
+// split the aggregate v into the parts it is passed in
+std::vector<llvm::Value *> pack(llvm::IRBuilder<> &b, llvm::Value *v,
+                                const Lowering &l) {
+  llvm::Value *words[2] = {nullptr, nullptr};
+
+  for (const Leaf &f : leaves(l.T)) {
+    llvm::Value *x = b.CreateExtractValue(v, f.path);
+    llvm::Type *I = b.getIntNTy(bits(f.T));
+    if (f.T->isPointerTy())
+      x = b.CreatePtrToInt(x, I);
+    else if (f.T->isIntegerTy(1))
+      x = b.CreateZExt(x, I);
+    else
+      x = b.CreateBitCast(x, I);
+
+    for (uint64_t lo = 0; lo < bits(f.T); lo += 64) {
+      uint64_t at = f.off * 8 + lo;
+      llvm::Value *c =
+          b.CreateZExtOrTrunc(lo ? b.CreateLShr(x, lo) : x, b.getInt64Ty());
+      if (at % 64)
+        c = b.CreateShl(c, at % 64);
+
+      llvm::Value *&w = words[at / 64];
+      w = w ? b.CreateOr(w, c, "part") : c;
+    }
+  }
+
+  std::vector<llvm::Value *> parts;
+  for (size_t i = 0; i < l.parts.size(); i++) {
+    llvm::Value *w = words[i] ? words[i] : b.getInt64(0);
+    parts.push_back(b.CreateBitCast(
+        b.CreateTrunc(w, b.getIntNTy(bits(l.parts[i]))), l.parts[i]));
+  }
+  return parts;
+}
+
+// rebuild an aggregate from the parts it was passed in
+llvm::Value *unpack(llvm::IRBuilder<> &b, std::vector<llvm::Value *> parts,
+                    const Lowering &l) {
+  llvm::Value *words[2];
+  for (size_t i = 0; i < parts.size(); i++)
+    words[i] = b.CreateZExt(
+        b.CreateBitCast(parts[i], b.getIntNTy(bits(l.parts[i]))),
+        b.getInt64Ty());
+
+  llvm::Value *v = llvm::UndefValue::get(l.T);
+  for (const Leaf &f : leaves(l.T)) {
+    llvm::Type *I = b.getIntNTy(bits(f.T));
+    llvm::Value *x = nullptr;
+    for (uint64_t lo = 0; lo < bits(f.T); lo += 64) {
+      uint64_t at = f.off * 8 + lo;
+      llvm::Value *c = words[at / 64];
+      if (at % 64)
+        c = b.CreateLShr(c, at % 64);
+      c = b.CreateZExtOrTrunc(c, I);
+      if (lo)
+        c = b.CreateShl(c, lo);
+
+      x = x ? b.CreateOr(x, c) : c;
+    }
+
+    if (f.T->isPointerTy())
+      x = b.CreateIntToPtr(x, f.T);
+    else if (f.T->isIntegerTy(1))
+      x = b.CreateICmpNE(x, llvm::Constant::getNullValue(I));
+    else
+      x = b.CreateBitCast(x, f.T);
+    v = b.CreateInsertValue(v, x, f.path);
+  }
+
+  return v;
+}
+
+// memory for a copy of a value of type T, in the entry block so that it is
+// only allocated once
+llvm::Value *slot(llvm::IRBuilder<> &b, llvm::Type *T) {
+  llvm::BasicBlock &Entry = b.GetInsertBlock()->getParent()->getEntryBlock();
+  llvm::IRBuilder<> e(&Entry, Entry.begin());
+  llvm::AllocaInst *A = e.CreateAlloca(T, nullptr, "c.arg");
+  A->setAlignment(alignment(T));
+  return A;
+}
+
+bool refs(ty::Type t) {
+  if (ty::isRef(t))
+    return true;
+
+  if (ty::isStruct(t) || ty::isArr(t))
+    for (ty::Type p : ty::compound(t).params)
+      if (refs(p))
+        return true;
+  return false;
+}
+
+void abi::check(ty::Type t, anx::Pos pos, size_t s) {
+  // C code could keep them where the garbage collector does not look
+  if (refs(t))
+    anx::perr("references cannot be passed to or returned from C functions",
+              pos, s);
+
+  if (!sysv() && (ty::isStruct(t) || ty::isArr(t) || ty::isStr(t)))
+    anx::perr("'" + ty::toString(t) +
+                  "' can only be passed to C functions on x86-64",
+              pos, s);
+}
+
+llvm::Function *abi::declare(std::string name, ty::Type ret,
+                             std::vector<ty::Type> types, bool variadic) {
+  Plan p = plan(ret, types);
+
+  llvm::FunctionType *FT =
+      llvm::FunctionType::get(result(p.ret), p.params, variadic);
+  llvm::Function *F = llvm::Function::Create(
+      FT, llvm::Function::ExternalLinkage, name, ir::mod.get());
+  F->setAttributes(p.attrs);
+
+  // C code has no safepoints
+  F->addFnAttr("gc-leaf-function");
+  return F;
+}
+
+// the functions of Anx code are mangled, but C functions keep their names
+bool abi::is_c(llvm::Function *F) {
+  return !F->getName().endswith(".anx") && F->getName() != "main";
+}
+
+llvm::Value *abi::call(llvm::IRBuilder<> &b, llvm::Function *F, ty::Type ret,
+                       std::vector<ty::Type> types,
+                       std::vector<llvm::Value *> args, size_t fixed) {
+  for (size_t i = fixed; i < types.size(); i++) {
+    ty::Type t = types[i];
+    if (ty::isSingle(t)) {
+      args[i] = b.CreateFPExt(args[i], b.getDoubleTy());
+      types[i] = ty::ty_f64;
+    } else if (extension(t) != llvm::Attribute::None) {
+      args[i] = ty::isSInt(t) ? b.CreateSExt(args[i], b.getInt32Ty())
+                              : b.CreateZExt(args[i], b.getInt32Ty());
+      types[i] = ty::isSInt(t) ? ty::ty_i32 : ty::ty_u32;
+    }
+  }
+
+  Plan p = plan(ret, types);
+
+  std::vector<llvm::Value *> vals;
+  llvm::Value *out = nullptr;
+  if (p.ret.kind == Lowering::memory)
+    vals.push_back(out = slot(b, p.ret.T));
+
+  for (size_t i = 0; i < args.size(); i++) {
+    const Lowering &l = p.args[i];
+    if (l.kind == Lowering::direct)
+      vals.push_back(args[i]);
+    else if (l.kind == Lowering::split) {
+      std::vector<llvm::Value *> parts = pack(b, args[i], l);
+      vals.insert(vals.end(), parts.begin(), parts.end());
+    } else if (l.kind == Lowering::memory) {
+      llvm::Value *copy = slot(b, l.T);
+      b.CreateStore(args[i], copy);
+      vals.push_back(copy);
+    }
+  }
+
+  llvm::CallInst *C = b.CreateCall(
+      F, vals, F->getReturnType()->isVoidTy() ? "" : "call");
+  C->setAttributes(p.attrs);
+
+  switch (p.ret.kind) {
+  case Lowering::memory:
+    return b.CreateLoad(p.ret.T, out, "ret");
+  case Lowering::ignore:
+    return llvm::Constant::getNullValue(p.ret.T);
+  case Lowering::split:
+    if (p.ret.parts.size() == 1)
+      return unpack(b, {C}, p.ret);
+    return unpack(b, {b.CreateExtractValue(C, 0), b.CreateExtractValue(C, 1)},
+                  p.ret);
+  default:
+    return C;
+  }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../anx.h"
+#include "../utils.h"
+
+namespace abi {
+// check that values of type t can be passed to and returned from C functions
+void check(ty::Type t, anx::Pos pos, size_t s);
+
+// declare the C function name as C code compiled for the target sees it
+llvm::Function *declare(std::string name, ty::Type ret,
+                        std::vector<ty::Type> types, bool variadic);
+bool is_c(llvm::Function *F);
+
+// call the C function F with args of types, of which the first fixed are its
+// declared parameters and the others are passed through its `...`
+llvm::Value *call(llvm::IRBuilder<> &b, llvm::Function *F, ty::Type ret,
+                  std::vector<ty::Type> types, std::vector<llvm::Value *> args,
+                  size_t fixed);
+} // namespace abi
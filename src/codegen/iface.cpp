@@ -0,0 +1,489 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <set>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "iface.h"
+#include "ir.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+//===---------------------------------------------------------------------===//
+// Iface - This module reads and writes the interfaces of imported modules.
+//
+// Compiling a module with -c writes its object file and, next to its source,
+// an interface: a binary .anxi file with all that importers need to know about
+// the module without parsing it. That is the structs it uses, the signatures
+// of its pub functions, the bitcode of those that are inline, and the object
+// files a program that imports it is linked with. Interfaces are mapped into
+// memory and read in place. Each one describes only its own module, so an
+// import costs the same however many modules lie below it.
+//
+// An interface older than its source, or than the interface of one of the
+// modules it imports, is rebuilt first by running the compiler on the module.
+//
+// Layout, with numbers little endian and strings prefixed by their length:
+//   "ANXI", u32 version, u8 whether the module or its imports use the gc
+//   u32 n, n * str    sources of the modules it imports
+//   u32 n, n * str    object files to link with, its own first
+//   u32 n, n * { str name, u8 soa, u32 n, n * { str field, type } }
+//   u32 n, n * { str name, u8 attrs, u8 async, type ret,
+//                u32 n, n * { str arg, type } }
+//   u32 n, n bytes    bitcode, 8 byte aligned
+// A type is a primitive type id below 0x80, or 0x80 plus a compound kind
+// followed by its parameters, or by the index of a struct above.
+//===---------------------------------------------------------------------===//
+
+const uint32_t version = 1;
+
+thread_local std::string iface::flags;
+thread_local std::vector<std::string> iface::objects;
+thread_local bool iface::gc = false;
+
+thread_local std::string base; // directory of the module being compiled
+thread_local std::string self; // and its source
+// sources of the modules waiting on this one
+thread_local std::vector<std::string> chain;
+
+struct Interface {
+  std::string src;
+  const char *data = nullptr;
+  size_t size = 0;
+  uint64_t mtime = 0;
+  bool gc = false;
+  std::vector<std::string> deps, objects;
+  const char *rest = nullptr; // structs, functions and bitcode
+  const char *code = nullptr;
+  size_t ncode = 0;
+};
+
+// interfaces by the path of their source, and the modules imported here
+thread_local std::map<std::string, Interface> interfaces;
+thread_local std::vector<std::string> imports;
+thread_local std::set<std::string> linked;
+
+struct Reader {
+  const char *p, *end;
+  std::string path;
+
+  const char *take(size_t n) {
+    if ((size_t)(end - p) < n)
+      anx::perr("the interface '" + path + "' is corrupt");
+
+    const char *q = p;
+    p += n;
+    return q;
+  }
+
+  uint8_t u8() { return *take(1); }
+
+  uint32_t u32() {
+    uint32_t v;
+    memcpy(&v, take(4), 4);
+    return v;
+  }
+
+  std::string str() {
+    uint32_t n = u32();
+    return std::string(take(n), n);
+  }
+
+  ty::Type type(const std::vector<ty::Type> &structs) {
+    uint8_t tag = u8();
+    if (tag < ty::ty_compound)
+      return (ty::Type)tag;
+
+    switch (tag - 0x80) {
+    case ty::kind_map: {
+      ty::Type key = type(structs);
+      return ty::map(key, type(structs));
+    }
+    case ty::kind_task:
+      return ty::task(type(structs));
+    case ty::kind_future:
+      return ty::future(type(structs));
+    case ty::kind_arr:
+      return ty::arr(type(structs));
+    case ty::kind_struct: {
+      uint32_t i = u32();
+      if (i < structs.size())
+        return structs[i];
+    }
+    }
+
+    anx::perr("the interface '" + path + "' is corrupt");
+  }
+};
+
+struct Writer {
+  std::string out;
+
+  void u8(uint8_t v) { out += (char)v; }
+  void u32(uint32_t v) { out.append((const char *)&v, 4); }
+
+  void str(const std::string &v) {
+    u32(v.size());
+    out += v;
+  }
+
+  void type(ty::Type t, const std::map<ty::Type, uint32_t> &structs) {
+    if (t < ty::ty_compound) {
+      u8(t);
+      return;
+    }
+
+    u8(0x80 + ty::compound(t).kind);
+    if (ty::isStruct(t))
+      u32(structs.at(t));
+    else
+      for (ty::Type p : ty::compound(t).params)
+        type(p, structs);
+  }
+};
+
+std::string absolute(std::string path) {
+  char buf[PATH_MAX];
+  return realpath(path.c_str(), buf) ? buf : path;
+}
+
+uint64_t mtime(const struct stat &st) {
+  return st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+}
+
+uint64_t mtime(std::string path) {
+  struct stat st;
+  return stat(path.c_str(), &st) ? 0 : mtime(st);
+}
+
+// map the interface of i.src into memory and read its header, or return
+// false if there is none that this compiler can read
+bool map(Interface &i) {
+  std::string path = i.src + "i";
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  void *p = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size >= 9)
+    p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return false;
+
+  i.data = (const char *)p;
+  i.size = st.st_size;
+  i.mtime = mtime(st);
+
+  uint32_t v;
+  memcpy(&v, i.data + 4, 4);
+  if (memcmp(i.data, "ANXI", 4) || v != version) {
+    munmap(p, i.size);
+    i.data = nullptr;
+    return false;
+  }
+
+  Reader r{i.data + 8, i.data + i.size, path};
+  i.gc = r.u8();
+  for (uint32_t n = r.u32(); n; n--)
+    i.deps.push_back(r.str());
+  for (uint32_t n = r.u32(); n; n--)
+    i.objects.push_back(r.str());
+  i.rest = r.p;
+
+  return true;
+}
+
+void unmap(Interface &i) {
+  if (i.data)
+    munmap((void *)i.data, i.size);
+
+  i.data = nullptr;
+  i.deps.clear();
+  i.objects.clear();
+}
+
+// compile the module at src with -c, which writes its object file and its
+// interface
+void build(std::string src, anx::Pos pos, size_t s) {
+  char exe[PATH_MAX];
+  ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (n < 0)
+    anx::perr("could not locate the compiler to build imports with");
+
+  std::string cmd =
+      "'" + std::string(exe, n) + "'" + iface::flags + " -c '" + src + "'";
+  if (system(cmd.c_str()))
+    anx::perr("could not compile the imported module '" + src + "'", pos, s);
+}
+
+// the interface of the module at src, built first if it is out of date
+Interface &interface(std::string src, anx::Pos pos, size_t s) {
+  auto it = interfaces.find(src);
+  if (it != interfaces.end())
+    return it->second;
+
+  if (std::find(chain.begin(), chain.end(), src) != chain.end())
+    anx::perr("modules cannot import each other in a cycle", pos, s);
+
+  Interface i;
+  i.src = src;
+
+  bool fresh = map(i) && i.mtime >= mtime(src);
+  for (size_t k = 0; fresh && k < i.deps.size(); k++)
+    fresh = interface(i.deps[k], pos, s).mtime <= i.mtime;
+
+  if (!fresh) {
+    unmap(i);
+    build(src, pos, s);
+    if (!map(i))
+      anx::perr("'" + src + "' was compiled, but left no interface", pos, s);
+  }
+
+  return interfaces[src] = i;
+}
+
+// Set up the imports of the module at src. The modules this one is imported
+// by are passed down through the environment to catch import cycles.
+void iface::init(std::string src) {
+  size_t slash = src.rfind('/');
+  base = slash == std::string::npos ? "." : src.substr(0, slash);
+  self = absolute(src);
+
+  const char *env = getenv("ANX_IMPORTING");
+  std::stringstream ss(env ? env : "");
+  for (std::string m; std::getline(ss, m, ':');)
+    if (!m.empty())
+      chain.push_back(m);
+  chain.push_back(self);
+
+  std::string importing;
+  for (std::string &m : chain)
+    importing += (importing.empty() ? "" : ":") + m;
+  setenv("ANX_IMPORTING", importing.c_str(), 1);
+}
+
+// Import the module at name, relative to the module being compiled: its
+// structs are declared right away, and its pub functions are returned as
+// prototypes to be declared along with the functions written here.
+std::vector<std::unique_ptr<ast::FnDecl>>
+iface::load(std::string name, anx::Pos pos, size_t s) {
+  // imports are found next to the importing file, which a session lacks
+  if (ir::jit)
+    anx::perr("modules cannot be imported into a session", pos, s);
+
+  std::string src = base + "/" + name + ".anx";
+  if (access(src.c_str(), F_OK))
+    anx::perr("cannot find module '" + name + "' at '" + src + "'", pos, s);
+
+  src = absolute(src);
+  if (std::find(imports.begin(), imports.end(), src) != imports.end())
+    return {};
+
+  Interface &i = interface(src, pos, s);
+  imports.push_back(src);
+
+  gc |= i.gc;
+  for (std::string &o : i.objects)
+    if (linked.insert(o).second)
+      objects.push_back(o);
+
+  Reader r{i.rest, i.data + i.size, src + "i"};
+
+  // a struct reaches every module that imports the one declaring it, maybe
+  // along several paths
+  std::vector<ty::Type> structs;
+  for (uint32_t n = r.u32(); n; n--) {
+    std::string sname = r.str();
+    bool soa = r.u8();
+
+    std::vector<std::string> fields;
+    std::vector<ty::Type> types;
+    for (uint32_t f = r.u32(); f; f--) {
+      fields.push_back(r.str());
+      types.push_back(r.type(structs));
+    }
+
+    ty::Type t = ty::named(sname);
+    if (ty::isVoid(t))
+      t = ty::structure(sname, fields, types, soa);
+    else if (ty::compound(t).fields != fields ||
+             ty::compound(t).params != types || ty::compound(t).soa != soa)
+      anx::perr("struct '" + sname + "' of '" + name +
+                    "' differs from the one declared before",
+                pos, s);
+
+    structs.push_back(t);
+  }
+
+  std::vector<std::unique_ptr<ast::FnDecl>> decls;
+  for (uint32_t n = r.u32(); n; n--) {
+    std::string fname = r.str();
+    uint8_t attrs = r.u8();
+    bool is_async = r.u8();
+    ty::Type type = r.type(structs);
+
+    std::vector<std::string> args;
+    std::vector<ty::Type> types;
+    for (uint32_t a = r.u32(); a; a--) {
+      args.push_back(r.str());
+      types.push_back(r.type(structs));
+    }
+
+    decls.push_back(std::make_unique<ast::FnDecl>(
+        fname, type, args, types, std::vector<ty::Type>(), nullptr, true,
+        is_async, attrs, pos, pos, pos));
+  }
+
+  i.ncode = r.u32();
+  r.take((8 - (r.p - i.data) % 8) % 8);
+  i.code = r.take(i.ncode);
+
+  return decls;
+}
+
+// Link in the bodies of the inline functions of the modules imported here, so
+// that calls to them are inlined as if they were written here. Only those
+// that are called are taken.
+void iface::link() {
+  for (std::string &src : imports) {
+    Interface &i = interfaces.at(src);
+    if (!i.ncode)
+      continue;
+
+    auto M = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(i.code, i.ncode), src + "i"),
+        *ir::ctx);
+    if (!M)
+      anx::perr("the interface '" + src + "i' holds invalid bitcode: " +
+                llvm::toString(M.takeError()));
+
+    if (llvm::Linker::linkModules(*ir::mod, std::move(*M),
+                                  llvm::Linker::LinkOnlyNeeded))
+      anx::perr("could not link the inline functions of '" + src + "'");
+  }
+}
+
+// The bitcode of the functions mangled as in inl, and of the internal
+// functions they use. They are available_externally: importers may inline
+// them, and call the module's own copy otherwise.
+std::string bitcode(const std::set<std::string> &inl) {
+  if (inl.empty())
+    return "";
+
+  llvm::ValueToValueMapTy VM;
+  std::unique_ptr<llvm::Module> M =
+      llvm::CloneModule(*ir::mod, VM, [&](const llvm::GlobalValue *G) {
+        return G->hasLocalLinkage() || inl.count(G->getName().str());
+      });
+
+  // the stack map label belongs to the object file of the module alone
+  M->setModuleInlineAsm("");
+  llvm::StripDebugInfo(*M);
+
+  llvm::legacy::PassManager pm;
+  pm.add(llvm::createGlobalDCEPass());
+  pm.run(*M);
+
+  for (const std::string &name : inl)
+    M->getFunction(name)->setLinkage(
+        llvm::GlobalValue::AvailableExternallyLinkage);
+
+  std::string code;
+  llvm::raw_string_ostream os(code);
+  llvm::WriteBitcodeToFile(*M, os);
+  os.flush();
+
+  return code;
+}
+
+// Get the interface of the module generated from prog, whose object file is
+// written to object. It is taken before the module is optimized as a whole,
+// so that inline functions are still the code each importer would generate.
+std::string iface::image(ast::ProgramNode &prog, std::string object) {
+  llvm::SmallString<128> obj(object);
+  llvm::sys::fs::make_absolute(obj);
+
+  Writer w;
+  w.out = "ANXI";
+  w.u32(version);
+  w.u8(gc || ir::mod->getFunction("anx_gc_new"));
+
+  w.u32(imports.size());
+  for (std::string &src : imports)
+    w.str(src);
+
+  w.u32(objects.size() + 1);
+  w.str(std::string(obj));
+  for (std::string &o : objects)
+    w.str(o);
+
+  std::map<ty::Type, uint32_t> index;
+  std::vector<ty::Type> structs = ty::structs();
+  w.u32(structs.size());
+  for (ty::Type t : structs) {
+    const ty::Compound &c = ty::compound(t);
+    w.str(c.name);
+    w.u8(c.soa);
+    w.u32(c.fields.size());
+    for (size_t f = 0; f < c.fields.size(); f++) {
+      w.str(c.fields[f]);
+      w.type(c.params[f], index);
+    }
+
+    uint32_t k = index.size();
+    index[t] = k;
+  }
+
+  // prototypes are left out: those imported belong to their own modules
+  std::vector<ast::FnDecl *> pub;
+  std::set<std::string> inl;
+  for (auto &fn : prog.decls)
+    if (fn->is_pub && fn->body) {
+      pub.push_back(fn.get());
+      if (fn->attrs & ast::attr_inline)
+        inl.insert(ir::mangle(fn->name));
+    }
+
+  w.u32(pub.size());
+  for (ast::FnDecl *fn : pub) {
+    w.str(fn->name);
+    w.u8(fn->attrs);
+    w.u8(fn->is_async);
+    w.type(fn->type, index);
+    w.u32(fn->args.size());
+    for (size_t a = 0; a < fn->args.size(); a++) {
+      w.str(fn->args[a]);
+      w.type(fn->types[a], index);
+    }
+  }
+
+  std::string code = bitcode(inl);
+  w.u32(code.size());
+  w.out.append((8 - w.out.size() % 8) % 8, '\0');
+  w.out += code;
+
+  return w.out;
+}
+
+// Write the interface of the module being compiled next to its source.
+// Importers may still have the old one mapped, so the new one takes its
+// place under a new inode rather than being written over it.
+void iface::write(std::string image) {
+  std::string path = self + "i", tmp = path + ".tmp";
+
+  std::ofstream f(tmp, std::ios::binary);
+  f.write(image.data(), image.size());
+  f.close();
+
+  if (!f || rename(tmp.c_str(), path.c_str()))
+    anx::perr("could not write the interface '" + path + "'");
+}
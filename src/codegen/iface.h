@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../anx.h"
+#include "../frontend/ast.h"
+
+namespace iface {
+// the options that modules built for an import are compiled with, such as
+// " -g --no-overflow"
+extern thread_local std::string flags;
+
+// the object files of the modules imported so far and of the modules they
+// import in turn, which the program is linked with, and whether any of them
+// allocates garbage collected objects
+extern thread_local std::vector<std::string> objects;
+extern thread_local bool gc;
+
+void init(std::string src);
+std::vector<std::unique_ptr<ast::FnDecl>> load(std::string name, anx::Pos pos,
+                                               size_t s);
+void link();
+std::string image(ast::ProgramNode &prog, std::string object);
+void write(std::string image);
+} // namespace iface
@@ -1,27 +1,93 @@
+#include <deque>
+#include <set>
+
 #include "ir.h"
 #include "../frontend/ast.h"
+#include "abi.h"
+#include "iface.h"
 #include "../intrinsics/intr.h"
+#include "../runtime/rt.h"
 #include "opti.h"
 
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/InstIterator.h"
+
 //===---------------------------------------------------------------------===//
 // IR - This module generates LLVM IR from the Anx AST.
 //===---------------------------------------------------------------------===//
 
-std::unique_ptr<llvm::LLVMContext> ir::ctx;
-std::unique_ptr<llvm::Module> ir::mod;
-std::unique_ptr<llvm::IRBuilder<>> ir::builder;
-
-std::vector<std::map<std::string, ir::Symbol>> ir::symbols;
-std::vector<llvm::BasicBlock *> breaks;
-std::vector<llvm::BasicBlock *> conts;
-ir::Symbol cf;
-std::string cfm;
-
-void ir::init() {
+thread_local std::unique_ptr<llvm::LLVMContext> ir::ctx;
+thread_local std::unique_ptr<llvm::Module> ir::mod;
+thread_local std::unique_ptr<llvm::IRBuilder<>> ir::builder;
+
+thread_local std::vector<std::map<std::string, ir::Symbol>> ir::symbols;
+thread_local llvm::FastMathFlags ir::fmf;
+thread_local bool ir::nsw = false;
+thread_local std::unique_ptr<llvm::DIBuilder> ir::di;
+thread_local bool ir::frame_pointers = false;
+thread_local bool ir::instrument = false;
+thread_local bool ir::report_escapes = false;
+thread_local bool ir::is_module = false;
+thread_local bool ir::jit = false;
+thread_local llvm::DIFile *file;
+thread_local std::map<ty::Type, llvm::DIType *> ditypes;
+thread_local std::vector<llvm::BasicBlock *> breaks;
+thread_local std::vector<llvm::BasicBlock *> conts;
+thread_local ir::Symbol cf;
+thread_local std::string cfm;
+thread_local intr::Coro co; // the current function, if it is async
+// whether the current function is timed by --instrument
+thread_local bool profiled;
+// the loops being generated that count their trips, with their counters
+thread_local std::vector<std::pair<uint32_t, ir::Var *>> loops;
+// the objects the current function allocates, where and by which intrinsic
+thread_local std::vector<std::tuple<llvm::CallInst *, anx::Pos, size_t>> news;
+// the functions that use the garbage collector, by the intrinsic they call
+// first, and the functions spawned, where and under which name
+thread_local std::map<llvm::Function *, std::string> collects;
+thread_local std::vector<std::tuple<llvm::Function *, anx::Pos, size_t>>
+    spawned;
+// generic functions by name, the types the type parameters of the instance
+// being generated are bound to, and how many instances asked for it in turn
+thread_local std::map<std::string, ast::FnDecl *> generics;
+thread_local std::map<ty::Type, ty::Type> bound;
+thread_local unsigned nesting;
+
+void ir::init(llvm::TargetMachine *TM) {
   ctx = std::make_unique<llvm::LLVMContext>();
   mod = std::make_unique<llvm::Module>("anx", *ctx);
   builder = std::make_unique<llvm::IRBuilder<>>(*ctx);
-  opti::init(mod.get());
+
+  mod->setTargetTriple(TM->getTargetTriple().str());
+  mod->setDataLayout(TM->createDataLayout());
+  opti::init(mod.get(), TM);
+}
+
+// Describe the module to debuggers and profilers: functions, lines and locals
+// of the source file at path are recorded as DWARF.
+void ir::dwarf(std::string path) {
+  di = std::make_unique<llvm::DIBuilder>(*mod);
+
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos)
+    file = di->createFile(path, ".");
+  else
+    file = di->createFile(path.substr(slash + 1), path.substr(0, slash));
+  di->createCompileUnit(llvm::dwarf::DW_LANG_C, file, "anx", true, "", 0);
+
+  mod->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                     llvm::DEBUG_METADATA_VERSION);
+  mod->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+// Attach the instructions generated from here on to the source position pos
+void ir::locate(anx::Pos pos) {
+  if (!di)
+    return;
+
+  llvm::Function *F = builder->GetInsertBlock()->getParent();
+  builder->SetCurrentDebugLocation(
+      llvm::DILocation::get(*ctx, pos.r, pos.c + 1, F->getSubprogram()));
 }
 
 ir::Symbol ir::search(std::string name, anx::Pos pos) {
@@ -46,6 +112,182 @@ std::string ir::mangle(std::string name) {
   return name + ".anx";
 }
 
+// Shift x by n bits, both of the same integer type, shifting right
+// arithmetically for signed types. A masked shift uses only the low bits of n,
+// so that it is defined for every amount and matches what x86 shifts do; an
+// unmasked one is poison when n is not less than the width of the type.
+llvm::Value *ir::shift(llvm::IRBuilder<> &b, bool left, bool is_signed,
+                       llvm::Value *x, llvm::Value *n, bool masked) {
+  if (masked)
+    n = b.CreateAnd(
+        n, llvm::ConstantInt::get(n->getType(),
+                                  n->getType()->getIntegerBitWidth() - 1));
+
+  if (left)
+    return b.CreateShl(x, n, "shl");
+  return is_signed ? b.CreateAShr(x, n, "shr") : b.CreateLShr(x, n, "shr");
+}
+
+// the collector stops only the thread that asked for memory to scan its
+// stack, so the functions spawned onto the scheduler's threads must not
+// reach it. the calls between the functions of the module are followed;
+// the bodies of imported functions are not there, and those of a module
+// that allocates may reach it.
+void workers() {
+  for (auto &[F, pos, size] : spawned) {
+    std::set<llvm::Function *> seen{F};
+    std::vector<llvm::Function *> todo{F};
+    while (!todo.empty()) {
+      llvm::Function *G = todo.back();
+      todo.pop_back();
+
+      std::string what, who = G->getName().str();
+      who = who.substr(0, who.rfind(".anx"));
+      if (collects.count(G))
+        what = "calls '" + collects[G] + "'";
+      else if (G->isDeclaration() && iface::gc &&
+               G->getName().endswith(".anx"))
+        what = "is imported from a module that uses it";
+      if (!what.empty())
+        anx::perr("spawned functions run on other threads and cannot use the "
+                  "garbage collector, but '" +
+                      who + "' " + what,
+                  pos, size);
+
+      for (llvm::BasicBlock &BB : *G)
+        for (llvm::Instruction &I : BB)
+          if (auto *C = llvm::dyn_cast<llvm::CallBase>(&I))
+            if (llvm::Function *H = C->getCalledFunction())
+              if (seen.insert(H).second)
+                todo.push_back(H);
+    }
+  }
+}
+
+// modules that allocate garbage collected objects get precise stack maps:
+// every function uses the statepoint strategy, and the address of the
+// module's part of the stack map section is listed in anx_stackmaps, where
+// the runtime finds those of all modules linked into the program. the
+// collector walks the stack along the frame pointer chain, which the
+// functions of modules that call into such a module keep as well.
+void statepoints() {
+  if (!ir::mod->getFunction("anx_gc_new")) {
+    if (iface::gc)
+      for (auto &F : *ir::mod)
+        if (!F.isDeclaration())
+          F.addFnAttr("frame-pointer", "all");
+    return;
+  }
+
+  llvm::linkAllBuiltinGCs();
+
+  for (auto &F : *ir::mod)
+    if (!F.isDeclaration()) {
+      F.setGC("statepoint-example");
+      F.addFnAttr("frame-pointer", "all");
+    }
+
+  ir::mod->appendModuleInlineAsm(".section .llvm_stackmaps,\"a\",@progbits\n"
+                                 ".Lanx_stackmaps:\n"
+                                 ".section anx_stackmaps,\"aw\",@progbits\n"
+                                 ".p2align 3\n"
+                                 ".quad .Lanx_stackmaps\n"
+                                 ".text");
+}
+
+// the instances of generic functions declared so far by name, and those
+// still to be generated with the types they are for and their nesting
+thread_local std::map<std::string, ir::Symbol> instances;
+thread_local std::deque<std::tuple<ast::FnDecl *, llvm::Function *,
+                                   std::map<ty::Type, ty::Type>, unsigned>>
+    pending;
+
+// t as it is in the instance being generated
+ty::Type concrete(ty::Type t, anx::Pos pos, size_t s) {
+  ty::Type c = ty::subst(t, bound);
+  if (!ty::isVoid(c) || ty::isVoid(t))
+    return c;
+
+  std::string with;
+  for (auto [p, b] : bound)
+    with += (with.empty() ? "" : ", ") + ty::toString(p) + " = " +
+            ty::toString(b);
+  anx::perr("'" + ty::toString(t) + "' is not a valid type with " + with, pos,
+            s);
+}
+
+// the name of the instance of fn being generated, as in add<i64>
+std::string instname(ast::FnDecl *fn) {
+  std::string name = fn->name + "<";
+  for (size_t i = 0; i < fn->params.size(); i++)
+    name += (i ? "," : "") + ty::toString(bound.at(fn->params[i]));
+  return name + ">";
+}
+
+// bind the type parameters in t to the parts of a they stand for, as T in
+// arr<T> to i64 for arr<i64>. a parameter is bound by the first argument that
+// uses it, and the others are converted to its type as in any call.
+void infer(ty::Type t, ty::Type a, std::map<ty::Type, ty::Type> &b) {
+  if (ty::isParam(t)) {
+    b.insert({t, a});
+    return;
+  }
+
+  if (t < ty::ty_compound || a < ty::ty_compound || ty::isStruct(t) ||
+      ty::compound(t).kind != ty::compound(a).kind)
+    return;
+
+  for (size_t i = 0; i < ty::compound(t).params.size(); i++)
+    infer(ty::compound(t).params[i], ty::compound(a).params[i], b);
+}
+
+// Get the instance of a generic function for arguments of the types atypes.
+// Each instance is declared the first time it is asked for, and generated
+// once every declared function has been, along with the instances they ask
+// for in turn.
+ir::Symbol ast::FnDecl::instance(std::vector<ty::Type> atypes, anx::Pos pos,
+                                 size_t s) {
+  std::map<ty::Type, ty::Type> b;
+  for (size_t i = 0; i < types.size() && i < atypes.size(); i++)
+    infer(types[i], atypes[i], b);
+
+  for (ty::Type p : params)
+    if (!b.count(p))
+      anx::perr("cannot infer type parameter '" + ty::toString(p) +
+                    "' of '" + name + "' from the arguments",
+                pos, s);
+
+  // a function that calls itself with ever larger types never runs out of
+  // instances to generate
+  if (nesting >= 64)
+    anx::perr("instances of '" + name + "' nest too deeply", pos, s);
+
+  std::map<ty::Type, ty::Type> outer = bound;
+  llvm::Function *outerF = F;
+  bound = b;
+
+  auto it = instances.find(instname(this));
+  if (it == instances.end()) {
+    declare();
+
+    std::vector<ty::Type> ctypes;
+    for (ty::Type t : types)
+      ctypes.push_back(concrete(t, n, name.size()));
+    ty::Type ctype = concrete(type, n, name.size());
+
+    it = instances
+             .insert({instname(this),
+                      ir::Symbol(F, is_async ? ty::future(ctype) : ctype,
+                                 ctypes)})
+             .first;
+    pending.push_back({this, F, b, nesting + 1});
+  }
+
+  bound = outer;
+  F = outerF;
+  return it->second;
+}
+
 ir::Symbol ast::ProgramNode::codegen() {
   ir::symbols.push_back(std::map<std::string, ir::Symbol>());
 
@@ -55,30 +297,122 @@ ir::Symbol ast::ProgramNode::codegen() {
   for (auto &fn : decls)
     fn->codegen();
 
-  if (!ir::mod->getFunction("main"))
+  // instances may ask for further instances in turn
+  while (!pending.empty()) {
+    auto [fn, F, b, depth] = pending.front();
+    pending.pop_front();
+
+    fn->F = F, bound = b, nesting = depth;
+    fn->codegen();
+  }
+  bound.clear();
+  nesting = 0;
+
+  if (ir::jit && ir::mod->getFunction("main"))
+    anx::perr("`main()` belongs to a program, not to a session");
+  if (ir::is_module && ir::mod->getFunction("main"))
+    anx::perr("`main()` belongs to a program, not to a module compiled with "
+              "-c");
+  if (!ir::is_module && !ir::mod->getFunction("main"))
     anx::perr("no `main()` function defined; there is no program entry point");
 
+  iface::link();
+  workers();
+
+  if (ir::instrument)
+    intr::profile();
+
+  statepoints();
+
+  // profilers walk the stack through the frame pointer chain, so keep it in
+  // the intrinsics' helpers as well
+  if (ir::frame_pointers)
+    for (llvm::Function &F : *ir::mod)
+      if (!F.isDeclaration())
+        F.addFnAttr("frame-pointer", "all");
+
+  if (ir::di)
+    ir::di->finalize();
+
   ir::symbols.pop_back();
 
   return ir::Symbol();
 }
 
 void ast::FnDecl::declare() {
-  std::string mngl = ir::mangle(name);
+  // instances of generic functions are declared as they are asked for, with
+  // their type parameters bound
+  bool inst = !bound.empty();
+  std::string mngl = ir::mangle(inst ? instname(this) : name);
+
+  // C functions keep their names, and are called as C code calls them
+  if (is_extern) {
+    if (!params.empty())
+      anx::perr("extern functions cannot be generic", n, name.size());
+    if (body)
+      anx::perr("extern functions cannot have a body", n, name.size());
+    if (name == "main" || name.rfind("anx_", 0) == 0)
+      anx::perr("'" + name + "' is reserved", n, name.size());
+
+    mngl = name;
+  }
 
-  if (ir::mod->getFunction(mngl))
+  if (!inst && (ir::mod->getFunction(mngl) || generics.count(name) ||
+                ir::symbols.back().count(ir::mangle(name))))
     anx::perr("a function with this name already exists", n, name.size());
+  if (!inst && ty::named(name))
+    anx::perr("a struct with this name already exists", n, name.size());
+
+  if (!params.empty() && !inst) {
+    if (name == "main")
+      anx::perr("`main()` cannot be generic", n, name.size());
+    if (is_pub)
+      anx::perr("generic functions cannot be pub", n, name.size());
+    if (!body)
+      anx::perr("generic functions need a body", n, name.size());
+
+    generics[name] = this;
+    return;
+  }
+
+  ty::Type type = concrete(this->type, n, name.size());
+  std::vector<ty::Type> types;
+  for (ty::Type t : this->types)
+    types.push_back(concrete(t, n, name.size()));
+
+  if (is_extern) {
+    abi::check(type, n, name.size());
+    for (ty::Type t : types)
+      abi::check(t, n, name.size());
+  }
 
   llvm::Type *ret = ty::toLLVM(type, true);
   if (name == "main") {
+    if (is_async)
+      anx::perr("`main()` cannot be async, use @block_on instead", n,
+                name.size());
+
     is_pub = true;
     ret = llvm::Type::getInt32Ty(*ir::ctx);
   }
 
+  // async functions return a handle to their coroutine, and their frames may
+  // outlive any stack map the garbage collector could find them in
+  if (is_async) {
+    if (ty::isRef(type))
+      anx::perr("async functions cannot return references", n, name.size());
+
+    ret = ty::toLLVM(ty::future(type), false);
+  }
+
   std::vector<llvm::Type *> Params(args.size());
 
-  for (size_t i = 0, e = args.size(); i != e; ++i)
+  for (size_t i = 0, e = args.size(); i != e; ++i) {
+    if (is_async && ty::isRef(types[i]))
+      anx::perr("async functions cannot take references", n, name.size());
+
     Params[i] = ty::toLLVM(types[i], false);
+  }
 
   llvm::FunctionType *FT = llvm::FunctionType::get(ret, Params, false);
 
@@ -86,45 +420,416 @@ void ast::FnDecl::declare() {
                                              ? llvm::Function::ExternalLinkage
                                              : llvm::Function::InternalLinkage;
 
-  F = llvm::Function::Create(FT, linkage, mngl, ir::mod.get());
+  if (is_extern)
+    F = abi::declare(mngl, type, types, is_variadic);
+  else
+    F = llvm::Function::Create(FT, linkage, mngl, ir::mod.get());
+  if (is_async)
+    F->setPresplitCoroutine();
+
+  // internal functions are only ever called from code generated here, so
+  // they can use a convention that guarantees tail calls, even between
+  // functions of different signatures
+  else if (!is_pub && !is_extern)
+    F->setCallingConv(llvm::CallingConv::Tail);
+
+  if (attrs & attr_noreturn && !ty::isVoid(type))
+    anx::perr("noreturn functions cannot have a return type", n, name.size());
+
+  if (attrs & attr_inline)
+    F->addFnAttr(llvm::Attribute::AlwaysInline);
+  if (attrs & attr_noinline)
+    F->addFnAttr(llvm::Attribute::NoInline);
+  if (attrs & attr_pure)
+    F->setOnlyReadsMemory();
+  if (attrs & attr_const)
+    F->setDoesNotAccessMemory();
+  if (attrs & attr_noreturn)
+    F->setDoesNotReturn();
+
+  // hot and cold functions are grouped into .text.hot and .text.unlikely, so
+  // that the hot paths of a program share as few pages as possible
+  if (attrs & attr_hot) {
+    F->addFnAttr(llvm::Attribute::Hot);
+    F->setSectionPrefix("hot");
+  } else if (attrs & attr_cold) {
+    F->addFnAttr(llvm::Attribute::Cold);
+    F->setSectionPrefix("unlikely");
+  }
 
+  // the parameters of C functions are the parts their arguments are lowered
+  // to, not the arguments themselves
   unsigned Idx = 0;
-  for (auto &Arg : F->args())
-    Arg.setName(args[Idx++]);
+  if (!is_extern)
+    for (auto &Arg : F->args())
+      Arg.setName(args[Idx++]);
+
+  if (!inst)
+    ir::add(name, ir::Symbol(F, is_async ? ty::future(type) : type, types));
+}
+
+// how much of the memory its callers can see a function may access
+enum Access { access_none, access_read, access_write };
+
+// the access of a single instruction in F, and the function it calls if that
+// is what accesses memory. calls are judged by the callee's attributes, except
+// for intrinsics, whose inlined bodies are scanned instead. locals are
+// private to each call, so accessing them does not count.
+Access access(llvm::Function *F, llvm::Instruction &I, std::string &callee) {
+  if (!I.mayReadOrWriteMemory())
+    return access_none;
+
+  auto *C = llvm::dyn_cast<llvm::CallBase>(&I);
+  if (!C) {
+    const llvm::Value *P = llvm::getLoadStorePointerOperand(&I);
+    if (P && llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(P)))
+      return access_none;
+
+    return I.mayWriteToMemory() ? access_write : access_read;
+  }
+
+  llvm::Function *G = C->getCalledFunction();
+  if (!G) {
+    callee = "an indirect call";
+    return access_write;
+  }
+
+  if (G->doesNotAccessMemory() || G->onlyAccessesInaccessibleMemory() ||
+      G->getIntrinsicID() == llvm::Intrinsic::prefetch)
+    return access_none;
+
+  // intrinsics are named as they are written, functions without their suffix
+  std::string name = std::string(G->getName());
+  if (name.substr(0, 4) == "anx.")
+    callee = "'@" + name.substr(4) + "'";
+  else
+    callee = "'" + name.substr(0, name.rfind(".anx")) + "'";
+
+  if (G->onlyReadsMemory())
+    return access_read;
+  if (G == F || G->isDeclaration() || name.substr(0, 4) != "anx.")
+    return access_write;
+
+  Access a = access_none;
+  std::string inner;
+  for (llvm::Instruction &J : llvm::instructions(G))
+    a = std::max(a, access(G, J, inner));
+  return a;
+}
+
+// check that a function declared pure (or const) does not write (or read)
+// memory visible to its callers
+void verify_pure(llvm::Function *F, bool is_const, anx::Pos n, size_t s) {
+  Access limit = is_const ? access_read : access_write;
+
+  for (llvm::Instruction &I : llvm::instructions(F)) {
+    std::string callee;
+    Access a = access(F, I, callee);
+    if (a < limit)
+      continue;
+
+    anx::perr(std::string(is_const ? "const" : "pure") + " function may " +
+                  (a == access_write ? "write" : "read") + " memory" +
+                  (callee.empty() ? "" : " through " + callee),
+              n, s);
+  }
+}
+
+// Local variables are put in SSA form as they are generated, following Braun
+// et al., "Simple and Efficient Construction of Static Single Assignment
+// Form". The value of a variable in a block is its last write there, or else
+// the value it has in the block's predecessors, with a phi where they differ.
+// Loop headers are unsealed while the loop is generated, since the latch is
+// not there yet: phis placed in them wait for their operands until the header
+// is sealed.
+thread_local std::deque<ir::Var> vars;
+thread_local std::map<std::pair<ir::Var *, llvm::BasicBlock *>,
+                      llvm::WeakTrackingVH>
+    defs;
+thread_local std::map<llvm::BasicBlock *,
+                      std::vector<std::pair<ir::Var *, llvm::PHINode *>>>
+    incomplete;
+thread_local std::set<llvm::BasicBlock *> unsealed;
+// phis whose operands are being looked up
+thread_local std::set<llvm::PHINode *> filling;
+
+llvm::Value *read(ir::Var *v, llvm::BasicBlock *BB);
+
+llvm::PHINode *phi(ir::Var *v, llvm::BasicBlock *BB) {
+  llvm::Type *T = ty::toLLVM(v->type, false);
+  llvm::PHINode *P =
+      BB->empty() ? llvm::PHINode::Create(T, 0, v->name, BB)
+                  : llvm::PHINode::Create(T, 0, v->name, &BB->front());
+
+  if (v->di) {
+    llvm::DILocation *L = llvm::DILocation::get(
+        *ir::ctx, v->pos.r, v->pos.c + 1, BB->getParent()->getSubprogram());
+    if (llvm::Instruction *I = BB->getFirstNonPHI())
+      ir::di->insertDbgValueIntrinsic(P, v->di, ir::di->createExpression(), L,
+                                      I);
+    else
+      ir::di->insertDbgValueIntrinsic(P, v->di, ir::di->createExpression(), L,
+                                      BB);
+  }
+  return P;
+}
+
+// replace a phi that merges a single value besides itself by that value.
+// phis that used it may become trivial in turn.
+llvm::Value *trivial(llvm::PHINode *P) {
+  llvm::Value *same = nullptr;
+  for (llvm::Value *op : P->incoming_values()) {
+    if (op == same || op == P)
+      continue;
+    if (same)
+      return P;
+    same = op;
+  }
+
+  // the variable is read where it was never written
+  if (!same)
+    same = llvm::UndefValue::get(P->getType());
+
+  std::vector<llvm::WeakTrackingVH> users;
+  for (llvm::User *U : P->users())
+    if (U != P && llvm::isa<llvm::PHINode>(U))
+      users.push_back(U);
+
+  P->replaceAllUsesWith(same);
+  P->eraseFromParent();
+
+  // same may be one of the users that turn out trivial, so it is tracked.
+  // phis still waiting for their operands are left alone until then.
+  llvm::WeakTrackingVH result = same;
+  for (llvm::Value *U : users)
+    if (auto *UP = llvm::dyn_cast_or_null<llvm::PHINode>(U))
+      if (UP->getNumIncomingValues() && !filling.count(UP))
+        trivial(UP);
+
+  return result;
+}
+
+llvm::Value *operands(ir::Var *v, llvm::PHINode *P) {
+  filling.insert(P);
+  for (llvm::BasicBlock *Pred : llvm::predecessors(P->getParent()))
+    P->addIncoming(read(v, Pred), Pred);
+  filling.erase(P);
+  return trivial(P);
+}
+
+llvm::Value *read(ir::Var *v, llvm::BasicBlock *BB) {
+  auto it = defs.find({v, BB});
+  if (it != defs.end())
+    return it->second;
+
+  llvm::Value *val;
+  if (unsealed.count(BB)) {
+    llvm::PHINode *P = phi(v, BB);
+    incomplete[BB].push_back({v, P});
+    val = P;
+  } else if (llvm::pred_empty(BB))
+    val = llvm::UndefValue::get(ty::toLLVM(v->type, false));
+  else if (llvm::BasicBlock *Pred = BB->getUniquePredecessor())
+    val = read(v, Pred);
+  else {
+    // the phi is the value in this block while its operands are looked up,
+    // which ends the search around loops
+    llvm::PHINode *P = phi(v, BB);
+    defs[{v, BB}] = P;
+    val = operands(v, P);
+  }
+
+  defs[{v, BB}] = val;
+  return val;
+}
+
+// give v the value val from the current position on
+void write(ir::Var *v, llvm::Value *val) {
+  llvm::BasicBlock *BB = ir::builder->GetInsertBlock();
+  defs[{v, BB}] = val;
+
+  if (v->di)
+    ir::di->insertDbgValueIntrinsic(
+        val, v->di, ir::di->createExpression(),
+        llvm::DILocation::get(*ir::ctx, v->pos.r, v->pos.c + 1,
+                              BB->getParent()->getSubprogram()),
+        BB);
+}
+
+// the predecessors of BB are all there: complete the phis waiting for them
+void seal(llvm::BasicBlock *BB) {
+  unsealed.erase(BB);
+
+  auto it = incomplete.find(BB);
+  if (it == incomplete.end())
+    return;
+
+  std::vector<std::pair<ir::Var *, llvm::PHINode *>> phis =
+      std::move(it->second);
+  incomplete.erase(it);
+  for (auto &[v, P] : phis)
+    operands(v, P);
+}
 
-  ir::add(name, ir::Symbol(F, type, types));
+// a new variable of the current function, described to the debugger as a
+// local or as the argument numbered arg from 1
+ir::Var *local(std::string name, ty::Type type, anx::Pos pos,
+               unsigned arg = 0);
+
+// the debug info type of t. compound types are described only by their size.
+llvm::DIType *ditype(ty::Type t) {
+  auto it = ditypes.find(t);
+  if (it != ditypes.end())
+    return it->second;
+
+  std::string name = ty::toString(t);
+  llvm::DIType *T;
+  if (ty::isBool(t))
+    T = ir::di->createBasicType(name, 8, llvm::dwarf::DW_ATE_boolean);
+  else if (ty::isSInt(t))
+    T = ir::di->createBasicType(name, ty::width(t), llvm::dwarf::DW_ATE_signed);
+  else if (ty::isUInt(t))
+    T = ir::di->createBasicType(name, ty::width(t),
+                                llvm::dwarf::DW_ATE_unsigned);
+  else if (ty::isSingle(t) || ty::isDouble(t))
+    T = ir::di->createBasicType(name, ty::isSingle(t) ? 32 : 64,
+                                llvm::dwarf::DW_ATE_float);
+  else if (ty::isPtr(t) || ty::isRef(t))
+    T = ir::di->createPointerType(nullptr, 64, 0, std::nullopt, name);
+  else
+    T = ir::di->createStructType(
+        file, name, file, 0,
+        ir::mod->getDataLayout().getTypeAllocSizeInBits(ty::toLLVM(t, false)),
+        0, llvm::DINode::FlagZero, nullptr, ir::di->getOrCreateArray({}));
+
+  return ditypes[t] = T;
+}
+
+ir::Var *local(std::string name, ty::Type type, anx::Pos pos, unsigned arg) {
+  ir::Var *v = &vars.emplace_back(ir::Var{name, type, pos});
+  if (!ir::di)
+    return v;
+
+  llvm::DISubprogram *SP = cf.fn()->getSubprogram();
+  v->di = arg ? ir::di->createParameterVariable(SP, name, arg, file, pos.r,
+                                                ditype(type), true)
+              : ir::di->createAutoVariable(SP, name, file, pos.r,
+                                           ditype(type), true);
+  return v;
+}
+
+// whether control can get from the entry of the function to End, only taking
+// the branch a constant condition picks and stopping at calls to functions
+// that do not return
+bool falls(llvm::BasicBlock *End) {
+  std::set<llvm::BasicBlock *> seen;
+  std::vector<llvm::BasicBlock *> todo{&End->getParent()->getEntryBlock()};
+  while (!todo.empty()) {
+    llvm::BasicBlock *BB = todo.back();
+    todo.pop_back();
+    if (!seen.insert(BB).second)
+      continue;
+
+    bool ends = false;
+    for (llvm::Instruction &I : *BB)
+      if (auto *C = llvm::dyn_cast<llvm::CallBase>(&I))
+        ends |= C->doesNotReturn();
+    if (ends)
+      continue;
+    if (BB == End)
+      return true;
+
+    auto *Br = llvm::dyn_cast_or_null<llvm::BranchInst>(BB->getTerminator());
+    auto *K = Br && Br->isConditional()
+                  ? llvm::dyn_cast<llvm::ConstantInt>(Br->getCondition())
+                  : nullptr;
+    if (K)
+      todo.push_back(Br->getSuccessor(K->isOne() ? 0 : 1));
+    else if (BB->getTerminator())
+      for (llvm::BasicBlock *S : llvm::successors(BB))
+        todo.push_back(S);
+  }
+  return false;
 }
 
 ir::Symbol ast::FnDecl::codegen() {
-  if (!body)
+  // generic functions are generated as their instances, one at a time
+  if (!body || (!params.empty() && bound.empty()))
     return ir::Symbol();
 
+  std::string name = bound.empty() ? this->name : instname(this);
+  ty::Type type = concrete(this->type, n, this->name.size());
+  std::vector<ty::Type> types;
+  for (ty::Type t : this->types)
+    types.push_back(concrete(t, n, this->name.size()));
+
   cf = ir::Symbol(F, type, types);
   cfm = name;
 
   llvm::BasicBlock *BB = llvm::BasicBlock::Create(*ir::ctx, "entry", F);
   ir::builder->SetInsertPoint(BB);
+  ir::builder->SetCurrentDebugLocation(llvm::DebugLoc());
+
+  if (ir::di) {
+    std::vector<llvm::Metadata *> sig = {
+        ty::isVoid(type) ? nullptr : ditype(type)};
+    for (ty::Type t : types)
+      sig.push_back(ditype(t));
+
+    llvm::DISubprogram::DISPFlags flags = llvm::DISubprogram::SPFlagDefinition |
+                                          llvm::DISubprogram::SPFlagOptimized;
+    if (F->hasLocalLinkage())
+      flags |= llvm::DISubprogram::SPFlagLocalToUnit;
+
+    F->setSubprogram(ir::di->createFunction(
+        file, name, F->getName(), file, d.r,
+        ir::di->createSubroutineType(ir::di->getOrCreateTypeArray(sig)), d.r,
+        llvm::DINode::FlagPrototyped, flags));
+    ir::locate(d);
+  }
+
+  // float operations carry the file's fast-math flags, or all of them in a
+  // fast function
+  llvm::FastMathFlags FMF = ir::fmf;
+  if (attrs & attr_fast)
+    FMF.setFast();
+  ir::builder->setFastMathFlags(FMF);
+
+  if (is_async)
+    co = intr::coroutine(*ir::builder, F, type);
 
   ir::symbols.push_back(std::map<std::string, ir::Symbol>());
 
   int i = 0;
   for (auto &Arg : F->args()) {
-    llvm::IRBuilder<> eb(&F->getEntryBlock(), F->getEntryBlock().begin());
-    llvm::AllocaInst *a =
-        eb.CreateAlloca(ty::toLLVM(types[i], false), nullptr, Arg.getName());
-
-    ir::builder->CreateStore(&Arg, a);
-    ir::add(std::string(Arg.getName()), ir::Symbol(a, types[i]));
+    ir::Var *v = local(std::string(Arg.getName()), types[i], n, i + 1);
+    write(v, &Arg);
+    ir::add(v->name, ir::Symbol(v, types[i]));
     i++;
   }
 
+  // the frames of async functions come and go as they suspend, and calls to
+  // pure functions may be merged or dropped, so neither is timed
+  profiled = ir::instrument && !is_async && !(attrs & (attr_pure | attr_const));
+  if (profiled)
+    intr::enter(*ir::builder, intr::site(name));
+
   body->codegen();
 
   if (!ir::builder->GetInsertBlock()->getTerminator()) {
+    if (profiled && !(attrs & attr_noreturn))
+      intr::leave(*ir::builder);
+
     if (name == "main")
       ir::builder->CreateRet(
           llvm::ConstantInt::get(*ir::ctx, llvm::APInt(32, 0, true)));
-    else if (ty::isVoid(type))
+    else if (ty::isVoid(type) && co.hdl)
+      intr::complete(*ir::builder, co, nullptr);
+    else if (attrs & attr_noreturn) {
+      if (falls(ir::builder->GetInsertBlock()))
+        anx::perr("noreturn function '" + name + "' may return", e);
+      ir::builder->CreateUnreachable();
+    } else if (ty::isVoid(type))
       ir::builder->CreateRetVoid();
     else
       anx::perr("expected return instruction at end of non-void function '" +
@@ -132,8 +837,56 @@ ir::Symbol ast::FnDecl::codegen() {
                 e);
   }
 
+  // the slots of an object allocated here are accessed as what they hold
+  for (auto &[C, pos, s] : news) {
+    bool refs = C->getCalledFunction()->getName() == "anx.new_refs";
+    for (llvm::User *U : C->users()) {
+      auto *A = llvm::dyn_cast<llvm::CallInst>(U);
+      llvm::Function *G = A ? A->getCalledFunction() : nullptr;
+      if (!G || A->getArgOperand(0) != C)
+        continue;
+
+      llvm::StringRef g = G->getName();
+      if (refs && (g == "anx.get" || g == "anx.set"))
+        anx::perr("this object holds references, which '@get' and '@set' "
+                  "cannot access",
+                  pos, s);
+      if (!refs && (g == "anx.getref" || g == "anx.setref"))
+        anx::perr("this object holds integers, which '@getref' and "
+                  "'@setref' cannot access",
+                  pos, s);
+    }
+  }
+
+  // objects that cannot outlive the function go on its stack. the objects
+  // stored in one that moves become plain values, and may move in turn.
+  std::vector<std::string> why(news.size());
+  for (bool moved = true; moved;) {
+    moved = false;
+    for (size_t i = 0; i < news.size(); i++) {
+      llvm::CallInst *&C = std::get<0>(news[i]);
+      if (C && (why[i] = intr::stack(C)).empty())
+        C = nullptr, moved = true;
+    }
+  }
+
+  if (ir::report_escapes)
+    for (size_t i = 0; i < news.size(); i++)
+      if (std::get<0>(news[i]))
+        anx::note("object stays on the heap: " + why[i], std::get<1>(news[i]),
+                  std::get<2>(news[i]));
+
+  co = intr::Coro();
+  vars.clear();
+  defs.clear();
+  news.clear();
+  if (ir::di)
+    ir::di->finalizeSubprogram(F->getSubprogram());
   opti::fun(F);
 
+  if (attrs & (attr_pure | attr_const))
+    verify_pure(F, attrs & attr_const, n, name.size());
+
   ir::symbols.pop_back();
 
   return cf;
@@ -152,23 +905,30 @@ ir::Symbol ast::VarDecl::codegen() {
                 names[i].size());
 
     ir::Symbol cd;
+    ty::Type type = concrete(types[i], n[i], names[i].size());
     if (inits[i]) {
       cd = inits[i]->codegen();
 
-      if (ty::isVoid(types[i]))
-        types[i] = cd.typ();
+      if (ty::isVoid(type))
+        type = cd.typ();
     }
 
-    llvm::IRBuilder<> eb(&cf.fn()->getEntryBlock(),
-                         cf.fn()->getEntryBlock().begin());
-    llvm::AllocaInst *a =
-        eb.CreateAlloca(ty::toLLVM(types[i], false), nullptr, names[i]);
+    if (co.hdl && ty::isRef(type))
+      anx::perr("async functions cannot hold references", n[i],
+                names[i].size());
 
-    if (inits[i])
-      ir::builder->CreateStore(
-          cd.coerce(types[i], inits[i]->s, inits[i]->ssize).val(), a);
+    ir::Var *v = local(names[i], type, n[i]);
 
-    ir::add(names[i], ir::Symbol(a, types[i]));
+    ir::locate(n[i]);
+    if (inits[i])
+      write(v, cd.coerce(type, inits[i]->s, inits[i]->ssize).val());
+    else if (ty::isMap(type)) // maps start out as empty tables
+      write(v, ir::builder->CreateCall(
+                   intr::handle("@map_new", n[i], {type}).fn(), {}, "map"));
+    else if (ty::isArr(type)) // and arrays without any elements
+      write(v, llvm::Constant::getNullValue(ty::toLLVM(type, false)));
+
+    ir::add(names[i], ir::Symbol(v, type));
   }
 
   return ir::Symbol();
@@ -179,10 +939,11 @@ ir::Symbol ast::AssignStmt::codegen() {
     anx::perr("instruction is unreachable", n);
 
   ir::Symbol sym = ir::search(name, n);
+  ir::locate(n);
 
   ir::Symbol v = value->codegen().coerce(sym.typ(), value->s, value->ssize);
 
-  ir::builder->CreateStore(v.val(), sym.inst());
+  write(sym.var(), v.val());
 
   return v;
 }
@@ -191,6 +952,7 @@ ir::Symbol ast::SwapStmt::codegen() {
   if (ir::builder->GetInsertBlock()->getTerminator())
     anx::perr("instruction is unreachable", d);
 
+  ir::locate(d);
   std::vector<ir::Symbol> vals;
   std::vector<ir::Symbol> syms;
 
@@ -201,7 +963,7 @@ ir::Symbol ast::SwapStmt::codegen() {
   }
 
   for (size_t i = 0; i < names.size(); i++)
-    ir::builder->CreateStore(vals[i].val(), syms[i].inst());
+    write(syms[i].var(), vals[i].val());
 
   return ir::Symbol();
 }
@@ -210,6 +972,7 @@ ir::Symbol ast::IfStmt::codegen() {
   if (ir::builder->GetInsertBlock()->getTerminator())
     anx::perr("instruction is unreachable", d);
 
+  ir::locate(d);
   llvm::Value *CondV =
       cond->codegen().coerce(ty::ty_bool, cond->s, cond->ssize).val();
 
@@ -219,7 +982,7 @@ ir::Symbol ast::IfStmt::codegen() {
   llvm::BasicBlock *ElseBB = llvm::BasicBlock::Create(*ir::ctx, "else");
   llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(*ir::ctx, "if.exit");
 
-  ir::builder->CreateCondBr(CondV, ThenBB, ElseBB);
+  intr::branch(*ir::builder, CondV, ThenBB, ElseBB);
 
   ir::builder->SetInsertPoint(ThenBB);
 
@@ -261,6 +1024,7 @@ ir::Symbol ast::BreakNode::codegen() {
   if (breaks.empty())
     anx::perr("break instruction outside of loop", d);
 
+  ir::locate(d);
   ir::builder->CreateBr(breaks.back());
 
   return ir::Symbol();
@@ -273,11 +1037,51 @@ ir::Symbol ast::ContNode::codegen() {
   if (conts.empty())
     anx::perr("continue instruction outside of loop", d);
 
+  ir::locate(d);
   ir::builder->CreateBr(conts.back());
 
   return ir::Symbol();
 }
 
+// Build the llvm.loop metadata for the pragmas of a loop. The position of the
+// loop goes along as anx.loop.pos, so that the transformations the optimizer
+// fails to honor can be reported there.
+llvm::MDNode *loop_id(const std::map<std::string, uint32_t> &pragmas,
+                      anx::Pos d) {
+  auto prop = [](std::string name, std::vector<uint32_t> vals,
+                 uint32_t bits = 32) {
+    std::vector<llvm::Metadata *> ops = {llvm::MDString::get(*ir::ctx, name)};
+    for (uint32_t v : vals)
+      ops.push_back(llvm::ConstantAsMetadata::get(
+          ir::builder->getIntN(bits, v)));
+    return llvm::MDNode::get(*ir::ctx, ops);
+  };
+
+  std::vector<llvm::Metadata *> ops = {
+      nullptr, prop("anx.loop.pos", {(uint32_t)d.r, (uint32_t)d.c})};
+
+  for (auto &[name, count] : pragmas) {
+    if (name == "@unroll")
+      ops.push_back(count ? prop("llvm.loop.unroll.count", {count})
+                          : prop("llvm.loop.unroll.enable", {}));
+    else if (name == "@no_unroll")
+      ops.push_back(prop("llvm.loop.unroll.disable", {}));
+    else if (name == "@vectorize") {
+      ops.push_back(prop("llvm.loop.vectorize.enable", {1}, 1));
+      if (count)
+        ops.push_back(prop("llvm.loop.vectorize.width", {count}));
+    } else if (name == "@interleave")
+      ops.push_back(prop("llvm.loop.interleave.count", {count}));
+    else if (name == "@distribute")
+      ops.push_back(prop("llvm.loop.distribute.enable", {1}, 1));
+  }
+
+  // a loop ID refers to itself, which keeps it distinct from every other loop
+  llvm::MDNode *ID = llvm::MDNode::getDistinct(*ir::ctx, ops);
+  ID->replaceOperandWith(0, ID);
+  return ID;
+}
+
 ir::Symbol ast::WhileNode::codegen() {
   if (ir::builder->GetInsertBlock()->getTerminator())
     anx::perr("instruction is unreachable", d);
@@ -290,24 +1094,42 @@ ir::Symbol ast::WhileNode::codegen() {
   llvm::BasicBlock *StepBB = llvm::BasicBlock::Create(*ir::ctx, "loop.step");
   llvm::BasicBlock *ExitBB = llvm::BasicBlock::Create(*ir::ctx, "loop.exit");
 
+  // with --instrument, the trips of the loop are counted in a hidden local
+  // and reported to the profiler once it is left
+  llvm::Type *I64 = llvm::Type::getInt64Ty(*ir::ctx);
+  ir::Var *trips = nullptr;
+  uint32_t site = 0;
+  if (ir::instrument) {
+    site = intr::site(cfm + ':' + std::to_string(d.r) + ':' +
+                      std::to_string(d.c + 1));
+    trips = &vars.emplace_back(ir::Var{"trips", ty::ty_u64, d});
+    write(trips, llvm::ConstantInt::get(I64, 0));
+  }
+
+  ir::locate(d);
   ir::builder->CreateBr(EntryBB);
   ir::builder->SetInsertPoint(EntryBB);
+  unsealed.insert(EntryBB);
 
   llvm::Value *CondV =
       cond->codegen().coerce(ty::ty_bool, cond->s, cond->ssize).val();
-  ir::builder->CreateCondBr(CondV, LoopBB, ExitBB);
+  intr::branch(*ir::builder, CondV, LoopBB, ExitBB);
 
   F->insert(F->end(), LoopBB);
   ir::builder->SetInsertPoint(LoopBB);
 
   breaks.push_back(ExitBB);
   conts.push_back(StepBB);
+  if (trips)
+    loops.push_back({site, trips});
 
   if (body)
     body->codegen();
 
   breaks.pop_back();
   conts.pop_back();
+  if (trips)
+    loops.pop_back();
 
   if (!ir::builder->GetInsertBlock()->getTerminator())
     ir::builder->CreateBr(StepBB);
@@ -315,15 +1137,28 @@ ir::Symbol ast::WhileNode::codegen() {
   F->insert(F->end(), StepBB);
   ir::builder->SetInsertPoint(StepBB);
 
+  if (trips)
+    write(trips, ir::builder->CreateAdd(read(trips, StepBB),
+                                        llvm::ConstantInt::get(I64, 1),
+                                        "trips", true, true));
+
   if (step)
     step->codegen();
 
-  if (!ir::builder->GetInsertBlock()->getTerminator())
-    ir::builder->CreateBr(EntryBB);
+  if (!ir::builder->GetInsertBlock()->getTerminator()) {
+    ir::locate(d);
+    llvm::BranchInst *Latch = ir::builder->CreateBr(EntryBB);
+    if (!pragmas.empty())
+      Latch->setMetadata(llvm::LLVMContext::MD_loop, loop_id(pragmas, d));
+  }
+  seal(EntryBB);
 
   F->insert(F->end(), ExitBB);
   ir::builder->SetInsertPoint(ExitBB);
 
+  if (trips)
+    intr::trips(*ir::builder, site, read(trips, ExitBB));
+
   return ir::Symbol();
 }
 
@@ -407,11 +1242,123 @@ ir::Symbol ast::NumStmt::codegen() {
   return sym;
 }
 
+ir::Symbol ast::StrStmt::codegen() {
+  llvm::Type *I64 = llvm::Type::getInt64Ty(*ir::ctx);
+  llvm::PointerType *P = llvm::PointerType::get(*ir::ctx, 0);
+  llvm::StructType *ST =
+      llvm::cast<llvm::StructType>(ty::toLLVM(ty::ty_str, false));
+
+  if (value.size() <= ANX_STR_INLINE) {
+    // short literals are immediates in the inline string representation
+    uint8_t bytes[24] = {0};
+    uint64_t words[3];
+    memcpy(bytes, value.data(), value.size());
+    bytes[23] = ANX_STR_TAG | value.size();
+    memcpy(words, bytes, sizeof(words));
+
+    return ir::Symbol(
+        llvm::ConstantStruct::get(
+            ST, {llvm::ConstantExpr::getIntToPtr(
+                     llvm::ConstantInt::get(I64, words[0]), P),
+                 llvm::ConstantInt::get(I64, words[1]),
+                 llvm::ConstantInt::get(I64, words[2])}),
+        ty::ty_str);
+  }
+
+  // longer literals are views of their bytes in read-only data
+  llvm::Constant *data = ir::builder->CreateGlobalStringPtr(value, "str");
+
+  return ir::Symbol(
+      llvm::ConstantStruct::get(ST, {data,
+                                     llvm::ConstantInt::get(I64, value.size()),
+                                     llvm::ConstantInt::get(I64, 0)}),
+      ty::ty_str);
+}
+
+ir::Symbol ast::MapStmt::codegen() {
+  std::vector<ir::Symbol> ks, vs;
+  for (size_t i = 0; i < keys.size(); i++) {
+    ks.push_back(keys[i]->codegen());
+    vs.push_back(vals[i]->codegen());
+  }
+
+  ty::Type type = concrete(this->type, n, 1);
+  if (ty::isVoid(type)) {
+    if (keys.empty())
+      anx::perr("cannot infer the type of an empty map literal", n, 2);
+
+    if (ty::isRef(ks[0].typ()) || ty::isRef(vs[0].typ()))
+      anx::perr("maps cannot hold references", n, 1);
+    if (ty::isMap(ks[0].typ()))
+      anx::perr("map keys cannot be maps", keys[0]->s, keys[0]->ssize);
+    if (ty::isStruct(ks[0].typ()) || ty::isArr(ks[0].typ()))
+      anx::perr("map keys cannot be structs or arrays", keys[0]->s,
+                keys[0]->ssize);
+
+    type = ty::map(ks[0].typ(), vs[0].typ());
+  }
+
+  llvm::Value *map = ir::builder->CreateCall(
+      intr::handle("@map_new", n, {type}).fn(), {}, "map");
+
+  ty::Type kt = ty::compound(type).params[0];
+  ty::Type vt = ty::compound(type).params[1];
+
+  if (keys.size() > 1)
+    ir::builder->CreateCall(
+        intr::handle("@reserve", n, {type}).fn(),
+        {map, llvm::ConstantInt::get(*ir::ctx, llvm::APInt(64, keys.size()))});
+
+  llvm::Function *insert = intr::handle("@insert", n, {type}).fn();
+  for (size_t i = 0; i < keys.size(); i++)
+    ir::builder->CreateCall(
+        insert, {map, ks[i].coerce(kt, keys[i]->s, keys[i]->ssize).val(),
+                 vs[i].coerce(vt, vals[i]->s, vals[i]->ssize).val()});
+
+  return ir::Symbol(map, type);
+}
+
+// count the trips of every loop a return leaves, and end the current call
+// for the profiler
+void unwind() {
+  for (auto &[site, trips] : loops)
+    intr::trips(*ir::builder, site,
+                read(trips, ir::builder->GetInsertBlock()));
+
+  if (profiled)
+    intr::leave(*ir::builder);
+}
+
 ir::Symbol ast::RetNode::codegen() {
   if (ir::builder->GetInsertBlock()->getTerminator())
     anx::perr("instruction is unreachable", d);
 
+  if (cf.fn()->doesNotReturn())
+    anx::perr("cannot return from a noreturn function", d);
+
+  // the call returns for the caller
+  auto *call = dynamic_cast<ast::CallStmt *>(value.get());
+  if (call && call->tail)
+    return call->codegen();
+
+  ir::locate(d);
+  if (co.hdl) {
+    if (!value != ty::isVoid(cf.typ()))
+      anx::perr(value ? "cannot return a value from a void function"
+                      : "cannot return void from non-void function",
+                d);
+
+    llvm::Value *v = nullptr;
+    if (value)
+      v = value->codegen().coerce(cf.typ(), value->s, value->ssize).val();
+
+    unwind();
+    intr::complete(*ir::builder, co, v);
+    return ir::Symbol();
+  }
+
   if (!value) {
+    unwind();
     if (cfm == "main")
       ir::builder->CreateRet(
           llvm::ConstantInt::get(*ir::ctx, llvm::APInt(32, 0, true)));
@@ -422,32 +1369,377 @@ ir::Symbol ast::RetNode::codegen() {
   }
 
   ir::Symbol v = value->codegen().coerce(cf.typ(), value->s, value->ssize);
+  unwind();
   return ir::Symbol(ir::builder->CreateRet(v.val()), v.typ());
 }
 
+// replace the current call with one to F. the callee reuses the caller's
+// frame, so anything that prevents it from doing so is an error rather than
+// a silently growing stack.
+ir::Symbol become(llvm::Function *F, std::vector<llvm::Value *> &ArgsV,
+                  ty::Type type,
+                  std::vector<std::unique_ptr<ast::StmtNode>> &args,
+                  anx::Pos n, size_t s) {
+  if (co.hdl)
+    anx::perr("async functions cannot use 'become'", n, s);
+  if (cfm == "main")
+    anx::perr("`main()` cannot use 'become'", n, s);
+  if (ty::isFuture(type))
+    anx::perr("cannot 'become' an async function", n, s);
+
+  if (type != cf.typ())
+    anx::perr("'become' needs a function returning '" +
+                  ty::toString(cf.typ()) + "', not '" + ty::toString(type) +
+                  "'",
+              n, s);
+
+  // only the tail calling convention can pass arguments that do not fit in
+  // the caller's own frame
+  llvm::Function *caller = cf.fn();
+  if (F->getCallingConv() != caller->getCallingConv())
+    anx::perr(caller->getCallingConv() == llvm::CallingConv::Tail
+                  ? "internal functions can only 'become' other internal "
+                    "functions"
+                  : "pub functions can only 'become' other pub functions",
+              n, s);
+  if (F->getCallingConv() != llvm::CallingConv::Tail &&
+      F->getFunctionType() != caller->getFunctionType())
+    anx::perr("pub functions can only 'become' functions with the same "
+              "parameter types",
+              n, s);
+
+  for (size_t i = 0; i < ArgsV.size(); i++)
+    if (llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(ArgsV[i])))
+      anx::perr("cannot pass the caller's locals to 'become'", args[i]->s,
+                args[i]->ssize);
+
+  unwind();
+
+  llvm::CallInst *C =
+      ir::builder->CreateCall(F, ArgsV, ty::isVoid(type) ? "" : "call");
+  C->setCallingConv(F->getCallingConv());
+  C->setTailCallKind(llvm::CallInst::TCK_MustTail);
+  // a statepoint cannot be a musttail call, and needs none here: the caller's
+  // frame is gone once the callee runs, whose own safepoints see its roots
+  C->addFnAttr(llvm::Attribute::get(*ir::ctx, "gc-leaf-function"));
+
+  if (ty::isVoid(type))
+    return ir::Symbol(ir::builder->CreateRetVoid(), type);
+  return ir::Symbol(ir::builder->CreateRet(C), type);
+}
+
+// the index of the field called name in the struct type t
+unsigned field(ty::Type t, std::string name, anx::Pos n) {
+  if (!ty::isStruct(t))
+    anx::perr("'" + ty::toString(t) + "' has no fields", n, name.size());
+
+  const std::vector<std::string> &fields = ty::compound(t).fields;
+  for (unsigned i = 0; i < fields.size(); i++)
+    if (fields[i] == name)
+      return i;
+
+  anx::perr("'" + ty::toString(t) + "' has no field '" + name + "'", n,
+            name.size());
+}
+
+// whether e is an element of an array, or a field of one, and so in memory
+// rather than a value
+bool stored(ast::StmtNode *e) {
+  while (auto *f = dynamic_cast<ast::FieldStmt *>(e))
+    e = f->base.get();
+  return dynamic_cast<ast::IndexStmt *>(e);
+}
+
+// the memory a stored element or field lives in. whole elements of @soa
+// arrays are spread over one buffer per field, and are kept as their array
+// and index instead.
+struct Place {
+  llvm::Value *ptr;
+  ty::Type type;
+  llvm::Value *arr = nullptr, *index = nullptr;
+  ty::Type at = ty::ty_void;
+};
+
+Place place(ast::StmtNode *e) {
+  if (auto *x = dynamic_cast<ast::IndexStmt *>(e)) {
+    ir::Symbol a = x->base->codegen();
+    if (!ty::isArr(a.typ()))
+      anx::perr("cannot index '" + ty::toString(a.typ()) + "'", x->base->s,
+                x->base->ssize);
+
+    llvm::Value *i =
+        x->index->codegen().coerce(ty::ty_u64, x->index->s, x->index->ssize)
+            .val();
+    ty::Type et = ty::compound(a.typ()).params[0];
+
+    ir::locate(x->n);
+    if (ty::isStruct(et) && ty::compound(et).soa)
+      return {nullptr, et, a.val(), i, a.typ()};
+    return {intr::element(*ir::builder, a.typ(), a.val(), i), et};
+  }
+
+  auto *f = static_cast<ast::FieldStmt *>(e);
+  Place p = place(f->base.get());
+  unsigned k = field(p.type, f->name, f->n);
+  ty::Type ft = ty::compound(p.type).params[k];
+
+  ir::locate(f->n);
+  if (!p.ptr)
+    return {intr::element(*ir::builder, p.at, p.arr, p.index, k), ft};
+  return {ir::builder->CreateStructGEP(ty::toLLVM(p.type, false), p.ptr, k,
+                                       f->name),
+          ft};
+}
+
+llvm::Value *load(Place p) {
+  if (p.ptr)
+    return ir::builder->CreateLoad(ty::toLLVM(p.type, false), p.ptr, "elem");
+
+  llvm::Value *v = llvm::UndefValue::get(ty::toLLVM(p.type, false));
+  const ty::Compound &c = ty::compound(p.type);
+  for (unsigned k = 0; k < c.params.size(); k++)
+    v = ir::builder->CreateInsertValue(
+        v,
+        ir::builder->CreateLoad(
+            ty::toLLVM(c.params[k], false),
+            intr::element(*ir::builder, p.at, p.arr, p.index, k), c.fields[k]),
+        k);
+  return v;
+}
+
+void store(Place p, llvm::Value *v) {
+  if (p.ptr) {
+    ir::builder->CreateStore(v, p.ptr);
+    return;
+  }
+
+  for (unsigned k = 0; k < ty::compound(p.type).params.size(); k++)
+    ir::builder->CreateStore(
+        ir::builder->CreateExtractValue(v, k),
+        intr::element(*ir::builder, p.at, p.arr, p.index, k));
+}
+
+// give the field e of a variable, or of one of its fields, the value v. the
+// structs on the way are values, and are rebuilt around it.
+void assign(ast::StmtNode *e, llvm::Value *v) {
+  if (auto *id = dynamic_cast<ast::IdentStmt *>(e)) {
+    write(ir::search(id->name, id->n).var(), v);
+    return;
+  }
+
+  auto *f = dynamic_cast<ast::FieldStmt *>(e);
+  if (!f)
+    anx::perr("cannot assign to a temporary value", e->s, e->ssize);
+
+  ir::Symbol b = f->base->codegen();
+  unsigned k = field(b.typ(), f->name, f->n);
+  assign(f->base.get(), ir::builder->CreateInsertValue(b.val(), v, k));
+}
+
+// whether e is a variable or a field of one, which assign() can change
+bool named(ast::StmtNode *e) {
+  while (auto *f = dynamic_cast<ast::FieldStmt *>(e))
+    e = f->base.get();
+  return dynamic_cast<ast::IdentStmt *>(e);
+}
+
 ir::Symbol ast::CallStmt::codegen() {
   if (ir::builder->GetInsertBlock()->getTerminator())
     anx::perr("instruction is unreachable", n);
 
-  ir::Symbol sym = name[0] == '@' ? intr::handle(name, n) : ir::search(name, n);
+  // arguments are generated first, since some intrinsics are instantiated
+  // for the types they are called with. the first argument of an intrinsic
+  // is kept as a place when it is in memory, so that it can be stored back
+  // to without being evaluated twice.
+  std::vector<ir::Symbol> vals;
+  std::vector<ty::Type> types;
+  Place first = {nullptr, ty::ty_void};
+  for (auto &arg : args) {
+    if (vals.empty() && name[0] == '@' && stored(arg.get())) {
+      first = place(arg.get());
+      vals.push_back(ir::Symbol(load(first), first.type));
+    } else
+      vals.push_back(arg->codegen());
+    types.push_back(vals.back().typ());
+  }
+
+  ir::locate(n);
+
+  // the name of a struct builds one out of its fields, in order
+  if (ty::Type st = name[0] == '@' ? ty::ty_void : ty::named(name)) {
+    if (tail)
+      anx::perr("only functions can be called with 'become'", n, name.size());
+
+    std::vector<ty::Type> ftypes = ty::compound(st).params;
+    if (ftypes.size() != args.size())
+      anx::perr("expected " + std::to_string(ftypes.size()) +
+                    " field(s), got " + std::to_string(args.size()) +
+                    " instead",
+                n, name.size());
+
+    llvm::Value *v = llvm::UndefValue::get(ty::toLLVM(st, false));
+    for (unsigned i = 0, e = args.size(); i != e; ++i)
+      v = ir::builder->CreateInsertValue(
+          v, vals[i].coerce(ftypes[i], args[i]->s, args[i]->ssize).val(), i);
+
+    return ir::Symbol(v, st);
+  }
+
+  // the length of an array is part of its value, and is read in place so
+  // that loops up to it can be vectorized
+  if (name == "@len" && args.size() == 1 && ty::isArr(types[0]) && !tail)
+    return ir::Symbol(intr::length(*ir::builder, types[0], vals[0].val()),
+                      ty::ty_u64);
+
+  bool hint = intr::hints.count(name);
+  ir::Symbol sym;
+  std::vector<ty::Type> atypes;
+  if (hint)
+    atypes = intr::hints.at(name);
+  else {
+    if (name[0] == '@')
+      sym = intr::handle(name, n, types);
+    else if (generics.count(name))
+      sym = generics[name]->instance(types, n, name.size());
+    else
+      sym = ir::search(name, n);
+    atypes = sym.atypes();
+  }
+
+  // C functions are called as C code calls them, and the arguments past the
+  // parameters of a variadic one are passed with their own types
+  bool c = !hint && name[0] != '@' && abi::is_c(sym.fn());
+  bool variadic = c && sym.fn()->isVarArg();
+
+  if (variadic ? atypes.size() > args.size() : atypes.size() != args.size())
+    anx::perr("expected " + std::string(variadic ? "at least " : "") +
+                  std::to_string(atypes.size()) + " argument(s), got " +
+                  std::to_string(args.size()) + " instead",
+              n, name.size());
+
+  if (tail && c)
+    anx::perr("C functions cannot be called with 'become'", n, name.size());
+
+  if (tail && (hint || name[0] == '@'))
+    anx::perr("only functions can be called with 'become'", n, name.size());
+
+  if (hint) {
+    for (unsigned i = 0, e = args.size(); i != e; ++i)
+      if (!ty::isVoid(atypes[i]))
+        vals[i] = vals[i].coerce(atypes[i], args[i]->s, args[i]->ssize);
+    return intr::hint(*ir::builder, name, n, vals);
+  }
+
+  llvm::Function *CalleeF = sym.fn();
+  std::vector<llvm::Value *> ArgsV;
+  for (unsigned i = 0, e = atypes.size(); i != e; ++i)
+    ArgsV.push_back(
+        vals[i].coerce(atypes[i], args[i]->s, args[i]->ssize).val());
+
+  if (c) {
+    size_t fixed = atypes.size();
+    for (unsigned i = fixed, e = args.size(); i != e; ++i) {
+      if (ty::isVoid(types[i]))
+        anx::perr("cannot pass a value of type void", args[i]->s,
+                  args[i]->ssize);
+      abi::check(types[i], args[i]->s, args[i]->ssize);
+
+      atypes.push_back(types[i]);
+      ArgsV.push_back(vals[i].val());
+    }
+
+    return ir::Symbol(
+        abi::call(*ir::builder, CalleeF, sym.typ(), atypes, ArgsV, fixed),
+        sym.typ());
+  }
+
+  if (tail)
+    return become(CalleeF, ArgsV, sym.typ(), args, n, name.size());
+
+  llvm::CallInst *C = ir::builder->CreateCall(
+      CalleeF, ArgsV, ty::isVoid(sym.typ()) ? "" : "call");
+  C->setCallingConv(CalleeF->getCallingConv());
+
+  if (name == "@new" || name == "@new_refs")
+    news.push_back({C, n, name.size()});
+  if (name == "@new" || name == "@new_refs" || name == "@gc")
+    collects.insert({ir::builder->GetInsertBlock()->getParent(), name});
+
+  // the intrinsics that change an array return the updated one, which goes
+  // back where the array came from
+  if (name[0] == '@' && !args.empty() && ty::isArr(types[0]) &&
+      sym.typ() == types[0]) {
+    if (first.ptr || first.arr)
+      store(first, C);
+    else if (named(args[0].get()))
+      assign(args[0].get(), C);
+  }
+
+  return ir::Symbol(C, sym.typ());
+}
+
+ir::Symbol ast::SpawnStmt::codegen() {
+  if (ir::builder->GetInsertBlock()->getTerminator())
+    anx::perr("instruction is unreachable", n);
+
+  if (name[0] == '@')
+    anx::perr("intrinsics cannot be spawned", n, name.size());
+
+  // a generic function is spawned as its instance for the arguments
+  std::vector<ir::Symbol> vals;
+  std::vector<ty::Type> types;
+  for (auto &arg : args) {
+    vals.push_back(arg->codegen());
+    types.push_back(vals.back().typ());
+  }
+
+  ir::Symbol sym = generics.count(name)
+                       ? generics[name]->instance(types, n, name.size())
+                       : ir::search(name, n);
   llvm::Function *CalleeF = sym.fn();
   std::vector<ty::Type> atypes = sym.atypes();
 
+  if (abi::is_c(CalleeF))
+    anx::perr("C functions cannot be spawned", n, name.size());
+
   if (CalleeF->arg_size() != args.size())
     anx::perr("expected " + std::to_string(CalleeF->arg_size()) +
                   " argument(s), got " + std::to_string(args.size()) +
                   " instead",
               n, name.size());
 
+  // tasks run on other threads, where the garbage collector cannot see them
+  if (ty::isRef(sym.typ()))
+    anx::perr("cannot spawn a function that returns a reference", n,
+              name.size());
+
+  ir::locate(n);
   std::vector<llvm::Value *> ArgsV;
-  for (unsigned i = 0, e = args.size(); i != e; ++i)
+  for (unsigned i = 0, e = args.size(); i != e; ++i) {
+    if (ty::isRef(atypes[i]))
+      anx::perr("cannot pass a reference to a spawned function", args[i]->s,
+                args[i]->ssize);
+
     ArgsV.push_back(
-        args[i]->codegen().coerce(atypes[i], args[i]->s, args[i]->ssize).val());
+        vals[i].coerce(atypes[i], args[i]->s, args[i]->ssize).val());
+  }
 
-  if (ty::isVoid(sym.typ()))
-    return ir::Symbol(ir::builder->CreateCall(CalleeF, ArgsV), ty::ty_void);
+  spawned.push_back({CalleeF, n, name.size()});
+  return ir::Symbol(intr::spawn(sym, ArgsV), ty::task(sym.typ()));
+}
 
-  return ir::Symbol(ir::builder->CreateCall(CalleeF, ArgsV, "call"), sym.typ());
+ir::Symbol ast::AwaitStmt::codegen() {
+  if (!co.hdl)
+    anx::perr("`await` outside of an async function, use @block_on instead", n,
+              5);
+
+  ir::Symbol sym = val->codegen();
+  if (!ty::isFuture(sym.typ()))
+    anx::perr("expected a future, got '" + ty::toString(sym.typ()) + "'",
+              val->s, val->ssize);
+
+  ty::Type type = ty::compound(sym.typ()).params[0];
+  return ir::Symbol(intr::await(*ir::builder, co, sym.val(), type), type);
 }
 
 ir::Symbol ast::UnOpStmt::codegen() {
@@ -456,6 +1748,7 @@ ir::Symbol ast::UnOpStmt::codegen() {
   if (ty::isVoid(sym.typ()))
     anx::perr("cannot use void type as operand", val->s, val->ssize);
 
+  ir::locate(n);
   if (op == "!") {
     ir::Symbol coerced = sym.coerce(ty::ty_bool, val->s, val->ssize);
     return ir::Symbol(ir::builder->CreateNot(coerced.val(), "not"),
@@ -466,6 +1759,10 @@ ir::Symbol ast::UnOpStmt::codegen() {
       anx::perr("cannot negate boolean type, use `!` instead", val->s,
                 val->ssize);
 
+    if (ty::isPtr(sym.typ()) || ty::isRef(sym.typ()) ||
+        sym.typ() >= ty::ty_compound)
+      anx::perr("cannot negate pointer type", val->s, val->ssize);
+
     if (ty::isUInt(sym.typ())) {
       uint32_t width = ty::width(sym.typ());
       return ir::Symbol(ir::builder->CreateNeg(sym.val(), "neg"),
@@ -475,7 +1772,19 @@ ir::Symbol ast::UnOpStmt::codegen() {
     if (ty::isSingle(sym.typ()) || ty::isDouble(sym.typ()))
       return ir::Symbol(ir::builder->CreateFNeg(sym.val(), "neg"), sym.typ());
 
-    return ir::Symbol(ir::builder->CreateNeg(sym.val(), "neg"), sym.typ());
+    return ir::Symbol(
+        ir::builder->CreateNeg(sym.val(), "neg", false, ir::nsw), sym.typ());
+  }
+  if (op == "~") {
+    if (ty::isBool(sym.typ()))
+      anx::perr("cannot complement boolean type, use `!` instead", val->s,
+                val->ssize);
+
+    if (!ty::isSInt(sym.typ()) && !ty::isUInt(sym.typ()))
+      anx::perr("cannot complement '" + ty::toString(sym.typ()) + "'", val->s,
+                val->ssize);
+
+    return ir::Symbol(ir::builder->CreateNot(sym.val(), "not"), sym.typ());
   }
 
   anx::perr("invalid unary operator", n, op.size());
@@ -483,11 +1792,59 @@ ir::Symbol ast::UnOpStmt::codegen() {
 
 ir::Symbol ast::IdentStmt::codegen() {
   ir::Symbol sym = ir::search(name, n);
-  llvm::AllocaInst *inst = sym.inst();
+  return ir::Symbol(read(sym.var(), ir::builder->GetInsertBlock()), sym.typ());
+}
+
+ir::Symbol ast::FieldStmt::codegen() {
+  if (stored(this)) {
+    Place p = place(this);
+    return ir::Symbol(load(p), p.type);
+  }
+
+  ir::Symbol b = base->codegen();
+  unsigned k = field(b.typ(), name, n);
 
-  return ir::Symbol(ir::builder->CreateLoad(inst->getAllocatedType(), inst,
-                                            ir::mangle(name).c_str()),
-                    sym.typ());
+  ir::locate(n);
+  return ir::Symbol(ir::builder->CreateExtractValue(b.val(), k, name),
+                    ty::compound(b.typ()).params[k]);
+}
+
+ir::Symbol ast::IndexStmt::codegen() {
+  Place p = place(this);
+  return ir::Symbol(load(p), p.type);
+}
+
+ir::Symbol ast::StoreStmt::codegen() {
+  if (ir::builder->GetInsertBlock()->getTerminator())
+    anx::perr("instruction is unreachable", n);
+
+  if (stored(target.get())) {
+    Place p = place(target.get());
+    ir::Symbol v = value->codegen().coerce(p.type, value->s, value->ssize);
+
+    ir::locate(n);
+    store(p, v.val());
+    return v;
+  }
+
+  // a field of a value: the type it must have is that of the field
+  auto *f = dynamic_cast<ast::FieldStmt *>(target.get());
+  ty::Type t = f->codegen().typ();
+  ir::Symbol v = value->codegen().coerce(t, value->s, value->ssize);
+
+  ir::locate(n);
+  assign(target.get(), v.val());
+  return v;
+}
+
+ir::Symbol ast::SizeStmt::codegen() {
+  const llvm::DataLayout &DL = ir::mod->getDataLayout();
+  llvm::Type *T = ty::toLLVM(concrete(type, n, align ? 8 : 7), false);
+
+  uint64_t bytes =
+      align ? DL.getABITypeAlign(T).value() : DL.getTypeAllocSize(T);
+  return ir::Symbol(llvm::ConstantInt::get(*ir::ctx, llvm::APInt(64, bytes)),
+                    ty::ty_u64);
 }
 
 ir::Symbol ast::ScopeNode::codegen() {
@@ -502,7 +1859,12 @@ ir::Symbol ast::ScopeNode::codegen() {
 }
 
 ir::Symbol ast::BinOpStmt::codegen() {
-  ir::Symbol lsym = lhs->codegen();
+  // an element that may be appended to is found once, to be updated after
+  Place lp{};
+  bool inmem = op == "+" && stored(lhs.get());
+  if (inmem)
+    lp = place(lhs.get());
+  ir::Symbol lsym = inmem ? ir::Symbol(load(lp), lp.type) : lhs->codegen();
   ir::Symbol rsym = rhs->codegen();
   ty::Type lt = lsym.typ(), rt = rsym.typ();
 
@@ -511,6 +1873,21 @@ ir::Symbol ast::BinOpStmt::codegen() {
     anx::perr("cannot use void type as operand", lhs->s, lhs->ssize);
   else if (ty::isVoid(rt))
     anx::perr("cannot use void type as operand", rhs->s, rhs->ssize);
+  else if (lt >= ty::ty_compound || rt >= ty::ty_compound)
+    dtype = lt >= ty::ty_compound ? lt : rt;
+  else if (op == "<<" || op == ">>") {
+    // a shift takes the type of the value shifted, the amount only counts
+    if (!ty::isSInt(rt) && !ty::isUInt(rt))
+      anx::perr("shift amount must be an integer, got '" + ty::toString(rt) +
+                    "'",
+                rhs->s, rhs->ssize);
+    dtype = lt;
+  } else if (ty::isPtr(lt) || ty::isPtr(rt))
+    dtype = ty::ty_ptr;
+  else if (ty::isRef(lt) || ty::isRef(rt))
+    dtype = ty::ty_ref;
+  else if (ty::isStr(lt) || ty::isStr(rt))
+    dtype = ty::ty_str;
   else if (ty::isDouble(lt) || ty::isDouble(rt))
     dtype = ty::ty_f64;
   else if (ty::isSingle(lt) || ty::isSingle(rt))
@@ -524,24 +1901,65 @@ ir::Symbol ast::BinOpStmt::codegen() {
   else
     dtype = ty::ty_bool;
 
+  ir::locate(n);
   llvm::Value *L = lsym.coerce(dtype, lhs->s, lhs->ssize).val();
   llvm::Value *R = rsym.coerce(dtype, lhs->s, lhs->ssize).val();
 
+  // signed overflow is only undefined when the file asks for it
+  bool nsw = ir::nsw && ty::isSInt(dtype);
+
+  if (ty::isStr(dtype)) {
+    auto call = [&](std::string fn) {
+      return ir::builder->CreateCall(intr::handle(fn, n).fn(), {L, R}, "call");
+    };
+    llvm::Value *zero = llvm::ConstantInt::get(*ir::ctx, llvm::APInt(32, 0));
+
+    // a string that is appended to in place hands its buffer over to the
+    // result, so that only one of them frees it
+    if (op == "+") {
+      llvm::Value *C = call("@concat");
+      if (ty::isStr(lt) && inmem)
+        store(lp, intr::appended(*ir::builder, L, C));
+      else if (ty::isStr(lt) && named(lhs.get()))
+        assign(lhs.get(), intr::appended(*ir::builder, L, C));
+      return ir::Symbol(C, dtype);
+    } else if (op == "==")
+      return ir::Symbol(call("@eq"), ty::ty_bool);
+    else if (op == "!=")
+      return ir::Symbol(ir::builder->CreateNot(call("@eq"), "not"),
+                        ty::ty_bool);
+    else if (op == "<")
+      return ir::Symbol(ir::builder->CreateICmpSLT(call("@cmp"), zero, "cmp"),
+                        ty::ty_bool);
+    else if (op == ">")
+      return ir::Symbol(ir::builder->CreateICmpSGT(call("@cmp"), zero, "cmp"),
+                        ty::ty_bool);
+    else if (op == "<=")
+      return ir::Symbol(ir::builder->CreateICmpSLE(call("@cmp"), zero, "cmp"),
+                        ty::ty_bool);
+    else if (op == ">=")
+      return ir::Symbol(ir::builder->CreateICmpSGE(call("@cmp"), zero, "cmp"),
+                        ty::ty_bool);
+  }
+
   if (op == "+") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFAdd(L, R, "add"), dtype);
     else if (ty::isSInt(dtype) || ty::isUInt(dtype))
-      return ir::Symbol(ir::builder->CreateAdd(L, R, "add"), dtype);
+      return ir::Symbol(ir::builder->CreateAdd(L, R, "add", false, nsw),
+                        dtype);
   } else if (op == "-") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFSub(L, R, "sub"), dtype);
     else if (ty::isSInt(dtype) || ty::isUInt(dtype))
-      return ir::Symbol(ir::builder->CreateSub(L, R, "sub"), dtype);
+      return ir::Symbol(ir::builder->CreateSub(L, R, "sub", false, nsw),
+                        dtype);
   } else if (op == "*") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFMul(L, R, "mul"), dtype);
     else if (ty::isSInt(dtype) || ty::isUInt(dtype))
-      return ir::Symbol(ir::builder->CreateMul(L, R, "mul"), dtype);
+      return ir::Symbol(ir::builder->CreateMul(L, R, "mul", false, nsw),
+                        dtype);
   } else if (op == "/") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFDiv(L, R, "div"), dtype);
@@ -556,6 +1974,20 @@ ir::Symbol ast::BinOpStmt::codegen() {
       return ir::Symbol(ir::builder->CreateSRem(L, R, "rem"), dtype);
     else if (ty::isUInt(dtype))
       return ir::Symbol(ir::builder->CreateURem(L, R, "rem"), dtype);
+  } else if (op == "&") {
+    if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype))
+      return ir::Symbol(ir::builder->CreateAnd(L, R, "and"), dtype);
+  } else if (op == "|") {
+    if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype))
+      return ir::Symbol(ir::builder->CreateOr(L, R, "or"), dtype);
+  } else if (op == "^") {
+    if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype))
+      return ir::Symbol(ir::builder->CreateXor(L, R, "xor"), dtype);
+  } else if (op == "<<" || op == ">>") {
+    if (ty::isSInt(dtype) || ty::isUInt(dtype))
+      return ir::Symbol(ir::shift(*ir::builder, op == "<<", ty::isSInt(dtype),
+                                  L, R, true),
+                        dtype);
   } else if (op == "<") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFCmpULT(L, R, "cmp"), ty::ty_bool);
@@ -587,12 +2019,14 @@ ir::Symbol ast::BinOpStmt::codegen() {
   } else if (op == "==") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFCmpUEQ(L, R, "cmp"), ty::ty_bool);
-    else if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype))
+    else if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype) ||
+             ty::isPtr(dtype) || ty::isRef(dtype))
       return ir::Symbol(ir::builder->CreateICmpEQ(L, R, "cmp"), ty::ty_bool);
   } else if (op == "!=") {
     if (ty::isDouble(dtype) || ty::isSingle(dtype))
       return ir::Symbol(ir::builder->CreateFCmpUNE(L, R, "cmp"), ty::ty_bool);
-    else if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype))
+    else if (ty::isSInt(dtype) || ty::isUInt(dtype) || ty::isBool(dtype) ||
+             ty::isPtr(dtype) || ty::isRef(dtype))
       return ir::Symbol(ir::builder->CreateICmpNE(L, R, "cmp"), ty::ty_bool);
   } else {
     anx::perr("invalid binary operator", n, op.size());
@@ -6,6 +6,15 @@
 #include "../utils.h"
 
 namespace ir {
+// a local variable or argument. variables are not kept in memory but in SSA
+// form, as the value each block sees
+struct Var {
+  std::string name;
+  ty::Type type;
+  anx::Pos pos;
+  llvm::DILocalVariable *di = nullptr;
+};
+
 class Symbol final {
 private:
   enum {
@@ -18,7 +27,7 @@ private:
   union {
     llvm::Value *value;
     llvm::Function *function;
-    llvm::AllocaInst *variable;
+    Var *variable;
   };
 
   ty::Type type;
@@ -29,7 +38,7 @@ public:
       : kind(sym_val), value(value), type(type) {}
   Symbol(llvm::Function *function, ty::Type type, std::vector<ty::Type> types)
       : kind(sym_fn), function(function), type(type), types(types) {}
-  Symbol(llvm::AllocaInst *variable, ty::Type type)
+  Symbol(Var *variable, ty::Type type)
       : kind(sym_var), variable(variable), type(type) {}
   Symbol() : kind(sym_void) {}
 
@@ -52,7 +61,7 @@ public:
     anx::perr("attempted to access a non-value as if it were a value");
   }
 
-  llvm::AllocaInst *inst() {
+  Var *var() {
     if (kind == sym_var)
       return variable;
 
@@ -76,14 +85,42 @@ public:
   }
 };
 
-extern std::unique_ptr<llvm::LLVMContext> ctx;
-extern std::unique_ptr<llvm::Module> mod;
-extern std::unique_ptr<llvm::IRBuilder<>> builder;
+extern thread_local std::unique_ptr<llvm::LLVMContext> ctx;
+extern thread_local std::unique_ptr<llvm::Module> mod;
+extern thread_local std::unique_ptr<llvm::IRBuilder<>> builder;
+
+extern thread_local std::vector<std::map<std::string, Symbol>> symbols;
+
+// fast-math flags for float operations, and whether signed integer
+// arithmetic may assume it does not overflow, for the whole file
+extern thread_local llvm::FastMathFlags fmf;
+extern thread_local bool nsw;
+
+// the debug info being built with -g, or null, and whether every function
+// keeps its frame pointer
+extern thread_local std::unique_ptr<llvm::DIBuilder> di;
+extern thread_local bool frame_pointers;
+
+// whether functions and loops are counted by the --instrument profiler
+extern thread_local bool instrument;
+
+// whether objects left on the heap are explained, for --report-escapes
+extern thread_local bool report_escapes;
+
+// whether a module is compiled for others to import, with -c, rather than a
+// program
+extern thread_local bool is_module;
 
-extern std::vector<std::map<std::string, Symbol>> symbols;
+// whether the code is linked into the running process by a session (see
+// session.h) instead of by the system linker
+extern thread_local bool jit;
 
-void init();
+void init(llvm::TargetMachine *TM);
 Symbol search(std::string name, anx::Pos pos);
 void add(std::string name, Symbol sym);
 std::string mangle(std::string name);
+void dwarf(std::string path);
+void locate(anx::Pos pos);
+llvm::Value *shift(llvm::IRBuilder<> &b, bool left, bool is_signed,
+                   llvm::Value *x, llvm::Value *n, bool masked);
 } // namespace ir
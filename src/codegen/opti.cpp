@@ -1,3 +1,5 @@
+#include <set>
+
 #include "opti.h"
 #include "../anx.h"
 #include "ir.h"
@@ -6,13 +8,103 @@
 // Opti - Optimization Passes for LLVM IR.
 //===---------------------------------------------------------------------===//
 
-std::unique_ptr<llvm::legacy::FunctionPassManager> fpm;
+thread_local std::unique_ptr<llvm::legacy::FunctionPassManager> fpm;
+
+// find the position of the loop whose header or latch is BB from the
+// anx.loop.pos property that codegen puts in the loop ID on its back edge
+std::optional<anx::Pos> loop_pos(const llvm::BasicBlock *BB) {
+  std::vector<const llvm::BasicBlock *> blocks = {BB};
+  blocks.insert(blocks.end(), llvm::pred_begin(BB), llvm::pred_end(BB));
+
+  for (const llvm::BasicBlock *B : blocks) {
+    llvm::MDNode *ID = B->getTerminator()->getMetadata("llvm.loop");
+    if (!ID)
+      continue;
+
+    for (const llvm::MDOperand &Op : llvm::drop_begin(ID->operands())) {
+      auto *Prop = llvm::dyn_cast<llvm::MDNode>(Op);
+      auto *Name = Prop ? llvm::dyn_cast<llvm::MDString>(Prop->getOperand(0))
+                        : nullptr;
+      if (Name && Name->getString() == "anx.loop.pos")
+        return anx::Pos{
+            llvm::mdconst::extract<llvm::ConstantInt>(Prop->getOperand(1))
+                ->getZExtValue(),
+            llvm::mdconst::extract<llvm::ConstantInt>(Prop->getOperand(2))
+                ->getZExtValue()};
+    }
+  }
+
+  return std::nullopt;
+}
+
+// loops whose misses have been explained, by position and transformation
+thread_local std::set<std::pair<std::pair<size_t, size_t>, std::string>>
+    explained;
+// the first error LLVM reported, which ends the compilation once the passes
+// that reported it are done
+thread_local std::string failed;
+
+// report the loop pragmas the optimizer could not honor as warnings on their
+// loops, and print anything else the way LLVM does by default. a pass that
+// was forced by a pragma explains why it gave up, and the generic warning
+// that follows is only shown when it did not.
+void diagnose(const llvm::DiagnosticInfo &DI, void *) {
+  if (auto *Opt = llvm::dyn_cast<llvm::DiagnosticInfoIROptimization>(&DI)) {
+    auto *BB = llvm::dyn_cast_or_null<llvm::BasicBlock>(Opt->getCodeRegion());
+    std::optional<anx::Pos> pos = BB ? loop_pos(BB) : std::nullopt;
+    bool failure = llvm::isa<llvm::DiagnosticInfoOptimizationFailure>(DI);
+
+    // drop the advice on pass ordering, which is about clang's pragmas
+    std::string msg = Opt->getMsg();
+    msg = msg.substr(0, msg.find(';'));
+
+    if (pos) {
+      auto key = std::make_pair(std::make_pair(pos->r, pos->c),
+                                msg.substr(0, msg.find(':')));
+      if (!failure || !explained.count(key))
+        anx::warn(msg, *pos, 5);
+      if (!failure)
+        explained.insert(key);
+    }
+
+    // explanations outside the loop itself are covered by the warning
+    if (pos || !failure)
+      return;
+  }
+
+  // errors end the compilation the way the compiler's own do, but not from
+  // inside the pass that is running: a session's thread would be unwound
+  // through LLVM's frames (see opti::check)
+  if (DI.getSeverity() == llvm::DS_Error) {
+    if (failed.empty()) {
+      llvm::raw_string_ostream os(failed);
+      llvm::DiagnosticPrinterRawOStream DP(os);
+      DI.print(DP);
+      os.flush();
+    }
+    return;
+  }
+
+  llvm::DiagnosticPrinterRawOStream DP(llvm::errs());
+  llvm::errs() << llvm::LLVMContext::getDiagnosticMessagePrefix(
+                      DI.getSeverity())
+               << ": ";
+  DI.print(DP);
+  llvm::errs() << '\n';
+}
+
+void opti::init(llvm::Module *mod, llvm::TargetMachine *TM) {
+  mod->getContext().setDiagnosticHandlerCallBack(diagnose, nullptr, true);
 
-void opti::init(llvm::Module *mod) {
   fpm = std::make_unique<llvm::legacy::FunctionPassManager>(mod);
 
+  // without the target's cost model, the unroller cannot unroll loops whose
+  // trip count is only known at run time and the vectorizer has no vectors
+  fpm->add(llvm::createTargetTransformInfoWrapperPass(
+      TM->getTargetIRAnalysis()));
+
+  fpm->add(llvm::createLowerExpectIntrinsicPass());
   fpm->add(llvm::createCFGSimplificationPass());
-  fpm->add(llvm::createPromoteMemoryToRegisterPass());
   fpm->add(llvm::createReassociatePass());
   fpm->add(llvm::createGVNPass());
   fpm->add(llvm::createAggressiveDCEPass());
@@ -32,7 +124,9 @@ void opti::init(llvm::Module *mod) {
   fpm->add(llvm::createLoopUnrollAndJamPass());
   fpm->add(llvm::createLoopLoadEliminationPass());
   fpm->add(llvm::createLoopFlattenPass());
+  fpm->add(llvm::createLoopDistributePass());
   fpm->add(llvm::createLoopVectorizePass());
+  fpm->add(llvm::createWarnMissedTransformationsPass());
 
   fpm->doInitialization();
 }
@@ -40,4 +134,42 @@ void opti::init(llvm::Module *mod) {
 void opti::fun(llvm::Function *F) {
   llvm::EliminateUnreachableBlocks(*F);
   fpm->run(*F);
+  check();
+}
+
+void opti::check() {
+  if (!failed.empty())
+    anx::perr(failed);
+}
+
+// module passes that run right before code generation. instances of generic
+// functions often compile to the same code, as for i64 and u64, and are
+// merged into one once their intrinsics are inlined.
+void opti::late(llvm::legacy::PassManager &pass) {
+  pass.add(llvm::createAlwaysInlinerLegacyPass());
+  pass.add(llvm::createMergeFunctionsPass());
+  pass.add(llvm::createRewriteStatepointsForGCLegacyPass());
+}
+
+// coroutines are only lowered by the new pass manager, whose default pipeline
+// splits them into their ramp, resume and destroy functions and elides the
+// frame allocation of any coroutine that cannot outlive its caller
+void opti::coro(llvm::Module &M, llvm::TargetMachine *TM) {
+  if (!M.getFunction("llvm.coro.begin"))
+    return;
+
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+
+  llvm::PassBuilder PB(TM);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2).run(M, MAM);
+  check();
 }
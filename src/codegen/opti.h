@@ -1,7 +1,14 @@
 #pragma once
 
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/AggressiveInstCombine/AggressiveInstCombine.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
 #include "llvm/Transforms/IPO/ArgumentPromotion.h"
 #include "llvm/Transforms/IPO/Inliner.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
@@ -13,6 +20,10 @@
 #include "llvm/Transforms/Vectorize.h"
 
 namespace opti {
-void init(llvm::Module *mod);
+void init(llvm::Module *mod, llvm::TargetMachine *TM);
 void fun(llvm::Function *F);
+void late(llvm::legacy::PassManager &pass);
+// end the compilation if LLVM reported an error since the passes last ran
+void check();
+void coro(llvm::Module &M, llvm::TargetMachine *TM);
 } // namespace opti
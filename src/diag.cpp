@@ -0,0 +1,88 @@
+#include <pthread.h>
+
+#include "anx.h"
+#include "frontend/lexer.h"
+
+//===---------------------------------------------------------------------===//
+// Diag - This module reports errors, warnings and notes.
+//
+// They are printed to standard error, and the first error ends the process.
+// While a session compiles, they are collected instead and an error ends the
+// thread the session compiles on (see session.cpp).
+//===---------------------------------------------------------------------===//
+
+thread_local std::istream *anx::stream = nullptr;
+thread_local std::string anx::file;
+thread_local std::vector<anx::Diagnostic> *anx::diagnostics = nullptr;
+
+// print a diagnostic of the given kind that points at size characters of the
+// source starting at pos
+void report(std::string kind, const char *color, std::string msg,
+            anx::Pos pos, size_t size) {
+  std::string line = lex::src[pos.r - 1], ep0;
+  size_t p = pos.c, begin = line.find_first_not_of(" \t\n"),
+         end = line.find_last_not_of(" \t\n");
+  if (begin != std::string::npos) {
+    ep0 = line.substr(0, begin);
+    line = line.substr(begin, end - begin + 1);
+    if (p > begin)
+      p -= begin;
+    else
+      p = 0;
+  }
+
+  size_t len = std::max(line.size(), p + size);
+
+  std::string ep1(p, '~'), ep2(size, '^'), ep3(len - size - p, '~');
+
+  std::cerr << color << kind << ": \033[0m" << msg << '\n';
+
+  std::cerr << "  --> " << anx::file << ':' << pos.r << ':' << pos.c + 1;
+  if (size > 1)
+    std::cerr << '-' << pos.c + size;
+  std::cerr << '\n';
+
+  std::cerr << "   | " << ep0 << line << '\n';
+  std::cerr << "   | " << ep0 << ep1 << color << ep2 << "\033[0m" << ep3
+            << '\n';
+}
+
+// give up on the compilation after an error. a session's thread is unwound
+// instead, which destroys the locals of every frame of the compiler on the
+// way, as it is built with exceptions, and then its thread locals.
+[[noreturn]] void fail() {
+  if (anx::diagnostics)
+    pthread_exit(nullptr);
+
+  exit(1);
+}
+
+void anx::perr(std::string msg, Pos pos, size_t size) {
+  if (diagnostics)
+    diagnostics->push_back({Diagnostic::error, msg, pos.r, pos.c + 1, size});
+  else
+    report("error", "\033[0;31m", msg, pos, size);
+  fail();
+}
+
+void anx::warn(std::string msg, Pos pos, size_t size) {
+  if (diagnostics)
+    diagnostics->push_back({Diagnostic::warning, msg, pos.r, pos.c + 1, size});
+  else
+    report("warning", "\033[0;33m", msg, pos, size);
+}
+
+void anx::note(std::string msg, Pos pos, size_t size) {
+  if (diagnostics)
+    diagnostics->push_back({Diagnostic::note, msg, pos.r, pos.c + 1, size});
+  else
+    report("note", "\033[0;36m", msg, pos, size);
+}
+
+void anx::perr(std::string msg) {
+  if (diagnostics)
+    diagnostics->push_back({Diagnostic::error, msg, 0, 0, 0});
+  else
+    std::cerr << "\033[0;31merror: \033[0m" << msg << '\n';
+  fail();
+}
@@ -1,4 +1,7 @@
+#include <set>
+
 #include "ast.h"
+#include "../codegen/iface.h"
 
 //===---------------------------------------------------------------------===//
 // AST - This module implements the Abstract Syntax Tree (AST) for Anx.
@@ -16,21 +19,40 @@
 //   ContNode - A continue instruction
 //   StmtNode - A node that evaluates
 //     AssignStmt - A variable assignment
+//     StoreStmt - An assignment to a field or array element
 //     BinOpStmt - A binary operation statement
 //     UnOpStmt - A unary operation statement
 //     CallStmt - A function call statement
+//     SpawnStmt - A function call run as a task
+//     AwaitStmt - A suspension until a future completes
 //     IdentStmt - A variable statement
+//     FieldStmt - A field of a struct
+//     IndexStmt - An element of an array
 //     NumStmt - A number literal statement
+//     StrStmt - A string literal statement
+//     MapStmt - A map literal statement
+//     SizeStmt - The size or alignment of a type
 //===---------------------------------------------------------------------===//
 
 // Get the priority of an operator, such as + or /
+//
+// The order is C's, so bitwise operators bind looser than comparisons
 int prio(const std::string &op) {
   if (op == "*" || op == "/" || op == "%")
-    return 2;
+    return 7;
   else if (op == "+" || op == "-")
+    return 6;
+  else if (op == "<<" || op == ">>")
+    return 5;
+  else if (op == "<" || op == ">" || op == "<=" || op == ">=")
+    return 4;
+  else if (op == "==" || op == "!=")
+    return 3;
+  else if (op == "&")
+    return 2;
+  else if (op == "^")
     return 1;
-  else if (op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" ||
-           op == ">=")
+  else if (op == "|")
     return 0;
 
   return -1;
@@ -40,33 +62,189 @@ std::unique_ptr<ast::Node> parse_inst();
 std::unique_ptr<ast::StmtNode> parse_expr();
 std::unique_ptr<ast::StmtNode> parse_primary();
 
+const std::set<std::string> builtin_types = {
+    "void", "bool", "i8",  "i16", "i32", "i64",  "i128",   "u8",
+    "u16",  "u32",  "u64", "u128", "f32", "f64", "ptr",    "ref",
+    "str",  "map",  "task", "future", "arr"};
+
+// the type parameters of the generic function being parsed, by name
+thread_local std::map<std::string, ty::Type> tparams;
+
+// Parse a type name, including compound types such as map<str, i64>
+ty::Type parse_type(bool allow_void) {
+  std::string name = lex::tok.val;
+  anx::Pos n = lex::c;
+
+  lex::eat(); // eat type
+
+  auto param = tparams.find(name);
+  if (param != tparams.end())
+    return param->second;
+
+  if (name != "map" && name != "task" && name != "future" && name != "arr")
+    return ty::fromString(name, allow_void, n, name.size());
+
+  if (lex::tok.val != "<")
+    anx::perr("expected '<' after '" + name + "'", lex::c);
+
+  lex::eat(); // eat <
+
+  std::vector<ty::Type> params;
+  std::vector<anx::Pos> p;
+
+  while (1) {
+    p.push_back(lex::c);
+    lex::exp(lex::tok_identifier, "expected a type parameter");
+    params.push_back(parse_type(name != "map"));
+
+    if (lex::tok.val[0] == '>' && lex::tok.tok == lex::tok_binop)
+      break;
+
+    lex::exp(lex::tok_comma, "expected ',' or '>' in type parameter list");
+    lex::eat(); // eat ,
+  }
+
+  // a nested list can end in `>>`, and a declaration in `>=`
+  if (lex::tok.val.size() > 1)
+    lex::split(); // eat >
+  else
+    lex::eat(); // eat >
+
+  size_t count = name == "map" ? 2 : 1;
+  if (params.size() != count)
+    anx::perr("'" + name + "' expects " + std::to_string(count) +
+                  " type parameter(s)",
+              n, name.size());
+
+  // maps and arrays live outside of the garbage collected heap, and tasks and
+  // futures run on other threads or frames, so none of them can hold
+  // references that the collector would need to find
+  for (size_t i = 0; i < count; i++)
+    if (ty::isRef(params[i]))
+      anx::perr("'" + name + "' cannot hold references", p[i], 3);
+
+  if (name == "task")
+    return ty::task(params[0]);
+  if (name == "future")
+    return ty::future(params[0]);
+  if (name == "arr")
+    return ty::arr(params[0]);
+
+  if (ty::isMap(params[0]))
+    anx::perr("map keys cannot be maps", p[0], 3);
+  if (ty::isStruct(params[0]) || ty::isArr(params[0]))
+    anx::perr("map keys cannot be structs or arrays", p[0], 3);
+
+  return ty::map(params[0], params[1]);
+}
+
+// Parse a parenthesized, comma separated list of call arguments
+std::vector<std::unique_ptr<ast::StmtNode>> parse_args() {
+  lex::eat(); // eat (
+
+  std::vector<std::unique_ptr<ast::StmtNode>> args;
+
+  if (lex::tok.tok != lex::tok_parene) {
+    while (1) {
+      args.push_back(parse_expr());
+
+      if (lex::tok.tok == lex::tok_parene)
+        break;
+
+      lex::exp(lex::tok_comma, "expected ',' or ')' in function call");
+
+      lex::eat(); // eat ,
+    }
+  }
+
+  lex::eat(); // eat )
+
+  return args;
+}
+
+// Parse the fields and elements accessed on e, as in `a[i].x`
+std::unique_ptr<ast::StmtNode> parse_postfix(std::unique_ptr<ast::StmtNode> e) {
+  anx::Pos s = e->s;
+
+  while (1) {
+    anx::Pos n = lex::c;
+
+    if (lex::tok.tok == lex::tok_dot) {
+      lex::eat(); // eat .
+
+      lex::exp(lex::tok_identifier, "expected a field name after '.'");
+      std::string name = lex::tok.val;
+      n = lex::c;
+
+      lex::eat(); // eat field
+
+      e = std::make_unique<ast::FieldStmt>(std::move(e), std::move(name), n);
+    } else if (lex::tok.tok == lex::tok_squares) {
+      lex::eat(); // eat [
+
+      std::unique_ptr<ast::StmtNode> index = parse_expr();
+
+      lex::exp(lex::tok_squaree, "expected a closing bracket ']'");
+      lex::eat(); // eat ]
+
+      e = std::make_unique<ast::IndexStmt>(std::move(e), std::move(index), n);
+    } else
+      return e;
+
+    e->s = s;
+    e->ssize = lex::l.c + lex::ls - s.c;
+  }
+}
+
 std::unique_ptr<ast::StmtNode> parse_identifier(bool standalone) {
   anx::Pos n = lex::c;
   std::string name = lex::tok.val;
 
   lex::eat(); // eat identifier
 
-  if (lex::tok.tok == lex::tok_parens) {
+  // the argument of @sizeof and @alignof is a type rather than a value
+  if ((name == "@sizeof" || name == "@alignof") &&
+      lex::tok.tok == lex::tok_parens) {
     lex::eat(); // eat (
 
-    std::vector<std::unique_ptr<ast::StmtNode>> args;
+    lex::exp(lex::tok_identifier, "expected a type");
+    ty::Type type = parse_type(false);
 
-    if (lex::tok.tok != lex::tok_parene) {
-      while (1) {
-        args.push_back(parse_expr());
+    lex::exp(lex::tok_parene, "expected a closing parenthesis ')'");
+    lex::eat(); // eat )
+
+    return std::make_unique<ast::SizeStmt>(type, name == "@alignof", n);
+  }
 
-        if (lex::tok.tok == lex::tok_parene)
-          break;
+  if (lex::tok.tok == lex::tok_parens) {
+    std::unique_ptr<ast::StmtNode> call =
+        std::make_unique<ast::CallStmt>(std::move(name), parse_args(), n);
+    if (standalone || (lex::tok.tok != lex::tok_dot &&
+                       lex::tok.tok != lex::tok_squares))
+      return call;
+
+    call->s = n;
+    return parse_postfix(std::move(call));
+  }
 
-        lex::exp(lex::tok_comma, "expected ',' or ')' in function call");
+  if (lex::tok.tok == lex::tok_dot || lex::tok.tok == lex::tok_squares) {
+    std::unique_ptr<ast::StmtNode> place =
+        std::make_unique<ast::IdentStmt>(name, n);
+    place->s = n;
+    place->ssize = name.size();
+    place = parse_postfix(std::move(place));
 
-        lex::eat(); // eat ,
-      }
+    if (lex::tok.tok == lex::tok_assign) {
+      lex::eat(); // eat =
+
+      return std::make_unique<ast::StoreStmt>(std::move(place), parse_expr(),
+                                              n);
     }
 
-    lex::eat(); // eat )
+    if (standalone)
+      anx::perr("unused expression result", place->s, place->ssize);
 
-    return std::make_unique<ast::CallStmt>(std::move(name), std::move(args), n);
+    return place;
   }
 
   if (standalone && lex::tok.tok == lex::tok_comma) {
@@ -132,9 +310,69 @@ std::unique_ptr<ast::ScopeNode> parse_scope() {
   }
 }
 
+const std::map<std::string, ast::FnAttr> fn_attrs = {
+    {"inline", ast::attr_inline}, {"noinline", ast::attr_noinline},
+    {"pure", ast::attr_pure},     {"const", ast::attr_const},
+    {"hot", ast::attr_hot},       {"cold", ast::attr_cold},
+    {"noreturn", ast::attr_noreturn}, {"fast", ast::attr_fast}};
+
+// modifiers that cannot be combined, and those async functions cannot have
+const std::vector<std::pair<uint8_t, uint8_t>> fn_attr_conflicts = {
+    {ast::attr_inline, ast::attr_noinline},
+    {ast::attr_pure, ast::attr_const},
+    {ast::attr_hot, ast::attr_cold}};
+const uint8_t async_attrs =
+    ast::attr_noinline | ast::attr_hot | ast::attr_cold | ast::attr_fast;
+const uint8_t extern_attrs = ast::attr_pure | ast::attr_const |
+                             ast::attr_hot | ast::attr_cold |
+                             ast::attr_noreturn;
+
 std::unique_ptr<ast::FnDecl> parse_fn(bool is_pub) {
   anx::Pos d = lex::c;
 
+  // C functions are declared as in `extern "C" fn puts(s: ptr): i32;`
+  bool is_extern = lex::tok.tok == lex::tok_extern;
+  if (is_extern) {
+    if (is_pub)
+      anx::perr("extern functions cannot be pub", lex::c, 6);
+
+    lex::eat(); // eat extern
+
+    lex::exp(lex::tok_string, "expected '\"C\"' after 'extern'");
+    if (lex::tok.val != "C")
+      anx::perr("only C functions can be declared extern", lex::c,
+                lex::tok.val.size() + 2);
+
+    lex::eat(); // eat "C"
+  }
+
+  uint8_t attrs = 0;
+  while (lex::tok.tok == lex::tok_attr) {
+    uint8_t attr = fn_attrs.at(lex::tok.val);
+    if (attrs & attr)
+      anx::perr("duplicate '" + lex::tok.val + "' modifier", lex::c,
+                lex::tok.val.size());
+
+    for (auto [a, b] : fn_attr_conflicts)
+      if ((attr == a && attrs & b) || (attr == b && attrs & a))
+        anx::perr("'" + lex::tok.val + "' conflicts with an earlier modifier",
+                  lex::c, lex::tok.val.size());
+
+    attrs |= attr;
+    lex::eat(); // eat attribute
+  }
+
+  bool is_async = lex::tok.tok == lex::tok_async;
+  if (is_async && attrs & ~async_attrs)
+    anx::perr("async functions can only be noinline, hot, cold or fast", d);
+  if (is_async)
+    lex::eat(); // eat async
+
+  if (is_extern && (is_async || attrs & ~extern_attrs))
+    anx::perr("extern functions can only be pure, const, hot, cold or "
+              "noreturn",
+              d);
+
   lex::exp(lex::tok_fn, "expected 'fn' to start function declaration");
 
   lex::eat(); // eat fn
@@ -147,15 +385,65 @@ std::unique_ptr<ast::FnDecl> parse_fn(bool is_pub) {
 
   lex::eat(); // eat identifier
 
+  // a generic function has type parameters, which stand for the types it is
+  // called with
+  std::vector<ty::Type> params;
+
+  if (lex::tok.tok == lex::tok_binop && lex::tok.val == "<") {
+    lex::eat(); // eat <
+
+    while (1) {
+      lex::exp(lex::tok_identifier, "expected a type parameter name");
+
+      std::string param = lex::tok.val;
+
+      if (builtin_types.count(param) || ty::named(param) || param[0] == '@')
+        anx::perr("'" + param + "' cannot be used as a type parameter name",
+                  lex::c, param.size());
+      if (tparams.count(param))
+        anx::perr("duplicate type parameter '" + param + "'", lex::c,
+                  param.size());
+
+      params.push_back(tparams[param] = ty::param(param));
+
+      lex::eat(); // eat name
+
+      if (lex::tok.tok == lex::tok_binop && lex::tok.val == ">")
+        break;
+
+      lex::exp(lex::tok_comma, "expected ',' or '>' in type parameter list");
+
+      lex::eat(); // eat ,
+    }
+
+    lex::eat(); // eat >
+  }
+
   lex::exp(lex::tok_parens, "expected '(' after function name");
 
   lex::eat(); // eat (
 
   std::vector<std::string> args;
   std::vector<ty::Type> types;
+  bool is_variadic = false;
 
   if (lex::tok.tok != lex::tok_parene) {
     while (1) {
+      // C functions may take any number of arguments after the others
+      if (lex::tok.tok == lex::tok_dot) {
+        if (!is_extern)
+          anx::perr("only extern functions can be variadic", lex::c);
+
+        for (int i = 0; i < 3; i++) {
+          lex::exp(lex::tok_dot, "expected '...'");
+          lex::eat(); // eat .
+        }
+
+        lex::exp(lex::tok_parene, "expected ')' after '...'");
+        is_variadic = true;
+        break;
+      }
+
       lex::exp(lex::tok_identifier,
                "expected parameter name in function argument list");
 
@@ -170,10 +458,7 @@ std::unique_ptr<ast::FnDecl> parse_fn(bool is_pub) {
       lex::exp(lex::tok_identifier, "expected type after parameter name");
 
       args.push_back(name);
-      types.push_back(
-          ty::fromString(lex::tok.val, false, lex::c, lex::tok.val.size()));
-
-      lex::eat(); // eat type
+      types.push_back(parse_type(false));
 
       if (lex::tok.tok == lex::tok_parene)
         break;
@@ -192,9 +477,7 @@ std::unique_ptr<ast::FnDecl> parse_fn(bool is_pub) {
   if (lex::tok.tok == lex::tok_colon) {
     lex::eat(); // eat :
 
-    type = ty::fromString(lex::tok.val, true, lex::c, lex::tok.val.size());
-
-    lex::eat(); // eat return type
+    type = parse_type(true);
   }
 
   std::unique_ptr<ast::Node> body;
@@ -213,9 +496,87 @@ std::unique_ptr<ast::FnDecl> parse_fn(bool is_pub) {
 
   anx::Pos e = lex::l;
 
-  return std::make_unique<ast::FnDecl>(std::move(name), std::move(type),
-                                       std::move(args), std::move(types),
-                                       std::move(body), is_pub, d, n, e);
+  tparams.clear();
+
+  auto fn = std::make_unique<ast::FnDecl>(
+      std::move(name), std::move(type), std::move(args), std::move(types),
+      std::move(params), std::move(body), is_pub, is_async, attrs, d, n, e);
+  fn->is_extern = is_extern;
+  fn->is_variadic = is_variadic;
+  return fn;
+}
+
+// Parse a struct declaration. Its type is declared right away, so that the
+// declarations after it can use it.
+void parse_struct(bool soa) {
+  lex::exp(lex::tok_struct, "expected 'struct' after '@soa'");
+
+  lex::eat(); // eat struct
+
+  lex::exp(lex::tok_identifier, "expected name after struct declaration");
+
+  std::string name = lex::tok.val;
+  anx::Pos n = lex::c;
+
+  if (builtin_types.count(name) || name[0] == '@')
+    anx::perr("'" + name + "' cannot be used as a struct name", n,
+              name.size());
+  if (ty::named(name))
+    anx::perr("a struct with this name already exists", n, name.size());
+
+  lex::eat(); // eat identifier
+
+  lex::exp(lex::tok_curlys, "expected '{' after struct name");
+
+  lex::eat(); // eat {
+
+  std::vector<std::string> fields;
+  std::vector<ty::Type> types;
+
+  while (lex::tok.tok != lex::tok_curlye) {
+    lex::exp(lex::tok_identifier, "expected a field name");
+
+    std::string field = lex::tok.val;
+    anx::Pos f = lex::c;
+
+    for (auto &prev : fields)
+      if (prev == field)
+        anx::perr("duplicate field '" + field + "'", f, field.size());
+
+    lex::eat(); // eat field
+
+    lex::exp(lex::tok_colon, "expected ':' after field name");
+
+    lex::eat(); // eat :
+
+    lex::exp(lex::tok_identifier, "expected type after field name");
+
+    anx::Pos t = lex::c;
+    size_t ts = lex::tok.val.size();
+
+    // structs are copied around as plain values, where the garbage collector
+    // could not find references
+    ty::Type type = parse_type(false);
+    if (ty::isRef(type))
+      anx::perr("structs cannot hold references", t, ts);
+
+    fields.push_back(field);
+    types.push_back(type);
+
+    if (lex::tok.tok == lex::tok_curlye)
+      break;
+
+    lex::exp(lex::tok_eol, "expected ';' after field");
+
+    lex::eat(); // eat ;
+  }
+
+  lex::eat(); // eat }
+
+  if (fields.empty())
+    anx::perr("structs need at least one field", n, name.size());
+
+  ty::structure(name, fields, types, soa);
 }
 
 std::unique_ptr<ast::StmtNode> parse_paren_expr() {
@@ -258,6 +619,76 @@ std::unique_ptr<ast::NumStmt> parse_char() {
   return std::make_unique<ast::NumStmt>(val, n);
 }
 
+std::unique_ptr<ast::StrStmt> parse_str() {
+  std::string val = lex::tok.val;
+  anx::Pos n = lex::c;
+
+  lex::eat(); // eat string
+
+  return std::make_unique<ast::StrStmt>(val, n);
+}
+
+std::unique_ptr<ast::MapStmt> parse_map(ty::Type type) {
+  anx::Pos n = lex::c;
+
+  lex::eat(); // eat {
+
+  std::vector<std::unique_ptr<ast::StmtNode>> keys, vals;
+
+  if (lex::tok.tok != lex::tok_curlye) {
+    while (1) {
+      keys.push_back(parse_expr());
+
+      lex::exp(lex::tok_colon, "expected ':' after map key");
+
+      lex::eat(); // eat :
+
+      vals.push_back(parse_expr());
+
+      if (lex::tok.tok == lex::tok_curlye)
+        break;
+
+      lex::exp(lex::tok_comma,
+               "expected ',' or '}' to continue or close map literal");
+
+      lex::eat(); // eat ,
+    }
+  }
+
+  lex::eat(); // eat }
+
+  std::unique_ptr<ast::MapStmt> map = std::make_unique<ast::MapStmt>(
+      std::move(keys), std::move(vals), type, n);
+
+  map->s = n;
+  map->ssize = lex::l.c + lex::ls - n.c;
+
+  return map;
+}
+
+std::unique_ptr<ast::SpawnStmt> parse_spawn() {
+  lex::eat(); // eat spawn
+
+  lex::exp(lex::tok_identifier, "expected a function call after 'spawn'");
+
+  std::string name = lex::tok.val;
+  anx::Pos n = lex::c;
+
+  lex::eat(); // eat identifier
+
+  lex::exp(lex::tok_parens, "expected '(' after the spawned function's name");
+
+  return std::make_unique<ast::SpawnStmt>(std::move(name), parse_args(), n);
+}
+
+std::unique_ptr<ast::AwaitStmt> parse_await() {
+  anx::Pos n = lex::c;
+
+  lex::eat(); // eat await
+
+  return std::make_unique<ast::AwaitStmt>(parse_primary(), n);
+}
+
 std::unique_ptr<ast::IfStmt> parse_if(bool ternary) {
   anx::Pos d = lex::c;
 
@@ -310,9 +741,15 @@ std::unique_ptr<ast::StmtNode> parse_primary() {
   case lex::tok_character:
     primary = parse_char();
     break;
+  case lex::tok_string:
+    primary = parse_str();
+    break;
   case lex::tok_parens:
     primary = parse_paren_expr();
     break;
+  case lex::tok_curlys:
+    primary = parse_map(ty::ty_void);
+    break;
   case lex::tok_binop:
     if (lex::tok.val == "-")
       primary = parse_unary();
@@ -325,6 +762,12 @@ std::unique_ptr<ast::StmtNode> parse_primary() {
   case lex::tok_if:
     primary = parse_if(true);
     break;
+  case lex::tok_spawn:
+    primary = parse_spawn();
+    break;
+  case lex::tok_await:
+    primary = parse_await();
+    break;
   default:
     anx::perr("expected an expression", {lex::l.r, lex::l.c + lex::ls});
   }
@@ -335,8 +778,18 @@ std::unique_ptr<ast::StmtNode> parse_primary() {
   return primary;
 }
 
+// Whether a parsed expression is a comparison, such as a < b
+bool compares(ast::StmtNode *e) {
+  auto *b = dynamic_cast<ast::BinOpStmt *>(e);
+  return b && (prio(b->op) == prio("==") || prio(b->op) == prio("<"));
+}
+
 std::unique_ptr<ast::StmtNode> parse_binop(int priority,
                                            std::unique_ptr<ast::StmtNode> lhs) {
+  // whether lhs was parsed here rather than as a primary, where parentheses
+  // would have grouped it
+  bool own = false;
+
   while (1) {
     anx::Pos s = lhs->s;
 
@@ -352,8 +805,20 @@ std::unique_ptr<ast::StmtNode> parse_binop(int priority,
 
     std::unique_ptr<ast::StmtNode> rhs = parse_primary();
 
-    if (c_prio < prio(lex::tok.val))
+    bool rcmp = false;
+    if (c_prio < prio(lex::tok.val)) {
       rhs = parse_binop(c_prio + 1, std::move(rhs));
+      rcmp = compares(rhs.get());
+    }
+
+    // C's order makes `x & 1 == 0` mask x with a bool, which is rarely meant,
+    // while `a < b & c < d` is plainly a test of both
+    if (c_prio <= prio("&") && (own && compares(lhs.get())) != rcmp)
+      anx::warn("comparison binds tighter than '" + op +
+                    "', add parentheses around it",
+                n, op.size());
+
+    own = true;
 
     lhs = std::make_unique<ast::BinOpStmt>(std::move(op), std::move(lhs),
                                            std::move(rhs), n);
@@ -375,7 +840,8 @@ std::unique_ptr<ast::StmtNode> parse_expr() {
   return lhs;
 }
 
-std::unique_ptr<ast::WhileNode> parse_while() {
+std::unique_ptr<ast::WhileNode>
+parse_while(std::map<std::string, uint32_t> pragmas = {}) {
   anx::Pos d = lex::c;
 
   lex::eat(); // eat while
@@ -400,19 +866,97 @@ std::unique_ptr<ast::WhileNode> parse_while() {
     body = parse_inst();
 
   return std::make_unique<ast::WhileNode>(std::move(cond), std::move(step),
-                                          std::move(body), d);
+                                          std::move(body), std::move(pragmas),
+                                          d);
+}
+
+// pragmas that can precede a while loop, with the name of their argument for
+// those that take a count
+const std::map<std::string, std::string> loop_pragmas = {
+    {"@unroll", "count"},    {"@no_unroll", ""},  {"@vectorize", "width"},
+    {"@interleave", "count"}, {"@distribute", ""}};
+
+std::unique_ptr<ast::WhileNode> parse_pragmas() {
+  std::map<std::string, uint32_t> pragmas;
+
+  while (lex::tok.tok == lex::tok_identifier &&
+         loop_pragmas.count(lex::tok.val)) {
+    std::string name = lex::tok.val, arg = loop_pragmas.at(name);
+    anx::Pos p = lex::c;
+
+    if (pragmas.count(name))
+      anx::perr("duplicate '" + name + "' pragma", p, name.size());
+
+    lex::eat(); // eat pragma
+
+    uint32_t count = 0;
+    if (!arg.empty() && lex::tok.tok == lex::tok_parens) {
+      lex::eat(); // eat (
+
+      if (lex::tok.tok == lex::tok_identifier) {
+        if (lex::tok.val != arg)
+          anx::perr("expected '" + arg + "'", lex::c, lex::tok.val.size());
+
+        lex::eat(); // eat argument name
+        lex::exp(lex::tok_assign, "expected '=' after '" + arg + "'");
+        lex::eat(); // eat =
+      }
+
+      lex::exp(lex::tok_number, "expected a " + arg);
+      if (lex::tok.val.find_first_not_of("0123456789") != std::string::npos ||
+          lex::tok.val.size() > 4 || !(count = std::stoul(lex::tok.val)))
+        anx::perr(arg + " must be a whole number from 1 to 9999", lex::c,
+                  lex::tok.val.size());
+
+      lex::eat(); // eat count
+      lex::exp(lex::tok_parene, "expected ')'");
+      lex::eat(); // eat )
+    } else if (name == "@interleave")
+      anx::perr("'@interleave' expects a count", p, name.size());
+
+    // the vectorizer ignores widths and interleave counts it cannot use
+    if (name == "@vectorize" && count && (count & (count - 1) || count > 64))
+      anx::perr("vector width must be a power of two up to 64", p,
+                name.size());
+    if (name == "@interleave" && (count & (count - 1) || count > 16))
+      anx::perr("interleave count must be a power of two up to 16", p,
+                name.size());
+
+    if ((name == "@unroll" && pragmas.count("@no_unroll")) ||
+        (name == "@no_unroll" && pragmas.count("@unroll")))
+      anx::perr("'" + name + "' conflicts with an earlier pragma", p,
+                name.size());
+
+    pragmas[name] = count;
+  }
+
+  lex::exp(lex::tok_while, "expected 'while' after loop pragma");
+
+  return parse_while(std::move(pragmas));
 }
 
 std::unique_ptr<ast::RetNode> parse_ret() {
   anx::Pos d = lex::c;
+  bool tail = lex::tok.tok == lex::tok_become;
 
-  lex::eat(); // eat ret
+  lex::eat(); // eat ret or become
 
   std::unique_ptr<ast::StmtNode> val = nullptr;
 
-  if (lex::tok.tok != lex::tok_eol)
+  if (lex::tok.tok != lex::tok_eol || tail)
     val = parse_expr();
 
+  // become returns whatever the call it is given returns, without keeping
+  // the caller's frame around for it
+  if (tail) {
+    auto *call = dynamic_cast<ast::CallStmt *>(val.get());
+    if (!call)
+      anx::perr("expected a function call after 'become'", val->s,
+                val->ssize);
+
+    call->tail = true;
+  }
+
   return std::make_unique<ast::RetNode>(std::move(val), d);
 }
 
@@ -445,14 +989,16 @@ std::unique_ptr<ast::VarDecl> parse_var() {
     lex::exp(lex::tok_colon, "expected a ':' denoting the variable's type");
     lex::eat(); // eat :
 
-    types.push_back(
-        ty::fromString(lex::tok.val, false, lex::c, lex::tok.val.size()));
-
-    lex::eat(); // eat type
+    types.push_back(parse_type(false));
 
     if (lex::tok.tok == lex::tok_assign) {
       lex::eat(); // eat =
-      inits.push_back(parse_expr());
+
+      // map literals take on the declared type, which also allows empty ones
+      if (ty::isMap(types.back()) && lex::tok.tok == lex::tok_curlys)
+        inits.push_back(parse_map(types.back()));
+      else
+        inits.push_back(parse_expr());
       goto varcheck;
     }
 
@@ -488,14 +1034,21 @@ std::unique_ptr<ast::Node> parse_inst() {
     lex::eat(); // eat cont
     break;
   case lex::tok_identifier:
+    if (loop_pragmas.count(lex::tok.val))
+      return parse_pragmas();
+
     n = parse_identifier(true);
     break;
   case lex::tok_ret:
+  case lex::tok_become:
     n = parse_ret();
     break;
   case lex::tok_var:
     n = parse_var();
     break;
+  case lex::tok_await:
+    n = parse_await();
+    break;
   default:
     anx::perr("expected an instruction", lex::c, lex::tok.val.size());
   }
@@ -506,6 +1059,25 @@ std::unique_ptr<ast::Node> parse_inst() {
   return n;
 }
 
+// Parse an import. The pub functions of the module are declared as if their
+// prototypes were written here.
+void parse_import(std::vector<std::unique_ptr<ast::FnDecl>> &decls) {
+  lex::eat(); // eat import
+
+  lex::exp(lex::tok_string, "expected the path of a module after 'import'");
+
+  std::string path = lex::tok.val;
+  anx::Pos p = lex::c;
+
+  lex::eat(); // eat path
+
+  lex::exp(lex::tok_eol, "expected ';'");
+  lex::eat(); // eat ;
+
+  for (auto &fn : iface::load(path, p, path.size() + 2))
+    decls.push_back(std::move(fn));
+}
+
 // generate the AST for a full translation unit
 std::unique_ptr<ast::ProgramNode> ast::unit() {
   std::vector<std::unique_ptr<FnDecl>> decls;
@@ -519,8 +1091,24 @@ std::unique_ptr<ast::ProgramNode> ast::unit() {
       decls.push_back(parse_fn(true));
       break;
     case lex::tok_fn:
+    case lex::tok_attr:
+    case lex::tok_async:
+    case lex::tok_extern:
       decls.push_back(parse_fn(false));
       break;
+    case lex::tok_struct:
+      parse_struct(false);
+      break;
+    case lex::tok_import:
+      parse_import(decls);
+      break;
+    case lex::tok_identifier:
+      if (lex::tok.val == "@soa") {
+        lex::eat(); // eat @soa
+        parse_struct(true);
+        break;
+      }
+      [[fallthrough]];
     default:
       anx::perr("only declarations permitted at the top level", lex::c,
                 lex::tok.val.size());
@@ -535,7 +1123,20 @@ std::unique_ptr<ast::FnDecl> ast::step() {
     lex::eat(); // eat pub
     return parse_fn(true);
   case lex::tok_fn:
+  case lex::tok_attr:
+  case lex::tok_async:
+  case lex::tok_extern:
     return parse_fn(false);
+  case lex::tok_struct:
+    parse_struct(false);
+    return ast::step();
+  case lex::tok_identifier:
+    if (lex::tok.val == "@soa") {
+      lex::eat(); // eat @soa
+      parse_struct(true);
+      return ast::step();
+    }
+    [[fallthrough]];
   default:
     anx::perr("only declarations permitted at the top level", lex::c,
               lex::tok.val.size());
@@ -22,24 +22,42 @@ public:
   size_t ssize;
 };
 
+// modifiers written before `fn`, as a bit set
+enum FnAttr : uint8_t {
+  attr_inline = 1 << 0,
+  attr_noinline = 1 << 1,
+  attr_pure = 1 << 2,  // reads but never writes memory visible to callers
+  attr_const = 1 << 3, // neither reads nor writes it
+  attr_hot = 1 << 4,
+  attr_cold = 1 << 5,
+  attr_noreturn = 1 << 6,
+  attr_fast = 1 << 7, // fast-math float arithmetic
+};
+
 class FnDecl : public Node {
 public:
   std::string name;
   ty::Type type;
   std::vector<std::string> args;
   std::vector<ty::Type> types;
+  std::vector<ty::Type> params; // type parameters, if it is generic
   std::unique_ptr<Node> body;
-  bool is_pub;
-  llvm::Function *F;
+  bool is_pub, is_async;
+  bool is_extern = false, is_variadic = false; // a C function, and its `...`
+  uint8_t attrs;
+  llvm::Function *F; // or the instance being generated, if it is generic
   anx::Pos d, n, e;
 
   FnDecl(std::string name, ty::Type type, std::vector<std::string> args,
-         std::vector<ty::Type> types, std::unique_ptr<Node> body, bool is_pub,
-         anx::Pos d, anx::Pos n, anx::Pos e)
+         std::vector<ty::Type> types, std::vector<ty::Type> params,
+         std::unique_ptr<Node> body, bool is_pub, bool is_async,
+         uint8_t attrs, anx::Pos d, anx::Pos n, anx::Pos e)
       : name(name), type(std::move(type)), args(std::move(args)),
-        types(std::move(types)), body(std::move(body)), is_pub(is_pub), d(d),
-        n(n), e(e) {}
+        types(std::move(types)), params(std::move(params)),
+        body(std::move(body)), is_pub(is_pub), is_async(is_async),
+        attrs(attrs), d(d), n(n), e(e) {}
   void declare();
+  ir::Symbol instance(std::vector<ty::Type> atypes, anx::Pos pos, size_t s);
   ir::Symbol codegen();
 };
 
@@ -108,12 +126,14 @@ public:
   std::unique_ptr<StmtNode> cond;
   std::unique_ptr<StmtNode> step;
   std::unique_ptr<Node> body;
+  std::map<std::string, uint32_t> pragmas; // pragma and its count, or 0
   anx::Pos d;
 
   WhileNode(std::unique_ptr<StmtNode> cond, std::unique_ptr<StmtNode> step,
-            std::unique_ptr<Node> body, anx::Pos d)
+            std::unique_ptr<Node> body,
+            std::map<std::string, uint32_t> pragmas, anx::Pos d)
       : cond(std::move(cond)), step(std::move(step)), body(std::move(body)),
-        d(d) {}
+        pragmas(std::move(pragmas)), d(d) {}
   ir::Symbol codegen();
 };
 
@@ -143,6 +163,19 @@ public:
   ir::Symbol codegen();
 };
 
+// an assignment to a field or array element, as in `a[i].x = 1`
+class StoreStmt : public StmtNode {
+public:
+  std::unique_ptr<StmtNode> target;
+  std::unique_ptr<StmtNode> value;
+  anx::Pos n;
+
+  StoreStmt(std::unique_ptr<StmtNode> target, std::unique_ptr<StmtNode> value,
+            anx::Pos n)
+      : target(std::move(target)), value(std::move(value)), n(n) {}
+  ir::Symbol codegen();
+};
+
 class SwapStmt : public StmtNode {
 public:
   std::vector<std::string> names;
@@ -184,6 +217,7 @@ public:
   std::string name;
   std::vector<std::unique_ptr<StmtNode>> args;
   anx::Pos n;
+  bool tail = false; // called by become
 
   CallStmt(std::string name, std::vector<std::unique_ptr<StmtNode>> args,
            anx::Pos n)
@@ -191,6 +225,28 @@ public:
   ir::Symbol codegen();
 };
 
+class SpawnStmt : public StmtNode {
+public:
+  std::string name;
+  std::vector<std::unique_ptr<StmtNode>> args;
+  anx::Pos n;
+
+  SpawnStmt(std::string name, std::vector<std::unique_ptr<StmtNode>> args,
+            anx::Pos n)
+      : name(name), args(std::move(args)), n(n) {}
+  ir::Symbol codegen();
+};
+
+class AwaitStmt : public StmtNode {
+public:
+  std::unique_ptr<StmtNode> val;
+  anx::Pos n;
+
+  AwaitStmt(std::unique_ptr<StmtNode> val, anx::Pos n)
+      : val(std::move(val)), n(n) {}
+  ir::Symbol codegen();
+};
+
 class IdentStmt : public StmtNode {
 public:
   std::string name;
@@ -200,6 +256,29 @@ public:
   ir::Symbol codegen();
 };
 
+class FieldStmt : public StmtNode {
+public:
+  std::unique_ptr<StmtNode> base;
+  std::string name;
+  anx::Pos n;
+
+  FieldStmt(std::unique_ptr<StmtNode> base, std::string name, anx::Pos n)
+      : base(std::move(base)), name(name), n(n) {}
+  ir::Symbol codegen();
+};
+
+class IndexStmt : public StmtNode {
+public:
+  std::unique_ptr<StmtNode> base;
+  std::unique_ptr<StmtNode> index;
+  anx::Pos n;
+
+  IndexStmt(std::unique_ptr<StmtNode> base, std::unique_ptr<StmtNode> index,
+            anx::Pos n)
+      : base(std::move(base)), index(std::move(index)), n(n) {}
+  ir::Symbol codegen();
+};
+
 class NumStmt : public StmtNode {
 public:
   std::string value;
@@ -209,6 +288,40 @@ public:
   ir::Symbol codegen();
 };
 
+class StrStmt : public StmtNode {
+public:
+  std::string value;
+  anx::Pos n;
+
+  StrStmt(std::string value, anx::Pos n) : value(value), n(n) {}
+  ir::Symbol codegen();
+};
+
+class MapStmt : public StmtNode {
+public:
+  std::vector<std::unique_ptr<StmtNode>> keys, vals;
+  ty::Type type; // void if it is inferred from the first entry
+  anx::Pos n;
+
+  MapStmt(std::vector<std::unique_ptr<StmtNode>> keys,
+          std::vector<std::unique_ptr<StmtNode>> vals, ty::Type type,
+          anx::Pos n)
+      : keys(std::move(keys)), vals(std::move(vals)), type(type), n(n) {}
+  ir::Symbol codegen();
+};
+
+// @sizeof or @alignof a type, in bytes
+class SizeStmt : public StmtNode {
+public:
+  ty::Type type;
+  bool align;
+  anx::Pos n;
+
+  SizeStmt(ty::Type type, bool align, anx::Pos n)
+      : type(type), align(align), n(n) {}
+  ir::Symbol codegen();
+};
+
 std::unique_ptr<ProgramNode> unit();
 std::unique_ptr<FnDecl> step();
 } // namespace ast
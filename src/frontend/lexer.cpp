@@ -4,15 +4,15 @@
 // Lexer - This module tokenizes an input Anx file.
 //===---------------------------------------------------------------------===//
 
-std::vector<std::string> lex::src; // source code
-lex::Token lex::tok;               // current token being parsed
+thread_local std::vector<std::string> lex::src; // source code
+thread_local lex::Token lex::tok;               // current token being parsed
 
-anx::Pos lex::c, lex::l;
-size_t lex::ls;
-anx::Pos t;
+thread_local anx::Pos lex::c, lex::l;
+thread_local size_t lex::ls;
+thread_local anx::Pos t;
 
 char grab() {
-  static std::string curr = "";
+  thread_local std::string curr = "";
 
   while (t.c >= curr.size()) {
     std::getline(*anx::stream, curr);
@@ -30,9 +30,27 @@ char grab() {
   return curr[t.c++];
 }
 
+// Resolve the character following a backslash in a character/string literal
+char escape(char ch) {
+  switch (ch) {
+  case '0':
+    return '\0';
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case '\\':
+  case '\'':
+  case '"':
+    return ch;
+  default:
+    anx::perr("unrecognized escape character", {t.r, t.c - 1});
+  }
+}
+
 // Get the next token from the input file and update the global token variable
 void lex::eat() {
-  static char lch = ' ';
+  thread_local char lch = ' ';
 
   while (isspace(lch))
     lch = grab();
@@ -55,10 +73,20 @@ void lex::eat() {
       tok.tok = tok_fn;
     else if (tok.val == "pub")
       tok.tok = tok_pub;
+    else if (tok.val == "inline" || tok.val == "noinline" ||
+             tok.val == "pure" || tok.val == "const" || tok.val == "hot" ||
+             tok.val == "cold" || tok.val == "noreturn" || tok.val == "fast")
+      tok.tok = tok_attr;
     else if (tok.val == "ret")
       tok.tok = tok_ret;
+    else if (tok.val == "become")
+      tok.tok = tok_become;
+    else if (tok.val == "extern")
+      tok.tok = tok_extern;
     else if (tok.val == "var")
       tok.tok = tok_var;
+    else if (tok.val == "struct")
+      tok.tok = tok_struct;
     else if (tok.val == "if")
       tok.tok = tok_if;
     else if (tok.val == "else")
@@ -69,6 +97,14 @@ void lex::eat() {
       tok.tok = tok_break;
     else if (tok.val == "continue")
       tok.tok = tok_cont;
+    else if (tok.val == "spawn")
+      tok.tok = tok_spawn;
+    else if (tok.val == "async")
+      tok.tok = tok_async;
+    else if (tok.val == "await")
+      tok.tok = tok_await;
+    else if (tok.val == "import")
+      tok.tok = tok_import;
     else
       tok.tok = tok_identifier;
 
@@ -192,6 +228,15 @@ void lex::eat() {
   case ')':
     tok.tok = tok_parene;
     return;
+  case '[':
+    tok.tok = tok_squares;
+    return;
+  case ']':
+    tok.tok = tok_squaree;
+    return;
+  case '.':
+    tok.tok = tok_dot;
+    return;
   case ':':
     tok.tok = tok_colon;
     return;
@@ -200,12 +245,15 @@ void lex::eat() {
   case '+':
   case '-':
   case '%':
+  case '&':
+  case '|':
+  case '^':
     tok.tok = tok_binop;
     return;
   case '<':
   case '>':
     tok.tok = tok_binop;
-    if (lch == '=') {
+    if (lch == '=' || lch == old) {
       tok.val += lch;
       lch = grab();
     }
@@ -226,6 +274,25 @@ void lex::eat() {
     } else
       tok.tok = tok_unop;
     return;
+  case '~':
+    tok.tok = tok_unop;
+    return;
+  case '"': {
+    tok.val = "";
+
+    while (lch != '"') {
+      if (lch == EOF || lch == '\n')
+        anx::perr("missing closing quote in string literal", c,
+                  tok.val.size() + 1);
+
+      tok.val += lch == '\\' ? escape(lch = grab()) : lch;
+      lch = grab();
+    }
+    lch = grab();
+
+    tok.tok = tok_string;
+    return;
+  }
   case '\'':
     size_t st = c.c;
 
@@ -233,20 +300,7 @@ void lex::eat() {
     case '\'':
       anx::perr("cannot have empty character literal", {t.r, c.c}, 2);
     case '\\':
-      lch = grab();
-      switch (lch) {
-      case '0':
-        tok.val = '\0';
-        break;
-      case 'n':
-        tok.val = '\n';
-        break;
-      case '\'':
-        tok.val = '\'';
-        break;
-      default:
-        anx::perr("unrecognized escape character", {t.r, t.c - 1});
-      }
+      tok.val = escape(lch = grab());
       break;
     default:
       tok.val = lch;
@@ -267,6 +321,16 @@ void lex::eat() {
   anx::perr("invalid token found", c);
 }
 
+// Split the first character off the current token, so that the '>' closing a
+// type parameter list can be eaten on its own in `map<i64, map<i64, i64>>`
+void lex::split() {
+  l = c, ls = 1;
+  c.c++;
+
+  tok.val = tok.val.substr(1);
+  tok.tok = tok.val == "=" ? tok_assign : tok_binop;
+}
+
 void lex::exp(lex::TokEnum token, std::string msg) {
   if (tok.tok != token)
     anx::perr(msg, {l.r, l.c + ls});
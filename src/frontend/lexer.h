@@ -13,21 +13,28 @@ enum TokEnum {
   tok_eol, // end of line
 
   // grouping
-  tok_comma,  // ,
-  tok_curlys, // curly start
-  tok_curlye, // curly end
-  tok_parens, // paren start
-  tok_parene, // paren end
+  tok_comma,   // ,
+  tok_curlys,  // curly start
+  tok_curlye,  // curly end
+  tok_parens,  // paren start
+  tok_parene,  // paren end
+  tok_squares, // square bracket start
+  tok_squaree, // square bracket end
+  tok_dot,     // .
 
   // functions
-  tok_fn,  // function
-  tok_pub, // public decorator
-  tok_ret, // return
+  tok_fn,     // function
+  tok_pub,    // public decorator
+  tok_attr,   // function attribute (inline, pure, cold, ...)
+  tok_ret,    // return
+  tok_become, // tail call
+  tok_extern, // foreign function decorator
 
   // variables
   tok_var,    // variable
   tok_colon,  // :
   tok_assign, // =
+  tok_struct, // struct
 
   // comparison / arithmetic
   tok_binop, // binary operation
@@ -40,10 +47,19 @@ enum TokEnum {
   tok_break, // break
   tok_cont,  // continue
 
+  // concurrency
+  tok_spawn, // spawn
+  tok_async, // async function decorator
+  tok_await, // await
+
+  // modules
+  tok_import, // import
+
   // identifiers
   tok_identifier, // identifier
   tok_number,     // literal number
   tok_character,  // literal ascii character
+  tok_string,     // literal string
 };
 
 struct Token {
@@ -51,11 +67,12 @@ struct Token {
   std::string val;
 };
 
-extern std::vector<std::string> src;
-extern Token tok;
-extern anx::Pos c, l;
-extern size_t ls;
+extern thread_local std::vector<std::string> src;
+extern thread_local Token tok;
+extern thread_local anx::Pos c, l;
+extern thread_local size_t ls;
 
 void eat();
+void split();
 void exp(TokEnum token, std::string msg);
 } // namespace lex
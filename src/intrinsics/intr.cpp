@@ -1,33 +1,1478 @@
 #include "intr.h"
+#include "../runtime/rt.h"
+
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
 
 //===---------------------------------------------------------------------===//
 // IR - This module handles and implements compiler intrinsic functions.
 //===---------------------------------------------------------------------===//
 
-std::map<std::string, ir::Symbol> intr::intrinsics;
+thread_local std::map<std::string, ir::Symbol> intr::intrinsics;
+
+llvm::FunctionType *signature(ty::Type ret, std::vector<ty::Type> types) {
+  std::vector<llvm::Type *> Params;
+  for (ty::Type t : types)
+    Params.push_back(ty::toLLVM(t, false));
+
+  return llvm::FunctionType::get(ty::toLLVM(ret, true), Params, false);
+}
+
+// runtime functions that never write memory, so calls to them can be
+// combined and they may be used from pure functions
+const std::set<std::string> readonly = {"anx_str_eq",   "anx_str_cmp",
+                                        "anx_str_find", "anx_str_hash",
+                                        "anx_map_find", "anx_map_size"};
+
+// get or declare an external (unmangled) function from the runtime or libc.
+// only functions that may run the garbage collector are safepoints.
+llvm::Function *external(std::string name, ty::Type ret,
+                         std::vector<ty::Type> types, bool safepoint = false) {
+  llvm::Function *F = ir::mod->getFunction(name);
+  if (F)
+    return F;
+
+  F = llvm::Function::Create(signature(ret, types),
+                             llvm::Function::ExternalLinkage, name,
+                             ir::mod.get());
+  if (!safepoint)
+    F->addFnAttr("gc-leaf-function");
+  if (readonly.count(name))
+    F->setOnlyReadsMemory();
+
+  return F;
+}
+
+// define a private function whose body implements an intrinsic inline. it
+// is always inlined into its callers before code generation.
+llvm::Function *inlined(std::string name, ty::Type ret,
+                        std::vector<ty::Type> types) {
+  // private rather than internal: the loop passes take an internal function
+  // called only once for one that is about to be inlined, and refuse to
+  // unroll loops that call it, but intrinsics are only inlined late
+  llvm::Function *F = llvm::Function::Create(
+      signature(ret, types), llvm::Function::PrivateLinkage,
+      "anx." + name.substr(1), ir::mod.get());
+  F->addFnAttr(llvm::Attribute::AlwaysInline);
+
+  llvm::BasicBlock::Create(*ir::ctx, "entry", F);
+
+  return F;
+}
+
+// address of slot i of a garbage collected object
+llvm::Value *slot(llvm::IRBuilder<> &b, llvm::Value *obj, llvm::Value *i) {
+  llvm::Value *off = b.CreateAdd(b.CreateShl(i, 3), b.getInt64(ANX_GC_HDR));
+  return b.CreateGEP(b.getInt8Ty(), obj, off, "slot");
+}
+
+// end the program unless obj was allocated to hold references exactly when
+// refs is set. accesses to an object allocated in sight are checked when
+// they are compiled instead (see FnDecl::codegen).
+void kind(llvm::IRBuilder<> &b, llvm::Value *obj, bool refs) {
+  llvm::Function *M = external("anx_gc_mismatch", ty::ty_void, {ty::ty_u8});
+  M->setDoesNotReturn();
+  M->addFnAttr(llvm::Attribute::Cold);
+
+  llvm::Value *flags = b.CreateLoad(
+      b.getInt16Ty(), b.CreateConstGEP1_64(b.getInt8Ty(), obj, ANX_GC_FLAGS),
+      "flags");
+  llvm::Value *bad =
+      b.CreateICmpEQ(b.CreateAnd(flags, b.getInt16(ANX_GC_REFS)),
+                     b.getInt16(refs ? 0 : ANX_GC_REFS), "mismatch");
+
+  llvm::Function *F = b.GetInsertBlock()->getParent();
+  llvm::BasicBlock *BadBB = llvm::BasicBlock::Create(*ir::ctx, "bad", F);
+  llvm::BasicBlock *OkBB = llvm::BasicBlock::Create(*ir::ctx, "ok", F);
+  llvm::MDBuilder MDB(*ir::ctx);
+  b.CreateCondBr(bad, BadBB, OkBB, MDB.createBranchWeights(1, 2000));
+
+  b.SetInsertPoint(BadBB);
+  b.CreateCall(M, {b.getInt8(refs)});
+  b.CreateUnreachable();
+
+  b.SetInsertPoint(OkBB);
+}
+
+// store a value in a fresh stack slot so it can be passed by pointer
+llvm::Value *spill(llvm::IRBuilder<> &b, llvm::Value *v) {
+  llvm::Value *a = b.CreateAlloca(v->getType());
+  b.CreateStore(v, a);
+  return a;
+}
+
+// wrap a runtime function that takes strings by pointer (and returns them
+// through a leading out pointer) so that it can be called with string values
+llvm::Function *bystr(std::string name, std::string cname, ty::Type ret,
+                      std::vector<ty::Type> types) {
+  bool sret = ty::isStr(ret);
+  llvm::Type *strT = ty::toLLVM(ty::ty_str, false);
+
+  std::vector<ty::Type> ctypes;
+  if (sret)
+    ctypes.push_back(ty::ty_ptr);
+  for (ty::Type t : types)
+    ctypes.push_back(ty::isStr(t) ? ty::ty_ptr : t);
+
+  // C booleans come back as bytes
+  ty::Type cret = sret ? ty::ty_void : ty::isBool(ret) ? ty::ty_u8 : ret;
+  llvm::Function *C = external(cname, cret, ctypes);
+
+  llvm::Function *F = inlined(name, ret, types);
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  std::vector<llvm::Value *> args;
+  llvm::Value *out = nullptr;
+  if (sret)
+    args.push_back(out = b.CreateAlloca(strT));
+
+  for (auto &A : F->args())
+    args.push_back(A.getType() == strT ? spill(b, &A) : &A);
+
+  llvm::Value *r = b.CreateCall(C, args);
+
+  if (sret)
+    b.CreateRet(b.CreateLoad(strT, out));
+  else if (ty::isVoid(ret))
+    b.CreateRetVoid();
+  else if (ty::isBool(ret))
+    b.CreateRet(b.CreateICmpNE(r, b.getInt8(0)));
+  else
+    b.CreateRet(r);
+
+  return F;
+}
+
+// whether a string value uses the inline representation, and if so its length
+std::pair<llvm::Value *, llvm::Value *> inline_len(llvm::IRBuilder<> &b,
+                                                   llvm::Value *str) {
+  llvm::Value *top = b.CreateLShr(b.CreateExtractValue(str, 2), 56);
+  llvm::Value *tag = b.CreateAnd(top, b.getInt64(ANX_STR_TAG));
+  return {b.CreateICmpNE(tag, b.getInt64(0), "inline"),
+          b.CreateAnd(top, b.getInt64(~ANX_STR_TAG & 0xff))};
+}
+
+llvm::Value *intr::appended(llvm::IRBuilder<> &b, llvm::Value *a,
+                            llvm::Value *out) {
+  // a owned its buffer, which is not inline, and out has the same one
+  llvm::Value *cap = b.CreateExtractValue(a, 2);
+  llvm::Value *moved = b.CreateAnd(
+      b.CreateICmpSGT(cap, b.getInt64(0)),
+      b.CreateAnd(b.CreateICmpEQ(b.CreateExtractValue(out, 2), cap),
+                  b.CreateICmpEQ(b.CreateExtractValue(out, 0),
+                                 b.CreateExtractValue(a, 0))),
+      "moved");
+  return b.CreateSelect(moved, b.CreateInsertValue(a, b.getInt64(0), 2), a);
+}
+
+// hash a map key the same way as the runtime does. keys of up to 16 bytes are
+// mixed inline, strings are hashed through the pointer they were spilled to.
+llvm::Value *hash(llvm::IRBuilder<> &b, ty::Type kt, llvm::Value *key,
+                  llvm::Value *kp) {
+  if (ty::isStr(kt))
+    return b.CreateCall(external("anx_str_hash", ty::ty_u64, {ty::ty_ptr}),
+                        {kp}, "hash");
+
+  // maps, tasks and futures are handles, the other compound types cannot be
+  // keys
+  llvm::Value *x = key;
+  if (ty::isPtr(kt) || kt >= ty::ty_compound)
+    x = b.CreatePtrToInt(x, b.getInt64Ty());
+  else if (ty::isSingle(kt) || ty::isDouble(kt))
+    x = b.CreateBitCast(x, b.getIntNTy(ty::width(kt)));
+
+  if (ty::width(kt) > 64)
+    x = b.CreateXor(b.CreateTrunc(x, b.getInt64Ty()),
+                    b.CreateTrunc(b.CreateLShr(x, 64), b.getInt64Ty()));
+  else
+    x = b.CreateZExt(x, b.getInt64Ty());
+
+  llvm::Value *h = b.CreateMul(x, b.getInt64(0x9e3779b97f4a7c15ull));
+  return b.CreateXor(h, b.CreateLShr(h, 32), "hash");
+}
+
+// intrinsics that are generated separately for every compound type they are
+// used with, keyed by name to the kind of their first argument
+const std::map<std::string, ty::Kind> generics = {
+    {"@map_new", ty::kind_map}, {"@insert", ty::kind_map},
+    {"@lookup", ty::kind_map},  {"@has", ty::kind_map},
+    {"@remove", ty::kind_map},  {"@size", ty::kind_map},
+    {"@reserve", ty::kind_map}, {"@rehash", ty::kind_map},
+    {"@next", ty::kind_map},    {"@key_at", ty::kind_map},
+    {"@val_at", ty::kind_map},  {"@map_free", ty::kind_map},
+    {"@join", ty::kind_task},   {"@block_on", ty::kind_future},
+    {"@resize", ty::kind_arr},  {"@push", ty::kind_arr},
+    {"@arr_free", ty::kind_arr}, {"@data", ty::kind_arr}};
+
+// generate the intrinsic `name` for the map type mt. the runtime tables are
+// untyped, so each map type gets its own wrappers that hash keys and move
+// values of the right size in and out of the slots.
+ir::Symbol map(std::string name, ty::Type mt) {
+  ty::Type kt = ty::compound(mt).params[0], vt = ty::compound(mt).params[1];
+  llvm::Type *K = ty::toLLVM(kt, false), *V = ty::toLLVM(vt, false);
+  llvm::Align A(8); // keys and values start on 8 byte boundaries
+
+  ty::Type ret;
+  std::vector<ty::Type> types = {mt};
+
+  if (name == "@map_new")
+    ret = mt, types = {};
+  else if (name == "@insert")
+    ret = ty::ty_void, types.push_back(kt), types.push_back(vt);
+  else if (name == "@lookup")
+    ret = vt, types.push_back(kt);
+  else if (name == "@has" || name == "@remove")
+    ret = ty::ty_bool, types.push_back(kt);
+  else if (name == "@size")
+    ret = ty::ty_u64;
+  else if (name == "@reserve" || name == "@rehash")
+    ret = ty::ty_void, types.push_back(ty::ty_u64);
+  else if (name == "@next")
+    ret = ty::ty_i64, types.push_back(ty::ty_i64);
+  else if (name == "@key_at")
+    ret = kt, types.push_back(ty::ty_i64);
+  else if (name == "@val_at")
+    ret = vt, types.push_back(ty::ty_i64);
+  else
+    ret = ty::ty_void;
+
+  llvm::Function *F = inlined(name, ret, types);
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+  llvm::Value *m = F->arg_size() ? F->getArg(0) : nullptr;
+
+  // map handles and keys are passed to the runtime as untyped pointers
+  std::vector<ty::Type> keyed = {ty::ty_ptr, ty::ty_ptr, ty::ty_u64};
+  llvm::Value *kp = nullptr, *h = nullptr;
+  if (name == "@insert" || name == "@lookup" || name == "@has" ||
+      name == "@remove") {
+    kp = spill(b, F->getArg(1));
+    h = hash(b, kt, F->getArg(1), kp);
+  }
+
+  if (name == "@map_new") {
+    llvm::Function *C = external("anx_map_new", ty::ty_ptr,
+                                 {ty::ty_u32, ty::ty_u32, ty::ty_u8});
+    b.CreateRet(b.CreateCall(C, {b.getInt32(ty::size(kt)),
+                                 b.getInt32(ty::size(vt)),
+                                 b.getInt8(ty::isStr(kt))},
+                             "map"));
+  } else if (name == "@insert") {
+    llvm::Value *p =
+        b.CreateCall(external("anx_map_insert", ty::ty_ptr, keyed), {m, kp, h});
+    b.CreateAlignedStore(F->getArg(2), p, A);
+    b.CreateRetVoid();
+  } else if (name == "@lookup") {
+    // missing keys read the zero value from a local slot instead of branching
+    llvm::Value *p =
+        b.CreateCall(external("anx_map_find", ty::ty_ptr, keyed), {m, kp, h});
+    llvm::AllocaInst *zero = b.CreateAlloca(V);
+    zero->setAlignment(A);
+    b.CreateStore(llvm::Constant::getNullValue(V), zero);
+    p = b.CreateSelect(b.CreateIsNull(p), zero, p);
+    b.CreateRet(b.CreateAlignedLoad(V, p, A, "val"));
+  } else if (name == "@has") {
+    llvm::Value *p =
+        b.CreateCall(external("anx_map_find", ty::ty_ptr, keyed), {m, kp, h});
+    b.CreateRet(b.CreateIsNotNull(p));
+  } else if (name == "@remove") {
+    llvm::Value *r =
+        b.CreateCall(external("anx_map_erase", ty::ty_u8, keyed), {m, kp, h});
+    b.CreateRet(b.CreateICmpNE(r, b.getInt8(0)));
+  } else if (name == "@size") {
+    b.CreateRet(b.CreateCall(
+        external("anx_map_size", ty::ty_u64, {ty::ty_ptr}), {m}, "size"));
+  } else if (name == "@reserve" || name == "@rehash") {
+    std::string cname =
+        name == "@reserve" ? "anx_map_reserve" : "anx_map_rehash";
+    b.CreateCall(external(cname, ty::ty_void, {ty::ty_ptr, ty::ty_u64}),
+                 {m, F->getArg(1)});
+    b.CreateRetVoid();
+  } else if (name == "@next") {
+    b.CreateRet(b.CreateCall(
+        external("anx_map_next", ty::ty_i64, {ty::ty_ptr, ty::ty_i64}),
+        {m, F->getArg(1)}, "next"));
+  } else if (name == "@key_at" || name == "@val_at") {
+    std::string cname = name == "@key_at" ? "anx_map_key" : "anx_map_val";
+    llvm::Value *p = b.CreateCall(
+        external(cname, ty::ty_ptr, {ty::ty_ptr, ty::ty_i64}),
+        {m, F->getArg(1)});
+    b.CreateRet(
+        b.CreateAlignedLoad(name == "@key_at" ? K : V, p, A, "entry"));
+  } else if (name == "@map_free") {
+    b.CreateCall(external("anx_map_free", ty::ty_void, {ty::ty_ptr}), {m});
+    b.CreateRetVoid();
+  }
+
+  return ir::Symbol(F, ret, types);
+}
+
+// generate @join for the task type tt, which waits for the task and takes
+// its result out of the environment it ran in
+ir::Symbol task(std::string name, ty::Type tt) {
+  ty::Type rt = ty::compound(tt).params[0];
+
+  llvm::Function *J = external("anx_join", ty::ty_ptr, {ty::ty_ptr});
+  llvm::Function *Free = external("anx_free", ty::ty_void, {ty::ty_ptr});
+
+  llvm::Function *F = inlined(name, rt, {tt});
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  llvm::Value *env = b.CreateCall(J, {F->getArg(0)}, "env");
+  llvm::Value *r = nullptr;
+  if (!ty::isVoid(rt))
+    r = b.CreateLoad(ty::toLLVM(rt, false), env, "result");
+  b.CreateCall(Free, {env});
+
+  if (r)
+    b.CreateRet(r);
+  else
+    b.CreateRetVoid();
+
+  return ir::Symbol(F, rt, {tt});
+}
+
+llvm::Value *intr::spawn(ir::Symbol fn, std::vector<llvm::Value *> args) {
+  llvm::Function *F = fn.fn();
+  bool ret = !ty::isVoid(fn.typ());
+
+  // the environment holds the result followed by the arguments
+  std::vector<llvm::Type *> fields;
+  if (ret)
+    fields.push_back(F->getReturnType());
+  for (auto &A : F->args())
+    fields.push_back(A.getType());
+  llvm::StructType *envT = llvm::StructType::get(*ir::ctx, fields);
+
+  // the thunk that runs on a worker unpacks the environment, makes the call
+  // and stores its result back
+  std::string tname = "anx.spawn." + F->getName().str();
+  llvm::Function *T = ir::mod->getFunction(tname);
+  if (!T) {
+    T = llvm::Function::Create(signature(ty::ty_void, {ty::ty_ptr}),
+                               llvm::Function::InternalLinkage, tname,
+                               ir::mod.get());
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(*ir::ctx, "entry", T));
+
+    std::vector<llvm::Value *> a;
+    for (unsigned i = ret; i < fields.size(); i++)
+      a.push_back(
+          b.CreateLoad(fields[i], b.CreateStructGEP(envT, T->getArg(0), i)));
+
+    llvm::CallInst *r = b.CreateCall(F, a);
+    r->setCallingConv(F->getCallingConv());
+    if (ret)
+      b.CreateStore(r, b.CreateStructGEP(envT, T->getArg(0), 0));
+    b.CreateRetVoid();
+  }
+
+  llvm::Value *env = ir::builder->CreateCall(
+      external("anx_alloc", ty::ty_ptr, {ty::ty_u64}),
+      {llvm::ConstantExpr::getSizeOf(envT)}, "env");
+
+  for (unsigned i = 0; i < args.size(); i++)
+    ir::builder->CreateStore(args[i],
+                             ir::builder->CreateStructGEP(envT, env, i + ret));
+
+  return ir::builder->CreateCall(
+      external("anx_spawn", ty::ty_ptr, {ty::ty_ptr, ty::ty_ptr}), {T, env},
+      "task");
+}
+
+// the names of the functions and loops counted by --instrument, indexed by
+// their site number
+thread_local std::vector<std::string> sites;
+
+uint32_t intr::site(std::string name) {
+  sites.push_back(name);
+  return sites.size() - 1;
+}
+
+void intr::enter(llvm::IRBuilder<> &b, uint32_t site) {
+  b.CreateCall(external("anx_prof_enter", ty::ty_void, {ty::ty_u32}),
+               {b.getInt32(site)});
+}
+
+void intr::leave(llvm::IRBuilder<> &b) {
+  b.CreateCall(external("anx_prof_exit", ty::ty_void, {}), {});
+}
+
+void intr::trips(llvm::IRBuilder<> &b, uint32_t site, llvm::Value *n) {
+  b.CreateCall(
+      external("anx_prof_loop", ty::ty_void, {ty::ty_u32, ty::ty_u64}),
+      {b.getInt32(site), n});
+}
+
+// hand the table of site names to the profiler from a constructor, so that
+// it is in place before any instrumented code runs
+void intr::profile() {
+  llvm::Function *F = llvm::Function::Create(
+      signature(ty::ty_void, {}), llvm::Function::InternalLinkage,
+      "anx.prof.init", ir::mod.get());
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(*ir::ctx, "entry", F));
+
+  std::vector<llvm::Constant *> names;
+  for (std::string &name : sites)
+    names.push_back(b.CreateGlobalStringPtr(name, "site"));
+
+  llvm::ArrayType *T =
+      llvm::ArrayType::get(llvm::PointerType::get(*ir::ctx, 0), names.size());
+  llvm::GlobalVariable *table = new llvm::GlobalVariable(
+      *ir::mod, T, true, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantArray::get(T, names), "anx.prof.sites");
+
+  b.CreateCall(external("anx_prof_init", ty::ty_void, {ty::ty_ptr, ty::ty_u32}),
+               {table, b.getInt32(names.size())});
+  b.CreateRetVoid();
+
+  llvm::appendToGlobalCtors(*ir::mod, F, 0);
+}
+
+llvm::Function *coro(llvm::Intrinsic::ID id,
+                     std::vector<llvm::Type *> tys = {}) {
+  return llvm::Intrinsic::getDeclaration(ir::mod.get(), id, tys);
+}
+
+llvm::StructType *promise(ty::Type type) {
+  std::vector<llvm::Type *> fields = {llvm::PointerType::get(*ir::ctx, 0)};
+  if (!ty::isVoid(type))
+    fields.push_back(ty::toLLVM(type, false));
+
+  return llvm::StructType::get(*ir::ctx, fields);
+}
+
+// the promise of another coroutine. promises are always 16 byte aligned so
+// that their offset in the frame does not depend on the result type.
+llvm::Value *promise_of(llvm::IRBuilder<> &b, llvm::Value *h) {
+  return b.CreateCall(coro(llvm::Intrinsic::coro_promise),
+                      {h, b.getInt32(16), b.getFalse()}, "promise");
+}
+
+// mark the point from which the current coroutine may be resumed. its handle
+// must not be handed to anyone who could resume it before this point.
+llvm::Value *save(llvm::IRBuilder<> &b, intr::Coro &co) {
+  return b.CreateCall(coro(llvm::Intrinsic::coro_save), {co.hdl}, "save");
+}
+
+// suspend the current coroutine, continuing in a new block once resumed
+void suspend(llvm::IRBuilder<> &b, intr::Coro &co, llvm::Value *save) {
+  llvm::Function *F = b.GetInsertBlock()->getParent();
+  llvm::Value *s = b.CreateCall(coro(llvm::Intrinsic::coro_suspend),
+                                {save, b.getFalse()}, "suspend");
+
+  llvm::BasicBlock *ResumeBB = llvm::BasicBlock::Create(*ir::ctx, "resume", F);
+  llvm::SwitchInst *SW = b.CreateSwitch(s, co.suspend, 2);
+  SW->addCase(b.getInt8(0), ResumeBB);
+  SW->addCase(b.getInt8(1), co.cleanup);
+
+  b.SetInsertPoint(ResumeBB);
+}
+
+// take the result out of a completed coroutine and destroy it
+llvm::Value *result(llvm::IRBuilder<> &b, llvm::Value *h, ty::Type type) {
+  llvm::Value *r = nullptr;
+  if (!ty::isVoid(type))
+    r = b.CreateLoad(ty::toLLVM(type, false),
+                     b.CreateStructGEP(promise(type), promise_of(b, h), 1),
+                     "result");
+
+  b.CreateCall(coro(llvm::Intrinsic::coro_destroy), {h});
+  return r;
+}
+
+// emit the start and the end of a coroutine. the coroutine runs eagerly until
+// it first suspends, and its ramp function returns its handle. when it
+// completes it schedules the coroutine waiting on it, if there is one, and
+// stays suspended until that waiter destroys it.
+intr::Coro intr::coroutine(llvm::IRBuilder<> &b, llvm::Function *F,
+                           ty::Type type) {
+  Coro co;
+  llvm::PointerType *P = llvm::PointerType::get(*ir::ctx, 0);
+  llvm::Constant *null = llvm::ConstantPointerNull::get(P);
+
+  if (F->empty())
+    llvm::BasicBlock::Create(*ir::ctx, "entry", F);
+  llvm::BasicBlock *EntryBB = &F->getEntryBlock();
+  b.SetInsertPoint(EntryBB);
+
+  co.promiseT = promise(type);
+  llvm::AllocaInst *pr = b.CreateAlloca(co.promiseT, nullptr, "promise");
+  pr->setAlignment(llvm::Align(16));
+  co.promise = pr;
+
+  llvm::Value *id = b.CreateCall(coro(llvm::Intrinsic::coro_id),
+                                 {b.getInt32(16), pr, null, null}, "id");
+
+  // frames are allocated by the runtime unless CoroElide places them inside
+  // the frame of their caller
+  llvm::BasicBlock *AllocBB =
+      llvm::BasicBlock::Create(*ir::ctx, "coro.alloc", F);
+  llvm::BasicBlock *BeginBB =
+      llvm::BasicBlock::Create(*ir::ctx, "coro.begin", F);
+  b.CreateCondBr(b.CreateCall(coro(llvm::Intrinsic::coro_alloc), {id}),
+                 AllocBB, BeginBB);
+
+  b.SetInsertPoint(AllocBB);
+  llvm::Value *size =
+      b.CreateCall(coro(llvm::Intrinsic::coro_size, {b.getInt64Ty()}));
+  llvm::Value *mem = b.CreateCall(
+      external("anx_alloc", ty::ty_ptr, {ty::ty_u64}), {size}, "mem");
+  b.CreateBr(BeginBB);
+
+  b.SetInsertPoint(BeginBB);
+  llvm::PHINode *frame = b.CreatePHI(P, 2, "frame");
+  frame->addIncoming(null, EntryBB);
+  frame->addIncoming(mem, AllocBB);
+  co.hdl = b.CreateCall(coro(llvm::Intrinsic::coro_begin), {id, frame}, "hdl");
+  b.CreateStore(null, b.CreateStructGEP(co.promiseT, pr, 0));
+
+  co.final = llvm::BasicBlock::Create(*ir::ctx, "coro.final", F);
+  co.cleanup = llvm::BasicBlock::Create(*ir::ctx, "coro.cleanup", F);
+  co.suspend = llvm::BasicBlock::Create(*ir::ctx, "coro.suspend", F);
+  llvm::BasicBlock *WakeBB = llvm::BasicBlock::Create(*ir::ctx, "coro.wake", F);
+  llvm::BasicBlock *EndBB = llvm::BasicBlock::Create(*ir::ctx, "coro.end", F);
+  llvm::BasicBlock *FreeBB = llvm::BasicBlock::Create(*ir::ctx, "coro.free", F);
+  llvm::BasicBlock *NeverBB =
+      llvm::BasicBlock::Create(*ir::ctx, "coro.never", F);
+
+  llvm::IRBuilder<> e(co.final);
+  llvm::Value *waiter =
+      e.CreateLoad(P, e.CreateStructGEP(co.promiseT, pr, 0), "waiter");
+  e.CreateCondBr(e.CreateIsNotNull(waiter), WakeBB, EndBB);
+
+  e.SetInsertPoint(WakeBB);
+  e.CreateCall(external("anx_async_ready", ty::ty_void, {ty::ty_ptr}),
+               {waiter});
+  e.CreateBr(EndBB);
+
+  // a coroutine is never resumed from its final suspension point
+  e.SetInsertPoint(EndBB);
+  llvm::Value *s = e.CreateCall(coro(llvm::Intrinsic::coro_suspend),
+                                {llvm::ConstantTokenNone::get(*ir::ctx),
+                                 e.getTrue()},
+                                "final");
+  llvm::SwitchInst *SW = e.CreateSwitch(s, co.suspend, 2);
+  SW->addCase(e.getInt8(0), NeverBB);
+  SW->addCase(e.getInt8(1), co.cleanup);
+
+  e.SetInsertPoint(NeverBB);
+  e.CreateUnreachable();
+
+  e.SetInsertPoint(co.cleanup);
+  llvm::Value *dead =
+      e.CreateCall(coro(llvm::Intrinsic::coro_free), {id, co.hdl}, "dead");
+  e.CreateCondBr(e.CreateIsNotNull(dead), FreeBB, co.suspend);
+
+  e.SetInsertPoint(FreeBB);
+  e.CreateCall(external("anx_free", ty::ty_void, {ty::ty_ptr}), {dead});
+  e.CreateBr(co.suspend);
+
+  e.SetInsertPoint(co.suspend);
+  e.CreateCall(coro(llvm::Intrinsic::coro_end),
+               {co.hdl, e.getFalse(), llvm::ConstantTokenNone::get(*ir::ctx)});
+  e.CreateRet(co.hdl);
+
+  return co;
+}
+
+llvm::Value *intr::await(llvm::IRBuilder<> &b, Coro &co, llvm::Value *h,
+                         ty::Type type) {
+  llvm::Function *F = b.GetInsertBlock()->getParent();
+  llvm::BasicBlock *WaitBB = llvm::BasicBlock::Create(*ir::ctx, "await", F);
+  llvm::BasicBlock *ReadyBB = llvm::BasicBlock::Create(*ir::ctx, "ready", F);
+
+  b.CreateCondBr(b.CreateCall(coro(llvm::Intrinsic::coro_done), {h}, "done"),
+                 ReadyBB, WaitBB);
+
+  // register as the waiter and suspend until the awaited coroutine is done
+  b.SetInsertPoint(WaitBB);
+  llvm::Value *s = save(b, co);
+  b.CreateStore(co.hdl, b.CreateStructGEP(promise(type), promise_of(b, h), 0));
+  suspend(b, co, s);
+  b.CreateBr(ReadyBB);
+
+  b.SetInsertPoint(ReadyBB);
+  return result(b, h, type);
+}
+
+void intr::complete(llvm::IRBuilder<> &b, Coro &co, llvm::Value *v) {
+  if (v)
+    b.CreateStore(v, b.CreateStructGEP(co.promiseT, co.promise, 1));
+  b.CreateBr(co.final);
+}
+
+// define an asynchronous intrinsic as a coroutine, leaving b in its body
+llvm::Function *async(llvm::IRBuilder<> &b, intr::Coro &co, std::string name,
+                      ty::Type ret, std::vector<ty::Type> types) {
+  std::vector<llvm::Type *> Params;
+  for (ty::Type t : types)
+    Params.push_back(ty::toLLVM(t, false));
+
+  llvm::Function *F = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::PointerType::get(*ir::ctx, 0), Params,
+                              false),
+      llvm::Function::InternalLinkage, "anx." + name.substr(1), ir::mod.get());
+  F->setPresplitCoroutine();
+
+  co = intr::coroutine(b, F, ret);
+  return F;
+}
+
+// an asynchronous read or write: retry the operation each time the
+// descriptor becomes ready until it stops failing with ANX_ASYNC_AGAIN
+llvm::Function *async_io(std::string name, bool write) {
+  llvm::IRBuilder<> b(*ir::ctx);
+  intr::Coro co;
+  llvm::Function *F = async(b, co, name, ty::ty_i64,
+                            {ty::ty_i32, ty::ty_ptr, ty::ty_u64});
+
+  llvm::Function *Try =
+      external("anx_async_try", ty::ty_i64,
+               {ty::ty_i32, ty::ty_ptr, ty::ty_u64, ty::ty_u8});
+  llvm::Function *Wait = external("anx_async_wait", ty::ty_void,
+                                  {ty::ty_i32, ty::ty_u8, ty::ty_ptr});
+
+  llvm::BasicBlock *TryBB = llvm::BasicBlock::Create(*ir::ctx, "try", F);
+  llvm::BasicBlock *WaitBB = llvm::BasicBlock::Create(*ir::ctx, "wait", F);
+  llvm::BasicBlock *DoneBB = llvm::BasicBlock::Create(*ir::ctx, "done", F);
+  b.CreateBr(TryBB);
+
+  b.SetInsertPoint(TryBB);
+  llvm::Value *r = b.CreateCall(
+      Try, {F->getArg(0), F->getArg(1), F->getArg(2), b.getInt8(write)}, "r");
+  b.CreateCondBr(b.CreateICmpEQ(r, b.getInt64(ANX_ASYNC_AGAIN)), WaitBB,
+                 DoneBB);
+
+  b.SetInsertPoint(WaitBB);
+  llvm::Value *s = save(b, co);
+  b.CreateCall(Wait, {F->getArg(0), b.getInt8(write), co.hdl});
+  suspend(b, co, s);
+  b.CreateBr(TryBB);
+
+  b.SetInsertPoint(DoneBB);
+  intr::complete(b, co, r);
+
+  return F;
+}
+
+// generate @block_on for the future type ft, which runs the event loop until
+// the future is done. the handle is passed to the runtime rather than checked
+// here, so that a frame elided into this function is seen to escape into it.
+ir::Symbol block_on(std::string name, ty::Type ft) {
+  ty::Type rt = ty::compound(ft).params[0];
+
+  llvm::Function *F = inlined(name, rt, {ft});
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  llvm::Value *h = F->getArg(0);
+  b.CreateCall(external("anx_async_run", ty::ty_void, {ty::ty_ptr}), {h});
+
+  llvm::Value *r = result(b, h, rt);
+  if (r)
+    b.CreateRet(r);
+  else
+    b.CreateRetVoid();
+
+  return ir::Symbol(F, rt, {ft});
+}
+
+// the types of the buffers arrays of type at keep their elements in: one for
+// each field of an @soa struct, or a single one of whole elements
+std::vector<ty::Type> buffers(ty::Type at) {
+  ty::Type et = ty::compound(at).params[0];
+  if (ty::isStruct(et) && ty::compound(et).soa)
+    return ty::compound(et).params;
+  return {et};
+}
+
+llvm::Value *intr::element(llvm::IRBuilder<> &b, ty::Type at, llvm::Value *a,
+                           llvm::Value *i, unsigned k) {
+  return b.CreateInBoundsGEP(ty::toLLVM(buffers(at)[k], false),
+                             b.CreateExtractValue(a, k), i, "elem");
+}
+
+llvm::Value *intr::length(llvm::IRBuilder<> &b, ty::Type at, llvm::Value *a) {
+  return b.CreateExtractValue(a, buffers(at).size(), "len");
+}
+
+// generate the intrinsic `name` for the array type at. arrays are values, so
+// the intrinsics return the updated array, which the call stores back into
+// its argument.
+ir::Symbol array(std::string name, ty::Type at) {
+  ty::Type et = ty::compound(at).params[0];
+  std::vector<ty::Type> bufs = buffers(at);
+  unsigned k = bufs.size(); // the length follows the buffers, then capacity
+  const llvm::DataLayout &DL = ir::mod->getDataLayout();
+
+  auto size = [&](unsigned j) -> uint64_t {
+    return DL.getTypeAllocSize(ty::toLLVM(bufs[j], false));
+  };
+
+  // the address of the elements, to hand them to C functions
+  if (name == "@data") {
+    llvm::Function *F = inlined(name, ty::ty_ptr, {at});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+    b.CreateRet(b.CreateExtractValue(F->getArg(0), 0, "data"));
+    return ir::Symbol(F, ty::ty_ptr, {at});
+  }
+
+  if (name == "@arr_free") {
+    llvm::Function *Free = external("anx_free", ty::ty_void, {ty::ty_ptr});
+    llvm::Function *F = inlined(name, at, {at});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+    for (unsigned j = 0; j < k; j++)
+      b.CreateCall(Free, {b.CreateExtractValue(F->getArg(0), j)});
+    b.CreateRet(llvm::Constant::getNullValue(F->getReturnType()));
+    return ir::Symbol(F, at, {at});
+  }
+
+  // reallocate every buffer of a to hold cap elements
+  llvm::Function *Realloc =
+      external("anx_realloc", ty::ty_ptr, {ty::ty_ptr, ty::ty_u64});
+  auto grow = [&](llvm::IRBuilder<> &b, llvm::Value *a, llvm::Value *cap) {
+    for (unsigned j = 0; j < k; j++) {
+      llvm::Value *p = b.CreateCall(
+          Realloc, {b.CreateExtractValue(a, j),
+                    b.CreateMul(cap, b.getInt64(size(j)), "size")});
+      a = b.CreateInsertValue(a, p, j);
+    }
+    return b.CreateInsertValue(a, cap, k + 1);
+  };
+
+  std::vector<ty::Type> types =
+      name == "@resize" ? std::vector<ty::Type>{at, ty::ty_u64}
+                        : std::vector<ty::Type>{at, et};
+  llvm::Function *F = inlined(name, at, types);
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  llvm::BasicBlock *EntryBB = b.GetInsertBlock();
+  llvm::BasicBlock *GrowBB = llvm::BasicBlock::Create(*ir::ctx, "grow", F);
+  llvm::BasicBlock *DoneBB = llvm::BasicBlock::Create(*ir::ctx, "done", F);
+
+  llvm::Value *a = F->getArg(0);
+  llvm::Value *len = b.CreateExtractValue(a, k, "len");
+  llvm::Value *cap = b.CreateExtractValue(a, k + 1, "cap");
+
+  if (name == "@resize") {
+    // the buffers are sized exactly, and the new elements start out zeroed
+    llvm::Value *n = F->getArg(1);
+    llvm::BasicBlock *ZeroBB = llvm::BasicBlock::Create(*ir::ctx, "zero", F);
+    llvm::BasicBlock *FillBB = llvm::BasicBlock::Create(*ir::ctx, "fill", F);
+    b.CreateCondBr(b.CreateICmpUGT(n, cap), GrowBB, FillBB);
+
+    b.SetInsertPoint(GrowBB);
+    llvm::Value *grown = grow(b, a, n);
+    b.CreateBr(FillBB);
+
+    b.SetInsertPoint(FillBB);
+    llvm::PHINode *P = b.CreatePHI(a->getType(), 2, "arr");
+    P->addIncoming(a, EntryBB);
+    P->addIncoming(grown, GrowBB);
+    b.CreateCondBr(b.CreateICmpUGT(n, len), ZeroBB, DoneBB);
+
+    b.SetInsertPoint(ZeroBB);
+    for (unsigned j = 0; j < k; j++)
+      b.CreateMemSet(
+          intr::element(b, at, P, len, j), b.getInt8(0),
+          b.CreateMul(b.CreateSub(n, len), b.getInt64(size(j))),
+          llvm::MaybeAlign());
+    b.CreateBr(DoneBB);
+
+    b.SetInsertPoint(DoneBB);
+    b.CreateRet(b.CreateInsertValue(P, n, k));
+  } else {
+    // @push doubles the capacity when the array is full
+    llvm::MDBuilder MDB(*ir::ctx);
+    b.CreateCondBr(b.CreateICmpEQ(len, cap), GrowBB, DoneBB,
+                   MDB.createBranchWeights(1, 2000));
+
+    b.SetInsertPoint(GrowBB);
+    llvm::Value *twice = b.CreateSelect(b.CreateICmpEQ(cap, b.getInt64(0)),
+                                        b.getInt64(8),
+                                        b.CreateShl(cap, 1, "cap"));
+    llvm::Value *grown = grow(b, a, twice);
+    b.CreateBr(DoneBB);
+
+    b.SetInsertPoint(DoneBB);
+    llvm::PHINode *P = b.CreatePHI(a->getType(), 2, "arr");
+    P->addIncoming(a, EntryBB);
+    P->addIncoming(grown, GrowBB);
+
+    llvm::Value *v = F->getArg(1);
+    if (ty::isStruct(et) && ty::compound(et).soa)
+      for (unsigned j = 0; j < k; j++)
+        b.CreateStore(b.CreateExtractValue(v, j),
+                      intr::element(b, at, P, len, j));
+    else
+      b.CreateStore(v, intr::element(b, at, P, len, 0));
+
+    b.CreateRet(b.CreateInsertValue(
+        P, b.CreateAdd(len, b.getInt64(1), "len", true, true), k));
+  }
+
+  return ir::Symbol(F, at, types);
+}
+
+// the most slots an object can have and still be moved onto the stack
+const uint64_t stack_slots = 64;
+
+// why the object allocated by @new or @new_refs at New may outlive its
+// function, or an empty string if it cannot. an object that is only read and
+// written through can only be reached by its function, unless it flows into
+// a phi, where another object may take its place.
+std::string escape(llvm::CallInst *New, bool refs) {
+  auto *n = llvm::dyn_cast<llvm::ConstantInt>(New->getArgOperand(0));
+  if (!n)
+    return "its size is not a constant";
+  if (n->getZExtValue() > stack_slots)
+    return "it has more than " + std::to_string(stack_slots) + " slots";
+
+  for (llvm::User *U : New->users()) {
+    if (llvm::isa<llvm::ReturnInst>(U))
+      return "it is returned";
+    if (llvm::isa<llvm::PHINode>(U) || llvm::isa<llvm::SelectInst>(U))
+      return "it is merged with other values where branches meet";
+    if (llvm::isa<llvm::StoreInst>(U)) // a slot of an object moved already
+      return "it is stored in another object";
+
+    auto *C = llvm::dyn_cast<llvm::CallInst>(U);
+    llvm::Function *G = C ? C->getCalledFunction() : nullptr;
+    if (!G)
+      return "it is used as a plain value";
+
+    std::string name = std::string(G->getName());
+    bool access = refs ? name == "anx.getref" || name == "anx.setref"
+                       : name == "anx.get" || name == "anx.set";
+    if (name == "anx.setref" && C->getArgOperand(2) == New)
+      return "it is stored in another object";
+    if (!access || C->getArgOperand(0) != New) {
+      if (name.substr(0, 4) == "anx.")
+        return "it is passed to '@" + name.substr(4) + "'";
+      return "it is passed to '" + name.substr(0, name.rfind(".anx")) + "'";
+    }
+
+    // references in its slots must end up in registers, where the garbage
+    // collector can see them
+    auto *i = llvm::dyn_cast<llvm::ConstantInt>(C->getArgOperand(1));
+    if (refs && !i)
+      return "its slots are indexed by a variable";
+    if (i && i->getZExtValue() >= n->getZExtValue())
+      return "a slot past its end is used";
+  }
+
+  return "";
+}
+
+std::string intr::stack(llvm::CallInst *New) {
+  bool refs = New->getCalledFunction()->getName() == "anx.new_refs";
+  std::string why = escape(New, refs);
+  if (!why.empty())
+    return why;
+
+  llvm::Function *F = New->getFunction();
+  llvm::IRBuilder<> b(&F->getEntryBlock(), F->getEntryBlock().begin());
+
+  uint64_t n = llvm::cast<llvm::ConstantInt>(New->getArgOperand(0))
+                   ->getZExtValue();
+  llvm::Type *ST = refs ? ty::toLLVM(ty::ty_ref, false) : b.getInt64Ty();
+  llvm::Type *T = llvm::ArrayType::get(ST, n);
+
+  std::vector<llvm::CallInst *> uses;
+  bool fixed = true;
+  for (llvm::User *U : New->users()) {
+    uses.push_back(llvm::cast<llvm::CallInst>(U));
+    fixed &= llvm::isa<llvm::ConstantInt>(uses.back()->getArgOperand(1));
+  }
+
+  // with constant indices every slot is a local of its own, put in SSA form
+  // right away so that the objects stored in it become plain values, which
+  // may be moved in turn. otherwise the object is an array of slots.
+  std::vector<llvm::AllocaInst *> slots;
+  llvm::AllocaInst *A = nullptr;
+  if (fixed)
+    for (uint64_t i = 0; i < n; i++)
+      slots.push_back(b.CreateAlloca(ST, nullptr, "slot"));
+  else
+    A = b.CreateAlloca(T, nullptr, "obj");
+
+  // every allocation is a fresh object
+  b.SetInsertPoint(New);
+  for (llvm::AllocaInst *S : slots)
+    b.CreateStore(llvm::Constant::getNullValue(ST), S);
+  if (A)
+    b.CreateStore(llvm::Constant::getNullValue(T), A);
+
+  for (llvm::CallInst *C : uses) {
+    b.SetInsertPoint(C);
+    b.SetCurrentDebugLocation(C->getDebugLoc());
+
+    llvm::Value *i = C->getArgOperand(1), *p;
+    if (fixed)
+      p = slots[llvm::cast<llvm::ConstantInt>(i)->getZExtValue()];
+    else
+      p = b.CreateInBoundsGEP(T, A, {b.getInt64(0), i});
+
+    if (C->arg_size() == 3)
+      b.CreateStore(C->getArgOperand(2), p);
+    else
+      C->replaceAllUsesWith(b.CreateLoad(C->getType(), p, "slot"));
+    C->eraseFromParent();
+  }
+
+  New->replaceAllUsesWith(llvm::PoisonValue::get(New->getType()));
+  New->eraseFromParent();
+
+  if (!slots.empty()) {
+    llvm::DominatorTree DT(*F);
+    llvm::PromoteMemToReg(slots, DT);
+  }
+  return "";
+}
+
+// intrinsics that are generated separately for every plain type they are
+// used with
+const std::set<std::string> overloads = {"@print", "@fmt"};
+
+// the current thread's output cursor: the address of its position, the
+// position itself and the end of the buffer
+std::tuple<llvm::Value *, llvm::Value *, llvm::Value *>
+cursor(llvm::IRBuilder<> &b) {
+  llvm::Type *P = ty::toLLVM(ty::ty_ptr, false);
+  llvm::StructType *OutT = llvm::StructType::get(*ir::ctx, {P, P});
+  llvm::Value *Out = ir::mod->getGlobalVariable("anx_out");
+  if (ir::jit)
+    Out = b.CreateCall(external("anx_io_out", ty::ty_ptr, {}), {}, "out");
+  else if (!Out)
+    Out = new llvm::GlobalVariable(
+        *ir::mod, OutT, false, llvm::GlobalValue::ExternalLinkage, nullptr,
+        "anx_out", nullptr, llvm::GlobalValue::InitialExecTLSModel);
+
+  llvm::Value *posp = b.CreateStructGEP(OutT, Out, 0);
+  llvm::Value *pos = b.CreateLoad(P, posp, "pos");
+  llvm::Value *end = b.CreateLoad(P, b.CreateStructGEP(OutT, Out, 1), "end");
+  return {posp, pos, end};
+}
+
+// format x, of plain type t, into the ANX_FMT_MAX bytes at out and return the
+// number of bytes written. integers narrower than 64 bits share the 64 bit
+// formatters.
+llvm::Value *format(llvm::IRBuilder<> &b, ty::Type t, llvm::Value *out,
+                    llvm::Value *x) {
+  std::string cname;
+  ty::Type ct = t;
+  if (ty::isBool(t)) {
+    cname = "anx_fmt_bool", ct = ty::ty_u8;
+    x = b.CreateZExt(x, b.getInt8Ty());
+  } else if (ty::isPtr(t))
+    cname = "anx_fmt_ptr";
+  else if (ty::isSingle(t))
+    cname = "anx_fmt_f32";
+  else if (ty::isDouble(t))
+    cname = "anx_fmt_f64";
+  else if (ty::width(t) == 128)
+    cname = ty::isSInt(t) ? "anx_fmt_i128" : "anx_fmt_u128";
+  else if (ty::isSInt(t)) {
+    cname = "anx_fmt_i64", ct = ty::ty_i64;
+    x = b.CreateSExt(x, b.getInt64Ty());
+  } else {
+    cname = "anx_fmt_u64", ct = ty::ty_u64;
+    x = b.CreateZExt(x, b.getInt64Ty());
+  }
+
+  return b.CreateCall(external(cname, ty::ty_u64, {ty::ty_ptr, ct}), {out, x},
+                      "n");
+}
+
+// generate @print or @fmt for the plain type t
+ir::Symbol overload(std::string name, ty::Type t) {
+  if (name == "@print" && ty::isStr(t))
+    return ir::Symbol(bystr(name, "anx_io_print", ty::ty_void, {t}),
+                      ty::ty_void, {t});
+
+  if (name == "@print") {
+    // format straight into the output buffer once it has room for any number
+    llvm::Function *Room = external("anx_io_room", ty::ty_ptr, {ty::ty_u64});
+    llvm::Function *F = inlined(name, ty::ty_void, {t});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    llvm::BasicBlock *EntryBB = b.GetInsertBlock();
+    llvm::BasicBlock *SlowBB = llvm::BasicBlock::Create(*ir::ctx, "slow", F);
+    llvm::BasicBlock *FmtBB = llvm::BasicBlock::Create(*ir::ctx, "fmt", F);
+
+    auto [posp, pos, end] = cursor(b);
+    llvm::Value *room = b.CreateSub(b.CreatePtrToInt(end, b.getInt64Ty()),
+                                    b.CreatePtrToInt(pos, b.getInt64Ty()));
+    b.CreateCondBr(b.CreateICmpUGE(room, b.getInt64(ANX_FMT_MAX)), FmtBB,
+                   SlowBB);
+
+    b.SetInsertPoint(SlowBB);
+    llvm::Value *fresh = b.CreateCall(Room, {b.getInt64(ANX_FMT_MAX)});
+    b.CreateBr(FmtBB);
+
+    b.SetInsertPoint(FmtBB);
+    llvm::PHINode *p = b.CreatePHI(pos->getType(), 2, "p");
+    p->addIncoming(pos, EntryBB);
+    p->addIncoming(fresh, SlowBB);
+
+    llvm::Value *n = format(b, t, p, F->getArg(0));
+    b.CreateStore(b.CreateGEP(b.getInt8Ty(), p, n), posp);
+    b.CreateRetVoid();
+
+    return ir::Symbol(F, ty::ty_void, {t});
+  }
+
+  llvm::Function *F = inlined(name, ty::ty_str, {t});
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  if (ty::isStr(t)) {
+    b.CreateRet(F->getArg(0));
+    return ir::Symbol(F, ty::ty_str, {t});
+  }
+
+  llvm::Function *From = external("anx_str_from", ty::ty_void,
+                                  {ty::ty_ptr, ty::ty_ptr, ty::ty_u64});
+  llvm::Type *strT = ty::toLLVM(ty::ty_str, false);
+  llvm::Value *buf = b.CreateAlloca(
+      llvm::ArrayType::get(b.getInt8Ty(), ANX_FMT_MAX), nullptr, "buf");
+  llvm::Value *out = b.CreateAlloca(strT);
+
+  llvm::Value *n = format(b, t, buf, F->getArg(0));
+  b.CreateCall(From, {out, buf, n});
+  b.CreateRet(b.CreateLoad(strT, out));
+
+  return ir::Symbol(F, ty::ty_str, {t});
+}
+
+// intrinsics that lower to a single LLVM intrinsic, overloaded on the type of
+// their operands. each maps to the intrinsic used for signed integers,
+// unsigned integers and floats, or not_intrinsic where it is not defined.
+struct Builtin {
+  llvm::Intrinsic::ID sint, uint, fp;
+  unsigned args;
+};
+
+namespace li = llvm::Intrinsic;
+
+const std::map<std::string, Builtin> builtins = {
+    // bit manipulation
+    {"@popcount", {li::ctpop, li::ctpop, li::not_intrinsic, 1}},
+    {"@clz", {li::ctlz, li::ctlz, li::not_intrinsic, 1}},
+    {"@ctz", {li::cttz, li::cttz, li::not_intrinsic, 1}},
+    {"@bswap", {li::bswap, li::bswap, li::not_intrinsic, 1}},
+    {"@bitreverse", {li::bitreverse, li::bitreverse, li::not_intrinsic, 1}},
+    {"@rotl", {li::fshl, li::fshl, li::not_intrinsic, 2}},
+    {"@rotr", {li::fshr, li::fshr, li::not_intrinsic, 2}},
+
+    // saturating arithmetic
+    {"@sat_add", {li::sadd_sat, li::uadd_sat, li::not_intrinsic, 2}},
+    {"@sat_sub", {li::ssub_sat, li::usub_sat, li::not_intrinsic, 2}},
+
+    // math
+    {"@min", {li::smin, li::umin, li::minnum, 2}},
+    {"@max", {li::smax, li::umax, li::maxnum, 2}},
+    {"@abs", {li::abs, li::not_intrinsic, li::fabs, 1}},
+    {"@sqrt", {li::not_intrinsic, li::not_intrinsic, li::sqrt, 1}},
+    {"@fma", {li::not_intrinsic, li::not_intrinsic, li::fma, 3}},
+    {"@floor", {li::not_intrinsic, li::not_intrinsic, li::floor, 1}},
+    {"@ceil", {li::not_intrinsic, li::not_intrinsic, li::ceil, 1}},
+    {"@trunc", {li::not_intrinsic, li::not_intrinsic, li::trunc, 1}},
+    {"@round", {li::not_intrinsic, li::not_intrinsic, li::round, 1}},
+    {"@copysign", {li::not_intrinsic, li::not_intrinsic, li::copysign, 2}},
+};
+
+// generate the builtin `name` for operands of the plain type t
+ir::Symbol builtin(std::string name, ty::Type t, anx::Pos pos) {
+  const Builtin &bi = builtins.at(name);
+  bool fp = ty::isSingle(t) || ty::isDouble(t);
+  bool integer = ty::isSInt(t) || ty::isUInt(t);
+
+  li::ID id = fp              ? bi.fp
+               : ty::isSInt(t) ? bi.sint
+               : integer       ? bi.uint
+                               : li::not_intrinsic;
+
+  // byte swaps need whole pairs of bytes
+  if (id == li::bswap && ty::width(t) % 16)
+    id = li::not_intrinsic;
+
+  if (id == li::not_intrinsic)
+    anx::perr("'" + name + "' is not defined for '" + ty::toString(t) + "'",
+              pos, name.size());
+
+  std::vector<ty::Type> types(bi.args, t);
+  llvm::Function *F = inlined(name, t, types);
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  std::vector<llvm::Value *> args;
+  for (auto &A : F->args())
+    args.push_back(&A);
+
+  // rotates are funnel shifts of a value with itself, and the counts and
+  // integer abs are defined for every input (zero and the minimum value)
+  if (id == li::fshl || id == li::fshr)
+    args.insert(args.begin() + 1, args[0]);
+  else if (id == li::ctlz || id == li::cttz || id == li::abs)
+    args.push_back(b.getFalse());
+
+  llvm::Type *T = ty::toLLVM(t, false);
+  b.CreateRet(b.CreateCall(li::getDeclaration(ir::mod.get(), id, {T}), args));
+
+  return ir::Symbol(F, t, types);
+}
+
+// shifts that are poison, rather than masked, when the amount is not less
+// than the width of the type
+const std::set<std::string> unchecked = {"@shl_unchecked", "@shr_unchecked"};
+
+// generate an unchecked shift for operands of the plain type t
+ir::Symbol unchecked_shift(std::string name, ty::Type t, anx::Pos pos) {
+  if (!ty::isSInt(t) && !ty::isUInt(t))
+    anx::perr("'" + name + "' is not defined for '" + ty::toString(t) + "'",
+              pos, name.size());
+
+  llvm::Function *F = inlined(name, t, {t, t});
+  llvm::IRBuilder<> b(&F->getEntryBlock());
+
+  b.CreateRet(ir::shift(b, name == "@shl_unchecked", ty::isSInt(t),
+                        F->getArg(0), F->getArg(1), false));
+
+  return ir::Symbol(F, t, {t, t});
+}
+
+ir::Symbol intr::handle(std::string name, anx::Pos pos,
+                        std::vector<ty::Type> types) {
+  std::map<std::string, ty::Kind>::const_iterator g = generics.find(name);
+  bool generic = g != generics.end();
+  if (generic && (types.empty() || types[0] < ty::ty_compound ||
+                  ty::compound(types[0]).kind != g->second))
+    anx::perr("expected a " +
+                  std::string(g->second == ty::kind_map    ? "map"
+                              : g->second == ty::kind_task ? "task"
+                              : g->second == ty::kind_arr  ? "array"
+                                                           : "future") +
+                  " as the first argument of '" + name + "'",
+              pos, name.size());
+
+  if (name == "@data" && buffers(types[0]).size() > 1)
+    anx::perr("the fields of @soa arrays are not stored together", pos,
+              name.size());
+
+  bool overloaded = overloads.count(name),
+       bi = builtins.count(name) || unchecked.count(name);
+  if (overloaded &&
+      (types.empty() || ty::isVoid(types[0]) || ty::isRef(types[0]) ||
+       types[0] >= ty::ty_compound))
+    anx::perr("'" + name + "' expects a number, bool, pointer or str", pos,
+              name.size());
+  if (bi && (types.empty() || types[0] >= ty::ty_compound))
+    anx::perr("'" + name + "' expects a number", pos, name.size());
+
+  std::string key = generic || overloaded || bi
+                        ? name + ":" + ty::toString(types[0])
+                        : name;
 
-ir::Symbol intr::handle(std::string name, anx::Pos pos) {
   std::map<std::string, ir::Symbol>::iterator sym;
-  if ((sym = intrinsics.find(name)) != intrinsics.end())
+  if ((sym = intrinsics.find(key)) != intrinsics.end())
     return sym->second;
 
-  if (name == "@out") {
-    llvm::Function *F = ir::mod->getFunction("putchar");
-    if (!F) {
-      llvm::Type *ret = llvm::Type::getInt32Ty(*ir::ctx);
-      std::vector<llvm::Type *> Params = {llvm::Type::getInt32Ty(*ir::ctx)};
+  ir::Symbol s;
 
-      llvm::FunctionType *FT = llvm::FunctionType::get(ret, Params, false);
-      F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "putchar",
-                                 ir::mod.get());
-    }
+  if (overloaded)
+    s = overload(name, types[0]);
+  else if (bi && unchecked.count(name))
+    s = unchecked_shift(name, types[0], pos);
+  else if (bi)
+    s = builtin(name, types[0], pos);
+  else if (generic) {
+    if (g->second == ty::kind_map)
+      s = map(name, types[0]);
+    else if (g->second == ty::kind_task)
+      s = task(name, types[0]);
+    else if (g->second == ty::kind_arr)
+      s = array(name, types[0]);
+    else
+      s = block_on(name, types[0]);
+  } else if (name == "@out") {
+    // append to the thread's output buffer, calling into the runtime only
+    // when it is full
+    llvm::Function *Putc = external("anx_io_putc", ty::ty_i32, {ty::ty_i32});
+    llvm::Function *F = inlined(name, ty::ty_i32, {ty::ty_i32});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    llvm::BasicBlock *FastBB = llvm::BasicBlock::Create(*ir::ctx, "fast", F);
+    llvm::BasicBlock *SlowBB = llvm::BasicBlock::Create(*ir::ctx, "slow", F);
+
+    llvm::Value *c = F->getArg(0);
+    auto [posp, pos, end] = cursor(b);
+    b.CreateCondBr(b.CreateICmpULT(pos, end), FastBB, SlowBB);
+
+    b.SetInsertPoint(FastBB);
+    b.CreateStore(b.CreateTrunc(c, b.getInt8Ty()), pos);
+    b.CreateStore(b.CreateGEP(b.getInt8Ty(), pos, b.getInt64(1)), posp);
+    b.CreateRet(c);
+
+    b.SetInsertPoint(SlowBB);
+    b.CreateRet(b.CreateCall(Putc, {c}));
+
+    s = ir::Symbol(F, ty::ty_i32, {ty::ty_i32});
+  } else if (name == "@write") {
+    llvm::Function *F =
+        external("anx_io_write", ty::ty_void, {ty::ty_ptr, ty::ty_u64});
+    s = ir::Symbol(F, ty::ty_void, {ty::ty_ptr, ty::ty_u64});
+  } else if (name == "@flush") {
+    llvm::Function *F = external("anx_io_flush", ty::ty_void, {});
+    s = ir::Symbol(F, ty::ty_void, {});
+  } else if (name == "@read") {
+    llvm::Function *F =
+        external("anx_io_read", ty::ty_i64, {ty::ty_ptr, ty::ty_u64});
+    s = ir::Symbol(F, ty::ty_i64, {ty::ty_ptr, ty::ty_u64});
+  } else if (name == "@readline") {
+    s = ir::Symbol(bystr(name, "anx_io_readline", ty::ty_str, {}), ty::ty_str,
+                   {});
+  } else if (name == "@parse_i64") {
+    s = ir::Symbol(bystr(name, "anx_parse_i64", ty::ty_i64, {ty::ty_str}),
+                   ty::ty_i64, {ty::ty_str});
+  } else if (name == "@parse_f64") {
+    s = ir::Symbol(bystr(name, "anx_parse_f64", ty::ty_f64, {ty::ty_str}),
+                   ty::ty_f64, {ty::ty_str});
+  } else if (name == "@alloc") {
+    llvm::Function *F = external("anx_alloc", ty::ty_ptr, {ty::ty_u64});
+    F->addRetAttr(llvm::Attribute::NoAlias);
+    s = ir::Symbol(F, ty::ty_ptr, {ty::ty_u64});
+  } else if (name == "@realloc") {
+    llvm::Function *F =
+        external("anx_realloc", ty::ty_ptr, {ty::ty_ptr, ty::ty_u64});
+    F->addRetAttr(llvm::Attribute::NoAlias);
+    s = ir::Symbol(F, ty::ty_ptr, {ty::ty_ptr, ty::ty_u64});
+  } else if (name == "@free") {
+    llvm::Function *F = external("anx_free", ty::ty_void, {ty::ty_ptr});
+    s = ir::Symbol(F, ty::ty_void, {ty::ty_ptr});
+  } else if (name == "@alloc_stats") {
+    llvm::Function *F = external("anx_alloc_stats_print", ty::ty_void, {});
+    s = ir::Symbol(F, ty::ty_void, {});
+  } else if (name == "@new" || name == "@new_refs") {
+    llvm::Function *N = external("anx_gc_new", ty::ty_ref,
+                                 {ty::ty_u64, ty::ty_u8}, true);
+    llvm::Function *F = inlined(name, ty::ty_ref, {ty::ty_u64});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    llvm::Value *refs = b.getInt8(name == "@new_refs");
+    b.CreateRet(b.CreateCall(N, {F->getArg(0), refs}, "obj"));
+
+    s = ir::Symbol(F, ty::ty_ref, {ty::ty_u64});
+  } else if (name == "@get") {
+    llvm::Function *F = inlined(name, ty::ty_i64, {ty::ty_ref, ty::ty_u64});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    kind(b, F->getArg(0), false);
+    llvm::Value *p = slot(b, F->getArg(0), F->getArg(1));
+    b.CreateRet(b.CreateLoad(b.getInt64Ty(), p, "val"));
+
+    s = ir::Symbol(F, ty::ty_i64, {ty::ty_ref, ty::ty_u64});
+  } else if (name == "@set") {
+    llvm::Function *F =
+        inlined(name, ty::ty_void, {ty::ty_ref, ty::ty_u64, ty::ty_i64});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    kind(b, F->getArg(0), false);
+    b.CreateStore(F->getArg(2), slot(b, F->getArg(0), F->getArg(1)));
+    b.CreateRetVoid();
+
+    s = ir::Symbol(F, ty::ty_void, {ty::ty_ref, ty::ty_u64, ty::ty_i64});
+  } else if (name == "@getref") {
+    llvm::Function *F = inlined(name, ty::ty_ref, {ty::ty_ref, ty::ty_u64});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    kind(b, F->getArg(0), true);
+    llvm::Value *p = slot(b, F->getArg(0), F->getArg(1));
+    b.CreateRet(b.CreateLoad(ty::toLLVM(ty::ty_ref, false), p, "ref"));
+
+    s = ir::Symbol(F, ty::ty_ref, {ty::ty_ref, ty::ty_u64});
+  } else if (name == "@setref") {
+    // reference stores go through the write barrier, whose slow path is only
+    // taken when the target object lives in the old generation
+    llvm::Function *W = external("anx_gc_barrier", ty::ty_void,
+                                 {ty::ty_ref, ty::ty_ref, ty::ty_ref});
+    llvm::Function *F =
+        inlined(name, ty::ty_void, {ty::ty_ref, ty::ty_u64, ty::ty_ref});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    llvm::Value *obj = F->getArg(0), *val = F->getArg(2);
+    kind(b, obj, true);
+    llvm::Value *p = slot(b, obj, F->getArg(1));
+    llvm::Value *prev = b.CreateLoad(ty::toLLVM(ty::ty_ref, false), p, "prev");
+    llvm::Value *flags = b.CreateLoad(
+        b.getInt16Ty(), b.CreateConstGEP1_64(b.getInt8Ty(), obj, ANX_GC_FLAGS),
+        "flags");
+    llvm::Value *old = b.CreateICmpNE(
+        b.CreateAnd(flags, b.getInt16(ANX_GC_OLD)), b.getInt16(0), "old");
+
+    llvm::BasicBlock *SlowBB = llvm::BasicBlock::Create(*ir::ctx, "slow", F);
+    llvm::BasicBlock *StoreBB = llvm::BasicBlock::Create(*ir::ctx, "store", F);
+    b.CreateCondBr(old, SlowBB, StoreBB);
+
+    b.SetInsertPoint(SlowBB);
+    b.CreateCall(W, {obj, prev, val});
+    b.CreateBr(StoreBB);
 
-    ir::Symbol s = ir::Symbol(F, ty::ty_i32, {ty::ty_i32});
+    b.SetInsertPoint(StoreBB);
+    b.CreateStore(val, p);
+    b.CreateRetVoid();
 
-    intrinsics.insert(std::make_pair(name, s));
+    s = ir::Symbol(F, ty::ty_void, {ty::ty_ref, ty::ty_u64, ty::ty_ref});
+  } else if (name == "@gc") {
+    llvm::Function *F = external("anx_gc_collect", ty::ty_void, {}, true);
+    s = ir::Symbol(F, ty::ty_void, {});
+  } else if (name == "@len") {
+    llvm::Function *F = inlined(name, ty::ty_u64, {ty::ty_str});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
 
-    return s;
+    auto [in, n] = inline_len(b, F->getArg(0));
+    b.CreateRet(b.CreateSelect(in, n, b.CreateExtractValue(F->getArg(0), 1)));
+
+    s = ir::Symbol(F, ty::ty_u64, {ty::ty_str});
+  } else if (name == "@at") {
+    llvm::Function *F = inlined(name, ty::ty_u8, {ty::ty_str, ty::ty_u64});
+    llvm::IRBuilder<> b(&F->getEntryBlock());
+
+    llvm::Value *str = F->getArg(0);
+    llvm::Value *in = inline_len(b, str).first;
+    llvm::Value *data =
+        b.CreateSelect(in, spill(b, str), b.CreateExtractValue(str, 0));
+    llvm::Value *p = b.CreateGEP(b.getInt8Ty(), data, F->getArg(1));
+    b.CreateRet(b.CreateLoad(b.getInt8Ty(), p, "char"));
+
+    s = ir::Symbol(F, ty::ty_u8, {ty::ty_str, ty::ty_u64});
+  } else if (name == "@slice") {
+    std::vector<ty::Type> types = {ty::ty_str, ty::ty_u64, ty::ty_u64};
+    s = ir::Symbol(bystr(name, "anx_str_slice", ty::ty_str, types), ty::ty_str,
+                   types);
+  } else if (name == "@concat") {
+    std::vector<ty::Type> types = {ty::ty_str, ty::ty_str};
+    s = ir::Symbol(bystr(name, "anx_str_concat", ty::ty_str, types),
+                   ty::ty_str, types);
+  } else if (name == "@eq") {
+    std::vector<ty::Type> types = {ty::ty_str, ty::ty_str};
+    s = ir::Symbol(bystr(name, "anx_str_eq", ty::ty_bool, types), ty::ty_bool,
+                   types);
+  } else if (name == "@cmp") {
+    std::vector<ty::Type> types = {ty::ty_str, ty::ty_str};
+    s = ir::Symbol(bystr(name, "anx_str_cmp", ty::ty_i32, types), ty::ty_i32,
+                   types);
+  } else if (name == "@find") {
+    std::vector<ty::Type> types = {ty::ty_str, ty::ty_str};
+    s = ir::Symbol(bystr(name, "anx_str_find", ty::ty_i64, types), ty::ty_i64,
+                   types);
+  } else if (name == "@str_free") {
+    s = ir::Symbol(bystr(name, "anx_str_free", ty::ty_void, {ty::ty_str}),
+                   ty::ty_void, {ty::ty_str});
+  } else if (name == "@sleep") {
+    llvm::IRBuilder<> b(*ir::ctx);
+    intr::Coro co;
+    llvm::Function *F = async(b, co, name, ty::ty_void, {ty::ty_u64});
+
+    llvm::Value *sv = save(b, co);
+    b.CreateCall(external("anx_async_sleep", ty::ty_void,
+                          {ty::ty_u64, ty::ty_ptr}),
+                 {F->getArg(0), co.hdl});
+    suspend(b, co, sv);
+    intr::complete(b, co, nullptr);
+
+    s = ir::Symbol(F, ty::future(ty::ty_void), {ty::ty_u64});
+  } else if (name == "@async_read" || name == "@async_write") {
+    std::vector<ty::Type> types = {ty::ty_i32, ty::ty_ptr, ty::ty_u64};
+    s = ir::Symbol(async_io(name, name == "@async_write"),
+                   ty::future(ty::ty_i64), types);
+  } else if (name == "@sched_stats") {
+    llvm::Function *F = external("anx_sched_stats_print", ty::ty_void, {});
+    s = ir::Symbol(F, ty::ty_void, {});
+  } else if (name == "@gc_stats") {
+    llvm::Function *F = external("anx_gc_stats_print", ty::ty_void, {});
+    s = ir::Symbol(F, ty::ty_void, {});
+  } else
+    anx::perr("unrecognized intrinsic function", pos);
+
+  intrinsics.insert(std::make_pair(key, s));
+
+  return s;
+}
+
+const std::map<std::string, std::vector<ty::Type>> intr::hints = {
+    {"@likely", {ty::ty_bool}},
+    {"@unlikely", {ty::ty_bool}},
+    {"@assume", {ty::ty_bool}},
+    {"@unreachable", {}},
+    {"@prefetch", {ty::ty_ptr, ty::ty_u32, ty::ty_u32}},
+    {"@store_nt", {ty::ty_ptr, ty::ty_void}},
+};
+
+ir::Symbol intr::hint(llvm::IRBuilder<> &b, std::string name, anx::Pos pos,
+                      std::vector<ir::Symbol> args) {
+  llvm::Module *M = ir::mod.get();
+  llvm::Value *v = nullptr;
+
+  if (name == "@likely" || name == "@unlikely") {
+    // the expectation stays attached to the value, so that the branch it
+    // ends up controlling can turn it into branch weights
+    llvm::Function *F = li::getDeclaration(M, li::expect, {b.getInt1Ty()});
+    v = b.CreateCall(F, {args[0].val(), b.getInt1(name == "@likely")},
+                     "expect");
+    return ir::Symbol(v, ty::ty_bool);
+  } else if (name == "@assume") {
+    v = b.CreateCall(li::getDeclaration(M, li::assume), {args[0].val()});
+  } else if (name == "@unreachable") {
+    v = b.CreateUnreachable();
+  } else if (name == "@prefetch") {
+    // prefetch(p, rw, locality): rw is 0 to read and 1 to write, locality
+    // goes from 0 (no reuse, skip the caches) to 3 (keep in every level)
+    auto *rw = llvm::dyn_cast<llvm::ConstantInt>(args[1].val());
+    auto *loc = llvm::dyn_cast<llvm::ConstantInt>(args[2].val());
+    if (!rw || rw->getZExtValue() > 1)
+      anx::perr("'@prefetch' expects a constant 0 (read) or 1 (write) as its "
+                "second argument",
+                pos, name.size());
+    if (!loc || loc->getZExtValue() > 3)
+      anx::perr("'@prefetch' expects a constant locality from 0 to 3 as its "
+                "third argument",
+                pos, name.size());
+
+    llvm::Value *p = args[0].val();
+    v = b.CreateCall(li::getDeclaration(M, li::prefetch, {p->getType()}),
+                     {p, rw, loc, b.getInt32(1)});
+  } else if (name == "@store_nt") {
+    // a store that bypasses the caches, for data that is not read back soon
+    ty::Type t = args[1].typ();
+    if (ty::isVoid(t) || ty::isRef(t) || ty::isStr(t) || t >= ty::ty_compound)
+      anx::perr("'@store_nt' expects a number, bool or ptr to store", pos,
+                name.size());
+
+    llvm::StoreInst *S = b.CreateStore(args[1].val(), args[0].val());
+    v = S;
+    S->setMetadata(llvm::LLVMContext::MD_nontemporal,
+                   llvm::MDNode::get(*ir::ctx, llvm::ConstantAsMetadata::get(
+                                                   b.getInt32(1))));
   }
 
-  anx::perr("unrecognized intrinsic function", pos);
+  return ir::Symbol(v, ty::ty_void);
+}
+
+// branch on cond, turning an @likely or @unlikely directly around it into
+// branch weights
+llvm::BranchInst *intr::branch(llvm::IRBuilder<> &b, llvm::Value *cond,
+                               llvm::BasicBlock *T, llvm::BasicBlock *F) {
+  auto *E = llvm::dyn_cast<llvm::IntrinsicInst>(cond);
+  if (!E || E->getIntrinsicID() != li::expect)
+    return b.CreateCondBr(cond, T, F);
+
+  bool likely = llvm::cast<llvm::ConstantInt>(E->getArgOperand(1))->isOne();
+  cond = E->getArgOperand(0);
+  if (E->use_empty())
+    E->eraseFromParent();
+
+  llvm::MDBuilder MDB(*ir::ctx);
+  return b.CreateCondBr(cond, T, F,
+                        likely ? MDB.createBranchWeights(2000, 1)
+                               : MDB.createBranchWeights(1, 2000));
 }
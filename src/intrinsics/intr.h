@@ -1,11 +1,59 @@
 #pragma once
 
 #include <map>
+#include <set>
 
 #include "../anx.h"
 #include "../codegen/ir.h"
 
 namespace intr {
-extern std::map<std::string, ir::Symbol> intrinsics;
-ir::Symbol handle(std::string name, anx::Pos pos);
+// the state of a coroutine whose body is being generated. async functions and
+// asynchronous intrinsics are lowered to LLVM switch-resumed coroutines, whose
+// promise holds the coroutine waiting on them followed by their result.
+struct Coro {
+  llvm::Value *hdl = nullptr;
+  llvm::Value *promise;
+  llvm::StructType *promiseT;
+  llvm::BasicBlock *final, *cleanup, *suspend;
+};
+
+extern thread_local std::map<std::string, ir::Symbol> intrinsics;
+ir::Symbol handle(std::string name, anx::Pos pos,
+                  std::vector<ty::Type> types = {});
+
+// hints are lowered in place at their call site rather than called, keyed by
+// name to the types of their arguments (ty_void accepts any plain type)
+extern const std::map<std::string, std::vector<ty::Type>> hints;
+ir::Symbol hint(llvm::IRBuilder<> &b, std::string name, anx::Pos pos,
+                std::vector<ir::Symbol> args);
+llvm::BranchInst *branch(llvm::IRBuilder<> &b, llvm::Value *cond,
+                         llvm::BasicBlock *T, llvm::BasicBlock *F);
+llvm::Value *spawn(ir::Symbol fn, std::vector<llvm::Value *> args);
+
+// the string a after out = a + b: a view of out's bytes if out took over the
+// buffer of a to append to it in place, otherwise a itself
+llvm::Value *appended(llvm::IRBuilder<> &b, llvm::Value *a, llvm::Value *out);
+
+// move the garbage collected object allocated at New onto the stack of its
+// function if it cannot outlive it, or return why it can
+std::string stack(llvm::CallInst *New);
+
+// the address of element i of the array a of type at, in its buffer k. @soa
+// arrays keep field k of their elements in buffer k, others have only one.
+llvm::Value *element(llvm::IRBuilder<> &b, ty::Type at, llvm::Value *a,
+                     llvm::Value *i, unsigned k = 0);
+llvm::Value *length(llvm::IRBuilder<> &b, ty::Type at, llvm::Value *a);
+
+// --instrument counts calls to and time in functions, and the trips of loops,
+// each a site registered by name with the profiler in the runtime
+uint32_t site(std::string name);
+void enter(llvm::IRBuilder<> &b, uint32_t site);
+void leave(llvm::IRBuilder<> &b);
+void trips(llvm::IRBuilder<> &b, uint32_t site, llvm::Value *n);
+void profile();
+
+Coro coroutine(llvm::IRBuilder<> &b, llvm::Function *F, ty::Type type);
+llvm::Value *await(llvm::IRBuilder<> &b, Coro &co, llvm::Value *h,
+                   ty::Type type);
+void complete(llvm::IRBuilder<> &b, Coro &co, llvm::Value *v);
 } // namespace intr
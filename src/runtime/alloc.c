@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Alloc - This module implements the allocator behind @alloc/@realloc/@free.
+//
+// Small requests are rounded up to one of NCLASS size classes and served from
+// a per-thread cache of free blocks without taking any locks. Caches refill
+// from (and spill back to) a central per-class pool, which in turn carves
+// blocks out of large mmap'd chunks. Requests above MAX_SMALL are mapped
+// directly, using transparent huge pages once they reach HUGE_PAGE bytes.
+//
+// Every block starts with a 16 byte header recording its class and size, so
+// frees and reallocs do not need any global lookup.
+//===---------------------------------------------------------------------===//
+
+#define HDR 16
+#define NCLASS 39
+#define MAX_SMALL 32768
+#define LARGE 0xffffffffu
+#define CHUNK_SIZE (4u << 20)
+#define HUGE_PAGE (2u << 20)
+#define PAGE 4096u
+
+typedef struct {
+  uint32_t cls;
+  uint32_t pad;
+  uint64_t size; // usable size for small blocks, mapping length for large ones
+} hdr_t;
+
+typedef struct block {
+  struct block *next;
+} block_t;
+
+typedef struct tcache {
+  block_t *head[NCLASS];
+  uint32_t count[NCLASS];
+  uint64_t allocs, frees, reallocs, hits, misses, large, huge;
+  uint64_t bytes_alloc, bytes_freed;
+  struct tcache *next, *prev;
+} tcache_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  block_t *head;
+  uint32_t count;
+} central_t;
+
+static central_t central[NCLASS];
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *chunk_cur, *chunk_end;
+
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static tcache_t *live_caches, *spare_caches;
+static anx_alloc_stats_t retired; // stats of threads that have exited
+
+static atomic_uint_fast64_t mapped;
+static void (*exit_hook)(const anx_alloc_stats_t *);
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static __thread tcache_t *tc;
+
+// map a block size (header included) to its size class
+static inline uint32_t class_of(uint64_t n) {
+  if (n <= 128)
+    return n <= 32 ? 0 : (uint32_t)((n + 15) / 16 - 2);
+
+  uint32_t p = 63 - __builtin_clzll(n - 1);
+  return 7 + (p - 7) * 4 + (uint32_t)((n - 1 - (1ull << p)) >> (p - 2));
+}
+
+static inline uint64_t class_size(uint32_t c) {
+  if (c < 7)
+    return (c + 2) * 16;
+
+  uint32_t p = 7 + (c - 7) / 4, j = (c - 7) % 4;
+  return (1ull << p) + (j + 1) * (1ull << (p - 2));
+}
+
+// number of blocks moved between a thread cache and the central pool at once
+static inline uint32_t batch(uint32_t c) {
+  uint64_t n = (64u << 10) / class_size(c);
+  return n < 4 ? 4 : n > 64 ? 64 : (uint32_t)n;
+}
+
+static void *map(size_t len) {
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+
+  atomic_fetch_add_explicit(&mapped, len, memory_order_relaxed);
+  return p;
+}
+
+// carve raw memory out of the current chunk, mapping a new one when exhausted
+static void *carve(size_t len) {
+  pthread_mutex_lock(&chunk_lock);
+
+  if (chunk_end - chunk_cur < (ptrdiff_t)len) {
+    char *c = map(CHUNK_SIZE);
+    if (!c) {
+      pthread_mutex_unlock(&chunk_lock);
+      return NULL;
+    }
+    chunk_cur = c, chunk_end = c + CHUNK_SIZE;
+  }
+
+  void *p = chunk_cur;
+  chunk_cur += len;
+
+  pthread_mutex_unlock(&chunk_lock);
+  return p;
+}
+
+static void fold(anx_alloc_stats_t *s, const tcache_t *t) {
+  s->allocs += t->allocs;
+  s->frees += t->frees;
+  s->reallocs += t->reallocs;
+  s->cache_hits += t->hits;
+  s->cache_misses += t->misses;
+  s->large_allocs += t->large;
+  s->huge_allocs += t->huge;
+  s->bytes_live += t->bytes_alloc - t->bytes_freed;
+}
+
+static void release(tcache_t *t, uint32_t c, uint32_t n) {
+  block_t *first = t->head[c], *last = first;
+  for (uint32_t i = 1; i < n; i++)
+    last = last->next;
+
+  t->head[c] = last->next;
+  t->count[c] -= n;
+
+  central_t *z = &central[c];
+  pthread_mutex_lock(&z->lock);
+  last->next = z->head;
+  z->head = first;
+  z->count += n;
+  pthread_mutex_unlock(&z->lock);
+}
+
+// return every cached block to the central pool when a thread exits
+static void teardown(void *arg) {
+  tcache_t *t = arg;
+
+  for (uint32_t c = 0; c < NCLASS; c++)
+    if (t->count[c])
+      release(t, c, t->count[c]);
+
+  pthread_mutex_lock(&reg_lock);
+  fold(&retired, t);
+  if (t->prev)
+    t->prev->next = t->next;
+  else
+    live_caches = t->next;
+  if (t->next)
+    t->next->prev = t->prev;
+  t->next = spare_caches;
+  spare_caches = t;
+  pthread_mutex_unlock(&reg_lock);
+
+  tc = NULL;
+}
+
+static void report(void) {
+  anx_alloc_stats_t s;
+  anx_alloc_stats(&s);
+
+  if (exit_hook)
+    exit_hook(&s);
+
+  const char *env = getenv("ANX_ALLOC_STATS");
+  if (env && *env && *env != '0')
+    anx_alloc_stats_print();
+}
+
+static void setup(void) {
+  for (uint32_t c = 0; c < NCLASS; c++)
+    pthread_mutex_init(&central[c].lock, NULL);
+
+  pthread_key_create(&key, teardown);
+  atexit(report);
+}
+
+static tcache_t *tcache(void) {
+  if (tc)
+    return tc;
+
+  pthread_once(&once, setup);
+
+  pthread_mutex_lock(&reg_lock);
+  tcache_t *t = spare_caches;
+  if (t)
+    spare_caches = t->next;
+  pthread_mutex_unlock(&reg_lock);
+
+  if (!t && !(t = carve(sizeof(tcache_t))))
+    abort();
+
+  memset(t, 0, sizeof(tcache_t));
+
+  pthread_mutex_lock(&reg_lock);
+  t->next = live_caches;
+  if (live_caches)
+    live_caches->prev = t;
+  live_caches = t;
+  pthread_mutex_unlock(&reg_lock);
+
+  pthread_setspecific(key, t);
+  return tc = t;
+}
+
+// pull a batch of blocks into the thread cache and return one of them
+static block_t *refill(tcache_t *t, uint32_t c) {
+  uint32_t want = batch(c), got = 0;
+  block_t *head = NULL;
+
+  central_t *z = &central[c];
+  pthread_mutex_lock(&z->lock);
+  while (got < want && z->head) {
+    block_t *b = z->head;
+    z->head = b->next;
+    b->next = head;
+    head = b;
+    got++;
+  }
+  z->count -= got;
+  pthread_mutex_unlock(&z->lock);
+
+  if (!got) {
+    uint64_t sz = class_size(c);
+    char *run = carve(sz * want);
+    if (!run)
+      return NULL;
+
+    for (uint32_t i = 0; i < want; i++) {
+      block_t *b = (block_t *)(run + i * sz);
+      b->next = head;
+      head = b;
+    }
+    got = want;
+  }
+
+  t->head[c] = head->next;
+  t->count[c] += got - 1;
+  return head;
+}
+
+static void *large_alloc(tcache_t *t, uint64_t n) {
+  size_t len = (n + PAGE - 1) & ~(size_t)(PAGE - 1);
+  char *base;
+
+  if (len >= HUGE_PAGE) {
+    // over-map so the region can be trimmed to a huge page boundary
+    len = (len + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+    char *raw = map(len + HUGE_PAGE);
+    if (!raw)
+      return NULL;
+
+    base = (char *)(((uintptr_t)raw + HUGE_PAGE - 1) &
+                    ~(uintptr_t)(HUGE_PAGE - 1));
+    if (base != raw)
+      munmap(raw, base - raw);
+    if (raw + HUGE_PAGE != base)
+      munmap(base + len, raw + HUGE_PAGE - base);
+    atomic_fetch_sub_explicit(&mapped, HUGE_PAGE, memory_order_relaxed);
+
+#ifdef MADV_HUGEPAGE
+    madvise(base, len, MADV_HUGEPAGE);
+#endif
+    t->huge++;
+  } else if (!(base = map(len)))
+    return NULL;
+
+  hdr_t *h = (hdr_t *)base;
+  h->cls = LARGE;
+  h->size = len;
+
+  t->large++;
+  t->bytes_alloc += len;
+  return h + 1;
+}
+
+static void large_free(tcache_t *t, hdr_t *h) {
+  t->bytes_freed += h->size;
+  atomic_fetch_sub_explicit(&mapped, h->size, memory_order_relaxed);
+  munmap(h, h->size);
+}
+
+void *anx_alloc(uint64_t size) {
+  tcache_t *t = tcache();
+  t->allocs++;
+
+  if (size > (1ull << 48))
+    return NULL;
+
+  uint64_t n = size + HDR;
+  if (n > MAX_SMALL)
+    return large_alloc(t, n);
+
+  uint32_t c = class_of(n);
+  block_t *b = t->head[c];
+
+  if (b) {
+    t->head[c] = b->next;
+    t->count[c]--;
+    t->hits++;
+  } else {
+    t->misses++;
+    if (!(b = refill(t, c)))
+      return NULL;
+  }
+
+  hdr_t *h = (hdr_t *)b;
+  h->cls = c;
+  h->size = class_size(c) - HDR;
+
+  t->bytes_alloc += h->size;
+  return h + 1;
+}
+
+void anx_free(void *ptr) {
+  if (!ptr)
+    return;
+
+  tcache_t *t = tcache();
+  hdr_t *h = (hdr_t *)ptr - 1;
+  t->frees++;
+
+  if (h->cls == LARGE) {
+    large_free(t, h);
+    return;
+  }
+
+  uint32_t c = h->cls;
+  t->bytes_freed += h->size;
+
+  block_t *b = (block_t *)h;
+  b->next = t->head[c];
+  t->head[c] = b;
+
+  if (++t->count[c] > 2 * batch(c))
+    release(t, c, batch(c));
+}
+
+void *anx_realloc(void *ptr, uint64_t size) {
+  if (!ptr)
+    return anx_alloc(size);
+
+  tcache_t *t = tcache();
+  hdr_t *h = (hdr_t *)ptr - 1;
+  t->reallocs++;
+
+  uint64_t have = h->cls == LARGE ? h->size - HDR : h->size;
+  if (size <= have && (h->cls != LARGE || size + HDR > MAX_SMALL))
+    return ptr;
+
+#ifdef MREMAP_MAYMOVE
+  if (h->cls == LARGE && size + HDR > MAX_SMALL && size + HDR < HUGE_PAGE) {
+    size_t old = h->size, len = (size + HDR + PAGE - 1) & ~(size_t)(PAGE - 1);
+    void *p = mremap(h, old, len, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+      return NULL;
+
+    atomic_fetch_add_explicit(&mapped, len - old, memory_order_relaxed);
+    t->bytes_alloc += len - old;
+    h = p;
+    h->size = len;
+    return h + 1;
+  }
+#endif
+
+  void *p = anx_alloc(size);
+  if (!p)
+    return NULL;
+
+  memcpy(p, ptr, have < size ? have : size);
+  anx_free(ptr);
+  return p;
+}
+
+void anx_alloc_stats(anx_alloc_stats_t *out) {
+  pthread_mutex_lock(&reg_lock);
+  *out = retired;
+  for (tcache_t *t = live_caches; t; t = t->next)
+    fold(out, t);
+  pthread_mutex_unlock(&reg_lock);
+
+  out->bytes_mapped = atomic_load_explicit(&mapped, memory_order_relaxed);
+}
+
+void anx_alloc_stats_print(void) {
+  anx_alloc_stats_t s;
+  anx_alloc_stats(&s);
+
+  fprintf(stderr,
+          "anx alloc: %llu allocs, %llu frees, %llu reallocs\n"
+          "  cache:   %llu hits, %llu refills\n"
+          "  large:   %llu mapped directly (%llu huge)\n"
+          "  memory:  %llu bytes live, %llu bytes mapped\n",
+          (unsigned long long)s.allocs, (unsigned long long)s.frees,
+          (unsigned long long)s.reallocs, (unsigned long long)s.cache_hits,
+          (unsigned long long)s.cache_misses,
+          (unsigned long long)s.large_allocs, (unsigned long long)s.huge_allocs,
+          (unsigned long long)s.bytes_live, (unsigned long long)s.bytes_mapped);
+}
+
+void anx_alloc_set_hook(void (*hook)(const anx_alloc_stats_t *)) {
+  pthread_once(&once, setup);
+  exit_hook = hook;
+}
@@ -0,0 +1,660 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fmt_table.h"
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Fmt - This module implements number formatting and parsing.
+//
+// Integers are written two digits at a time from a table of digit pairs.
+// Floats are printed with the fewest digits that still parse back to the
+// same value, using the Ryu algorithm (Ulf Adams, PLDI 2018): the interval of
+// decimals that round to the float is scaled by a 128 bit power of five and
+// digits are dropped until its bounds meet. Integers and floats are parsed
+// eight digits at a time with SWAR arithmetic, and floats whose digits and
+// exponent are exact in a double take a fast path that needs a single
+// multiplication or division.
+//===---------------------------------------------------------------------===//
+
+static const char PAIRS[200] = "0001020304050607080910111213141516171819"
+                               "2021222324252627282930313233343536373839"
+                               "4041424344454647484950515253545556575859"
+                               "6061626364656667686970717273747576777879"
+                               "8081828384858687888990919293949596979899";
+
+static const uint64_t POW10[20] = {1ull,
+                                   10ull,
+                                   100ull,
+                                   1000ull,
+                                   10000ull,
+                                   100000ull,
+                                   1000000ull,
+                                   10000000ull,
+                                   100000000ull,
+                                   1000000000ull,
+                                   10000000000ull,
+                                   100000000000ull,
+                                   1000000000000ull,
+                                   10000000000000ull,
+                                   100000000000000ull,
+                                   1000000000000000ull,
+                                   10000000000000000ull,
+                                   100000000000000000ull,
+                                   1000000000000000000ull,
+                                   10000000000000000000ull};
+
+// number of decimal digits of x
+static inline uint32_t length(uint64_t x) {
+  uint32_t t = (64 - __builtin_clzll(x | 1)) * 1233 >> 12;
+  return t + 1 - ((x | 1) < POW10[t]);
+}
+
+// write the digits of x so that they end right before end
+static void digits(char *end, uint64_t x) {
+  while (x >= 100) {
+    uint64_t q = x / 100;
+    memcpy(end -= 2, PAIRS + (x - q * 100) * 2, 2);
+    x = q;
+  }
+
+  if (x >= 10)
+    memcpy(end - 2, PAIRS + x * 2, 2);
+  else
+    end[-1] = (char)('0' + x);
+}
+
+uint64_t anx_fmt_u64(char *out, uint64_t x) {
+  uint32_t n = length(x);
+  digits(out + n, x);
+  return n;
+}
+
+uint64_t anx_fmt_i64(char *out, int64_t x) {
+  if (x >= 0)
+    return anx_fmt_u64(out, x);
+
+  *out = '-';
+  return 1 + anx_fmt_u64(out + 1, -(uint64_t)x);
+}
+
+uint64_t anx_fmt_u128(char *out, anx_u128_t x) {
+  if (!(x >> 64))
+    return anx_fmt_u64(out, (uint64_t)x);
+
+  // at most 39 digits: print the leading ones, then 19 digit chunks that are
+  // padded with zeros
+  const uint64_t e19 = POW10[19];
+  uint64_t low = (uint64_t)(x % e19), mid = 0;
+  anx_u128_t top = x / e19;
+  int chunks = 1;
+
+  if (top >> 64 || (uint64_t)top >= e19) {
+    mid = (uint64_t)(top % e19);
+    top /= e19;
+    chunks = 2;
+  }
+
+  uint64_t n = anx_fmt_u64(out, (uint64_t)top);
+  if (chunks == 2) {
+    memset(out + n, '0', 19);
+    digits(out + n + 19, mid);
+    n += 19;
+  }
+
+  memset(out + n, '0', 19);
+  digits(out + n + 19, low);
+  return n + 19;
+}
+
+uint64_t anx_fmt_i128(char *out, anx_i128_t x) {
+  if (x >= 0)
+    return anx_fmt_u128(out, x);
+
+  *out = '-';
+  return 1 + anx_fmt_u128(out + 1, -(anx_u128_t)x);
+}
+
+uint64_t anx_fmt_bool(char *out, uint8_t x) {
+  memcpy(out, x ? "true" : "false", 5);
+  return x ? 4 : 5;
+}
+
+uint64_t anx_fmt_ptr(char *out, const void *p) {
+  uintptr_t x = (uintptr_t)p;
+  uint32_t n = x ? (67 - __builtin_clzll(x)) / 4 : 1;
+
+  memcpy(out, "0x", 2);
+  for (uint32_t i = n; i; i--, x >>= 4)
+    out[1 + i] = "0123456789abcdef"[x & 15];
+
+  return n + 2;
+}
+
+//===---------------------------------------------------------------------===//
+// Ryu
+//===---------------------------------------------------------------------===//
+
+#define POW5_INV_BITCOUNT 125
+#define POW5_BITCOUNT 125
+#define FLOAT_POW5_INV_BITCOUNT (POW5_INV_BITCOUNT - 64)
+#define FLOAT_POW5_BITCOUNT (POW5_BITCOUNT - 64)
+
+// a decimal m * 10^e
+typedef struct {
+  uint64_t m;
+  int32_t e;
+} decimal_t;
+
+// ceil(log2(5^e)), or 1 for e = 0
+static inline int32_t pow5bits(int32_t e) {
+  return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e)) and floor(log10(5^e))
+static inline uint32_t log10_pow2(int32_t e) {
+  return ((uint32_t)e * 78913) >> 18;
+}
+
+static inline uint32_t log10_pow5(int32_t e) {
+  return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline uint32_t pow5_factor(uint64_t x) {
+  uint32_t n = 0;
+  for (; x % 5 == 0; x /= 5)
+    n++;
+  return n;
+}
+
+static inline int multiple_of_pow5(uint64_t x, uint32_t p) {
+  return pow5_factor(x) >= p;
+}
+
+static inline int multiple_of_pow2(uint64_t x, uint32_t p) {
+  return (x & ((1ull << p) - 1)) == 0;
+}
+
+// (m * mul) >> j, where mul is a 128 bit table entry and j >= 64
+static inline uint64_t mul_shift64(uint64_t m, const uint64_t *mul,
+                                   int32_t j) {
+  anx_u128_t b0 = (anx_u128_t)m * mul[0];
+  anx_u128_t b2 = (anx_u128_t)m * mul[1];
+  return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+}
+
+static inline uint32_t mul_shift32(uint32_t m, uint64_t factor, int32_t j) {
+  uint64_t b0 = (uint64_t)m * (uint32_t)factor;
+  uint64_t b1 = (uint64_t)m * (factor >> 32);
+  return (uint32_t)(((b0 >> 32) + b1) >> (j - 32));
+}
+
+// shortest decimal in the rounding interval of a finite, non-zero double
+static decimal_t d2d(uint64_t mantissa, uint32_t exponent) {
+  int32_t e2;
+  uint64_t m2;
+  if (exponent == 0) {
+    e2 = 1 - 1023 - 52 - 2;
+    m2 = mantissa;
+  } else {
+    e2 = (int32_t)exponent - 1023 - 52 - 2;
+    m2 = (1ull << 52) | mantissa;
+  }
+
+  // the interval is [mm, mp] around mv, all scaled by 4 to stay integral
+  const int even = (m2 & 1) == 0, accept_bounds = even;
+  const uint64_t mv = 4 * m2;
+  const uint32_t mm_shift = mantissa != 0 || exponent <= 1;
+
+  uint64_t vr, vp, vm;
+  int32_t e10;
+  int vm_trailing_zeros = 0, vr_trailing_zeros = 0;
+
+  if (e2 >= 0) {
+    const uint32_t q = log10_pow2(e2) - (e2 > 3);
+    const int32_t k = POW5_INV_BITCOUNT + pow5bits(q) - 1;
+    const int32_t i = -e2 + (int32_t)q + k;
+    e10 = (int32_t)q;
+
+    vr = mul_shift64(4 * m2, POW5_INV_SPLIT[q], i);
+    vp = mul_shift64(4 * m2 + 2, POW5_INV_SPLIT[q], i);
+    vm = mul_shift64(4 * m2 - 1 - mm_shift, POW5_INV_SPLIT[q], i);
+
+    if (q <= 21) {
+      // only one of mp, mv and mm can be a multiple of 5, if any
+      if (mv % 5 == 0)
+        vr_trailing_zeros = multiple_of_pow5(mv, q);
+      else if (accept_bounds)
+        vm_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+      else
+        vp -= multiple_of_pow5(mv + 2, q);
+    }
+  } else {
+    const uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+    const int32_t i = -e2 - (int32_t)q;
+    const int32_t k = pow5bits(i) - POW5_BITCOUNT;
+    const int32_t j = (int32_t)q - k;
+    e10 = (int32_t)q + e2;
+
+    vr = mul_shift64(4 * m2, POW5_SPLIT[i], j);
+    vp = mul_shift64(4 * m2 + 2, POW5_SPLIT[i], j);
+    vm = mul_shift64(4 * m2 - 1 - mm_shift, POW5_SPLIT[i], j);
+
+    if (q <= 1) {
+      // mv has at least q trailing zeros as it is a multiple of 4
+      vr_trailing_zeros = 1;
+      if (accept_bounds)
+        vm_trailing_zeros = mm_shift == 1;
+      else
+        vp--;
+    } else if (q < 63) {
+      vr_trailing_zeros = multiple_of_pow2(mv, q);
+    }
+  }
+
+  // drop digits while the bounds still differ
+  int32_t removed = 0;
+  uint8_t last = 0;
+  uint64_t output;
+
+  if (vm_trailing_zeros || vr_trailing_zeros) {
+    for (; vp / 10 > vm / 10; removed++) {
+      vm_trailing_zeros &= vm % 10 == 0;
+      vr_trailing_zeros &= last == 0;
+      last = (uint8_t)(vr % 10);
+      vr /= 10, vp /= 10, vm /= 10;
+    }
+
+    if (vm_trailing_zeros)
+      for (; vm % 10 == 0; removed++) {
+        vr_trailing_zeros &= last == 0;
+        last = (uint8_t)(vr % 10);
+        vr /= 10, vp /= 10, vm /= 10;
+      }
+
+    // exactly halfway: round to even
+    if (vr_trailing_zeros && last == 5 && vr % 2 == 0)
+      last = 4;
+
+    output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) ||
+                   last >= 5);
+  } else {
+    // the common case, where no bound is exact
+    int round_up = 0;
+    if (vp / 100 > vm / 100) {
+      round_up = vr % 100 >= 50;
+      vr /= 100, vp /= 100, vm /= 100;
+      removed += 2;
+    }
+
+    for (; vp / 10 > vm / 10; removed++) {
+      round_up = vr % 10 >= 5;
+      vr /= 10, vp /= 10, vm /= 10;
+    }
+
+    output = vr + (vr == vm || round_up);
+  }
+
+  return (decimal_t){output, e10 + removed};
+}
+
+// shortest decimal in the rounding interval of a finite, non-zero float. the
+// high halves of the double tables are precise enough for floats.
+static decimal_t f2d(uint32_t mantissa, uint32_t exponent) {
+  int32_t e2;
+  uint32_t m2;
+  if (exponent == 0) {
+    e2 = 1 - 127 - 23 - 2;
+    m2 = mantissa;
+  } else {
+    e2 = (int32_t)exponent - 127 - 23 - 2;
+    m2 = (1u << 23) | mantissa;
+  }
+
+  const int even = (m2 & 1) == 0, accept_bounds = even;
+  const uint32_t mv = 4 * m2, mp = 4 * m2 + 2;
+  const uint32_t mm_shift = mantissa != 0 || exponent <= 1;
+  const uint32_t mm = 4 * m2 - 1 - mm_shift;
+
+  uint32_t vr, vp, vm;
+  int32_t e10;
+  int vm_trailing_zeros = 0, vr_trailing_zeros = 0;
+  uint8_t last = 0;
+
+  if (e2 >= 0) {
+    const uint32_t q = log10_pow2(e2);
+    const int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5bits(q) - 1;
+    const int32_t i = -e2 + (int32_t)q + k;
+    const uint64_t inv = POW5_INV_SPLIT[q][1] + 1;
+    e10 = (int32_t)q;
+
+    vr = mul_shift32(mv, inv, i);
+    vp = mul_shift32(mp, inv, i);
+    vm = mul_shift32(mm, inv, i);
+
+    // the digit the loop below would remove first, when it removes none
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      const int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5bits(q - 1) - 1;
+      last = mul_shift32(mv, POW5_INV_SPLIT[q - 1][1] + 1,
+                         -e2 + (int32_t)q - 1 + l) %
+             10;
+    }
+
+    if (q <= 9) {
+      if (mv % 5 == 0)
+        vr_trailing_zeros = multiple_of_pow5(mv, q);
+      else if (accept_bounds)
+        vm_trailing_zeros = multiple_of_pow5(mm, q);
+      else
+        vp -= multiple_of_pow5(mp, q);
+    }
+  } else {
+    const uint32_t q = log10_pow5(-e2);
+    const int32_t i = -e2 - (int32_t)q;
+    const int32_t k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+    int32_t j = (int32_t)q - k;
+    e10 = (int32_t)q + e2;
+
+    vr = mul_shift32(mv, POW5_SPLIT[i][1], j);
+    vp = mul_shift32(mp, POW5_SPLIT[i][1], j);
+    vm = mul_shift32(mm, POW5_SPLIT[i][1], j);
+
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      j = (int32_t)q - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+      last = mul_shift32(mv, POW5_SPLIT[i + 1][1], j) % 10;
+    }
+
+    if (q <= 1) {
+      vr_trailing_zeros = 1;
+      if (accept_bounds)
+        vm_trailing_zeros = mm_shift == 1;
+      else
+        vp--;
+    } else if (q < 31) {
+      vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+    }
+  }
+
+  int32_t removed = 0;
+  uint32_t output;
+
+  if (vm_trailing_zeros || vr_trailing_zeros) {
+    for (; vp / 10 > vm / 10; removed++) {
+      vm_trailing_zeros &= vm % 10 == 0;
+      vr_trailing_zeros &= last == 0;
+      last = (uint8_t)(vr % 10);
+      vr /= 10, vp /= 10, vm /= 10;
+    }
+
+    if (vm_trailing_zeros)
+      for (; vm % 10 == 0; removed++) {
+        vr_trailing_zeros &= last == 0;
+        last = (uint8_t)(vr % 10);
+        vr /= 10, vp /= 10, vm /= 10;
+      }
+
+    if (vr_trailing_zeros && last == 5 && vr % 2 == 0)
+      last = 4;
+
+    output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) ||
+                   last >= 5);
+  } else {
+    for (; vp / 10 > vm / 10; removed++) {
+      last = (uint8_t)(vr % 10);
+      vr /= 10, vp /= 10, vm /= 10;
+    }
+
+    output = vr + (vr == vm || last >= 5);
+  }
+
+  return (decimal_t){output, e10 + removed};
+}
+
+// print m * 10^e the way Python's repr does: positional notation for
+// exponents from -4 to 15, with a ".0" on integral values, and scientific
+// notation with at least two exponent digits otherwise
+static uint64_t write_decimal(char *out, int neg, decimal_t d) {
+  char *p = out;
+  if (neg)
+    *p++ = '-';
+
+  char buf[20];
+  int32_t n = (int32_t)length(d.m);
+  digits(buf + n, d.m);
+
+  int32_t x = n + d.e - 1; // exponent of the first digit
+  if (x >= -4 && x < 16) {
+    if (d.e >= 0) {
+      memcpy(p, buf, n);
+      memset(p + n, '0', d.e);
+      memcpy(p + n + d.e, ".0", 2);
+      p += n + d.e + 2;
+    } else if (x >= 0) {
+      memcpy(p, buf, x + 1);
+      p[x + 1] = '.';
+      memcpy(p + x + 2, buf + x + 1, n - x - 1);
+      p += n + 1;
+    } else {
+      memcpy(p, "0.", 2);
+      memset(p + 2, '0', -x - 1);
+      memcpy(p + 1 - x, buf, n);
+      p += 1 - x + n;
+    }
+
+    return p - out;
+  }
+
+  *p++ = buf[0];
+  if (n > 1) {
+    *p++ = '.';
+    memcpy(p, buf + 1, n - 1);
+    p += n - 1;
+  }
+
+  *p++ = 'e';
+  *p++ = x < 0 ? '-' : '+';
+  if (x < 0)
+    x = -x;
+  if (x >= 100)
+    *p++ = (char)('0' + x / 100);
+  memcpy(p, PAIRS + (x % 100) * 2, 2);
+
+  return p + 2 - out;
+}
+
+static uint64_t write_special(char *out, int neg, int nan, int zero) {
+  const char *s = nan ? "nan" : zero ? "0.0" : "inf";
+  uint64_t n = 0;
+  if (neg && !nan)
+    out[n++] = '-';
+
+  memcpy(out + n, s, 3);
+  return n + 3;
+}
+
+uint64_t anx_fmt_f64(char *out, double x) {
+  uint64_t bits;
+  memcpy(&bits, &x, 8);
+
+  const int neg = bits >> 63;
+  const uint64_t mantissa = bits & ((1ull << 52) - 1);
+  const uint32_t exponent = (bits >> 52) & 0x7ff;
+
+  if (exponent == 0x7ff || (!exponent && !mantissa))
+    return write_special(out, neg, exponent == 0x7ff && mantissa, !exponent);
+
+  // small integers are exact and need no search
+  const int32_t e2 = (int32_t)exponent - 1023 - 52;
+  const uint64_t m2 = (1ull << 52) | mantissa;
+  if (e2 <= 0 && e2 >= -52 && !(m2 & ((1ull << -e2) - 1))) {
+    decimal_t d = {m2 >> -e2, 0};
+    for (; d.m % 10 == 0; d.m /= 10)
+      d.e++;
+    return write_decimal(out, neg, d);
+  }
+
+  return write_decimal(out, neg, d2d(mantissa, exponent));
+}
+
+uint64_t anx_fmt_f32(char *out, float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, 4);
+
+  const int neg = bits >> 31;
+  const uint32_t mantissa = bits & ((1u << 23) - 1);
+  const uint32_t exponent = (bits >> 23) & 0xff;
+
+  if (exponent == 0xff || (!exponent && !mantissa))
+    return write_special(out, neg, exponent == 0xff && mantissa, !exponent);
+
+  return write_decimal(out, neg, f2d(mantissa, exponent));
+}
+
+//===---------------------------------------------------------------------===//
+// Parsing
+//===---------------------------------------------------------------------===//
+
+// whether all 8 bytes of v are ASCII digits
+static inline int is_digits8(uint64_t v) {
+  return ((v & 0xf0f0f0f0f0f0f0f0ull) |
+          (((v + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull) >> 4)) ==
+         0x3333333333333333ull;
+}
+
+// the value of 8 ASCII digits in little endian order, combining adjacent
+// digits, then pairs, then quads with three multiplications
+static inline uint32_t parse8(uint64_t v) {
+  v -= 0x3030303030303030ull;
+  v = v * 10 + (v >> 8);
+  v = ((v & 0x000000ff000000ffull) * (100 + (1000000ull << 32)) +
+       ((v >> 16) & 0x000000ff000000ffull) * (1 + (10000ull << 32))) >>
+      32;
+  return (uint32_t)v;
+}
+
+// accumulate the digits at p into *m, keeping at most 19 of them; *count
+// receives the number of digits and *dropped how many did not fit
+static const char *parse_digits(const char *p, const char *end, uint64_t *m,
+                                int32_t *count, int32_t *dropped) {
+  uint64_t v;
+
+  while (end - p >= 8 && *count + 8 <= 19) {
+    memcpy(&v, p, 8);
+    if (!is_digits8(v))
+      break;
+
+    *m = *m * 100000000 + parse8(v);
+    *count += 8;
+    p += 8;
+  }
+
+  for (; p < end && (unsigned)(*p - '0') < 10; p++, ++*count) {
+    if (*count < 19)
+      *m = *m * 10 + (uint64_t)(*p - '0');
+    else
+      ++*dropped;
+  }
+
+  return p;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    p++;
+  return p;
+}
+
+// leading zeros do not count against the 19 digits that fit
+static const char *skip_zeros(const char *p, const char *end) {
+  while (p < end && *p == '0')
+    p++;
+  return p;
+}
+
+int64_t anx_parse_i64(const anx_str_t *s) {
+  const char *p = anx_str_data(s), *end = p + anx_str_len(s);
+  p = skip_space(p, end);
+
+  int neg = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    p++;
+
+  uint64_t m = 0;
+  int32_t count = 0, dropped = 0;
+  p = skip_zeros(p, end);
+  parse_digits(p, end, &m, &count, &dropped);
+
+  // out of range values saturate
+  uint64_t limit = neg ? (uint64_t)INT64_MAX + 1 : INT64_MAX;
+  if (dropped || m > limit)
+    m = limit;
+
+  return neg ? (int64_t)(0 - m) : (int64_t)m;
+}
+
+static const double POW10D[23] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+
+double anx_parse_f64(const anx_str_t *s) {
+  const char *p = anx_str_data(s), *end = p + anx_str_len(s);
+  p = skip_space(p, end);
+  const char *start = p;
+
+  int neg = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+'))
+    p++;
+
+  uint64_t m = 0;
+  int32_t count = 0, dropped = 0, e = 0;
+  p = skip_zeros(p, end);
+  count = p != start && p[-1] == '0';
+  p = parse_digits(p, end, &m, &count, &dropped);
+  e += dropped;
+
+  // every fractional digit that was kept divides by ten
+  if (p < end && *p == '.') {
+    int32_t before = count - dropped;
+    p = parse_digits(p + 1, end, &m, &count, &dropped);
+    e -= count - dropped - before;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    int eneg = q < end && *q == '-';
+    if (q < end && (*q == '-' || *q == '+'))
+      q++;
+
+    int32_t x = 0;
+    if (q < end && (unsigned)(*q - '0') < 10) {
+      for (; q < end && (unsigned)(*q - '0') < 10; q++)
+        if (x < 100000)
+          x = x * 10 + (*q - '0');
+      e += eneg ? -x : x;
+      p = q;
+    }
+  }
+
+  // digits and power of ten are both exact in a double, so a single correctly
+  // rounded operation gives the correctly rounded result
+  if (!dropped && m <= (1ull << 53) && e >= -22 && e <= 22) {
+    double d = (double)m;
+    d = e < 0 ? d / POW10D[-e] : d * POW10D[e];
+    return neg ? -d : d;
+  }
+
+  // otherwise (and for inf and nan) fall back to the C library
+  char small[64], *copy = small;
+  uint64_t n = (uint64_t)((count ? p : end) - start);
+  if (n >= sizeof(small))
+    copy = anx_alloc(n + 1);
+
+  memcpy(copy, start, n);
+  copy[n] = 0;
+  double d = strtod(copy, NULL);
+
+  if (copy != small)
+    anx_free(copy);
+  return d;
+}
@@ -0,0 +1,666 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// GC - This module implements the precise, generational garbage collector.
+//
+// New objects are bump allocated in a fixed size nursery. When it fills up, a
+// copying minor collection promotes every live nursery object into the old
+// generation, finding roots through the stack maps that LLVM emits for each
+// statepoint and through the remembered set maintained by the write barrier.
+//
+// The old generation is a mark-region (Immix style) heap: 32KiB blocks split
+// into 128 byte lines, where allocation bumps through runs of free lines and
+// reclamation happens at line granularity without ever moving old objects.
+// It is marked incrementally, a budgeted slice at the end of each minor
+// collection, using a snapshot-at-the-beginning barrier so that no pause ever
+// has to trace the full heap. Objects larger than LARGE_OBJ are mapped
+// individually and swept when a marking cycle completes.
+//
+// The collector supports a single mutator thread. Frames are walked along the
+// frame pointer chain, which every function of a program that allocates
+// objects keeps, assuming the x86-64 System V ABI.
+//===---------------------------------------------------------------------===//
+
+#define BLOCK (32u << 10)
+#define LINE 128u
+#define LINES (BLOCK / LINE)
+#define META_LINES ((sizeof(block_t) + LINE - 1) / LINE)
+#define LARGE_OBJ (8u << 10)
+#define BLOCKS_PER_MAP 32
+#define SLICE_MIN (256u << 10)
+#define CYCLE_MIN (16u << 20)
+
+enum {
+  F_OLD = ANX_GC_OLD,
+  F_REFS = ANX_GC_REFS,
+  F_LOGGED = 4,
+  F_LARGE = 8,
+  F_FWD = 16
+};
+
+typedef struct obj {
+  uint32_t slots;
+  uint16_t flags;
+  uint16_t mark; // epoch of the last marking cycle that reached this object
+  struct obj *fwd;
+  struct obj *slot[];
+} obj_t;
+
+typedef struct block {
+  uint32_t line[LINES]; // epoch in which each line last held a live object
+} block_t;
+
+typedef struct large {
+  struct large *prev, *next;
+  size_t len;
+  uint64_t pad;
+} large_t;
+
+typedef struct {
+  obj_t **items;
+  size_t len, cap;
+} vec_t;
+
+typedef struct {
+  uintptr_t ret;
+  const uint8_t *locs;
+  uint16_t nlocs;
+} site_t;
+
+// every module that allocates objects puts the address of its part of the
+// .llvm_stackmaps section in this one, so that a program linked from several
+// modules has a stack map for each
+extern const uint8_t *const __start_anx_stackmaps[] __attribute__((weak));
+extern const uint8_t *const __stop_anx_stackmaps[] __attribute__((weak));
+
+static char *nursery, *nursery_top, *nursery_end;
+
+static block_t **blocks;
+static size_t nblocks, capblocks;
+static size_t hole_block, hole_line; // where the search for free lines resumes
+static char *cursor, *limit;
+
+static large_t *larges;
+
+static uint32_t epoch = 1, done = 1; // current and last completed mark cycle
+static int marking;
+static uint64_t since_cycle, cycle_threshold = CYCLE_MIN, marked_bytes;
+
+static vec_t grey, scan, remembered;
+
+static site_t *sites;
+static size_t nsites_mask;
+
+static anx_gc_stats_t stats;
+
+static void push(vec_t *s, obj_t *o) {
+  if (s->len == s->cap) {
+    s->cap = s->cap ? s->cap * 2 : 1024;
+    if (!(s->items = realloc(s->items, s->cap * sizeof(obj_t *)))) {
+      fputs("anx gc: out of memory\n", stderr);
+      abort();
+    }
+  }
+  s->items[s->len++] = o;
+}
+
+static void *map(size_t len) {
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0);
+  if (p == MAP_FAILED) {
+    fputs("anx gc: out of memory\n", stderr);
+    abort();
+  }
+  return p;
+}
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline size_t size_of(const obj_t *o) {
+  return ANX_GC_HDR + (size_t)o->slots * 8;
+}
+
+static inline int young(const void *p) {
+  return (const char *)p >= nursery && (const char *)p < nursery_end;
+}
+
+static inline block_t *block_of(const void *p) {
+  return (block_t *)((uintptr_t)p & ~(uintptr_t)(BLOCK - 1));
+}
+
+static void mark_lines(const obj_t *o, uint32_t e) {
+  block_t *b = block_of(o);
+  size_t first = ((const char *)o - (const char *)b) / LINE,
+         last = ((const char *)o + size_of(o) - 1 - (const char *)b) / LINE;
+
+  for (size_t i = first; i <= last; i++)
+    b->line[i] = e;
+}
+
+//===---------------------------------------------------------------------===//
+// Stack maps
+//===---------------------------------------------------------------------===//
+
+static inline size_t hash(uintptr_t ret) {
+  return (ret * 0x9e3779b97f4a7c15ull) >> 17;
+}
+
+static const uint8_t *align8(const uint8_t *base, const uint8_t *p) {
+  return base + (((p - base) + 7) & ~(size_t)7);
+}
+
+static uint32_t records(const uint8_t *map) {
+  if (map[0] != 3) {
+    fputs("anx gc: unsupported stack map\n", stderr);
+    abort();
+  }
+
+  uint32_t nrec;
+  memcpy(&nrec, map + 12, 4);
+  return nrec;
+}
+
+// index the statepoint records of one module's stack map
+static void index_map(const uint8_t *base) {
+  const uint8_t *p = base;
+
+  uint32_t nfun, ncon;
+  memcpy(&nfun, p + 4, 4);
+  memcpy(&ncon, p + 8, 4);
+  p += 16;
+
+  const uint8_t *funs = p, *rec = p + nfun * 24 + ncon * 8;
+
+  for (uint32_t f = 0; f < nfun; f++) {
+    uint64_t addr, count;
+    memcpy(&addr, funs + f * 24, 8);
+    memcpy(&count, funs + f * 24 + 16, 8);
+
+    for (uint64_t r = 0; r < count; r++) {
+      uint32_t off;
+      uint16_t nlocs, nlive;
+      memcpy(&off, rec + 8, 4);
+      memcpy(&nlocs, rec + 14, 2);
+
+      site_t s = {addr + off, rec + 16, nlocs};
+      size_t h = hash(s.ret) & nsites_mask;
+      while (sites[h].ret)
+        h = (h + 1) & nsites_mask;
+      sites[h] = s;
+
+      rec = align8(base, rec + 16 + nlocs * 12);
+      memcpy(&nlive, rec + 2, 2);
+      rec = align8(base, rec + 4 + nlive * 4);
+    }
+  }
+}
+
+// index every statepoint record of the program by the return address of its
+// call
+static void load_sites(void) {
+  const uint8_t *const *maps = __start_anx_stackmaps;
+  size_t nmaps = maps ? __stop_anx_stackmaps - maps : 0;
+  if (!nmaps) {
+    fputs("anx gc: missing stack map\n", stderr);
+    abort();
+  }
+
+  size_t nrec = 0;
+  for (size_t i = 0; i < nmaps; i++)
+    nrec += records(maps[i]);
+
+  size_t cap = 16;
+  while (cap < nrec * 2)
+    cap <<= 1;
+  sites = calloc(cap, sizeof(site_t));
+  nsites_mask = cap - 1;
+
+  for (size_t i = 0; i < nmaps; i++)
+    index_map(maps[i]);
+}
+
+static const site_t *find_site(uintptr_t ret) {
+  for (size_t h = hash(ret) & nsites_mask; sites[h].ret; h = (h + 1) & nsites_mask)
+    if (sites[h].ret == ret)
+      return &sites[h];
+
+  return NULL;
+}
+
+// the slot a stack map location refers to, in a frame with the given stack
+// and frame pointers
+static obj_t **location(const uint8_t *loc, char *sp, char *fp) {
+  uint16_t reg;
+  int32_t off;
+  memcpy(&reg, loc + 4, 2);
+  memcpy(&off, loc + 8, 4);
+
+  if (loc[0] != 3 || (reg != 7 && reg != 6)) {
+    fputs("anx gc: unsupported stack map location\n", stderr);
+    abort();
+  }
+
+  return (obj_t **)((reg == 7 ? sp : fp) + off);
+}
+
+// visit the live references of the frame stopped at the statepoint s
+static void walk_frame(const site_t *s, char *sp, char *fp,
+                       obj_t *(*visit)(obj_t *)) {
+  // skip calling convention, flags and the deopt arguments
+  int32_t ndeopt;
+  memcpy(&ndeopt, s->locs + 2 * 12 + 8, 4);
+
+  size_t first = 3 + ndeopt, n = (s->nlocs - first) / 2;
+  ptrdiff_t delta[n ? n : 1];
+
+  for (size_t k = 0; k < n; k++) {
+    obj_t **b = location(s->locs + (first + 2 * k) * 12, sp, fp),
+          **d = location(s->locs + (first + 2 * k + 1) * 12, sp, fp);
+    delta[k] = (char *)*d - (char *)*b;
+  }
+
+  for (size_t k = 0; k < n; k++) {
+    obj_t **b = location(s->locs + (first + 2 * k) * 12, sp, fp);
+    *b = visit(*b); // visiting is idempotent, bases may repeat
+  }
+
+  for (size_t k = 0; k < n; k++) {
+    obj_t **b = location(s->locs + (first + 2 * k) * 12, sp, fp),
+          **d = location(s->locs + (first + 2 * k + 1) * 12, sp, fp);
+    if (b != d)
+      *d = (obj_t *)((char *)*b + delta[k]);
+  }
+}
+
+// the end of the current thread's stack, which the frame walk stays below
+static char *stack_end(void) {
+  static __thread char *end;
+  if (end)
+    return end;
+
+  pthread_attr_t attr;
+  void *addr;
+  size_t size;
+  if (pthread_getattr_np(pthread_self(), &attr) ||
+      pthread_attr_getstack(&attr, &addr, &size)) {
+    fputs("anx gc: cannot find the stack\n", stderr);
+    abort();
+  }
+  pthread_attr_destroy(&attr);
+
+  return end = (char *)addr + size;
+}
+
+// visit every live reference held by Anx frames, following the frame pointer
+// chain up from the runtime entry point that triggered the collection.
+// frames without a statepoint, such as those of C code that calls back into
+// Anx, are passed over. derived pointers are rebased after their base has
+// been visited.
+static void walk_stack(void **fp, obj_t *(*visit)(obj_t *)) {
+  if (!sites)
+    load_sites();
+
+  char *end = stack_end();
+  while ((char *)fp < end - 16 && !((uintptr_t)fp & 7)) {
+    // the caller resumes with its stack pointer just above the return
+    // address, and its frame pointer saved below it
+    void **next = fp[0];
+    const site_t *s = find_site((uintptr_t)fp[1]);
+    if (s)
+      walk_frame(s, (char *)(fp + 2), (char *)next, visit);
+
+    if (next <= fp)
+      break;
+    fp = next;
+  }
+}
+
+//===---------------------------------------------------------------------===//
+// Old generation
+//===---------------------------------------------------------------------===//
+
+static void new_blocks(void) {
+  char *raw = map((BLOCKS_PER_MAP + 1) * BLOCK);
+  char *first = (char *)(((uintptr_t)raw + BLOCK - 1) & ~(uintptr_t)(BLOCK - 1));
+
+  if (nblocks + BLOCKS_PER_MAP > capblocks) {
+    capblocks = capblocks ? capblocks * 2 : 256;
+    blocks = realloc(blocks, capblocks * sizeof(block_t *));
+  }
+
+  for (size_t i = 0; i < BLOCKS_PER_MAP; i++)
+    blocks[nblocks++] = (block_t *)(first + i * BLOCK); // zeroed: all free
+}
+
+static inline int line_free(const block_t *b, size_t i) {
+  return b->line[i] < done;
+}
+
+// find the next run of free lines that can hold size bytes
+static void next_hole(size_t size) {
+  for (;;) {
+    for (; hole_block < nblocks; hole_block++, hole_line = META_LINES) {
+      block_t *b = blocks[hole_block];
+      if (hole_line < META_LINES)
+        hole_line = META_LINES;
+
+      while (hole_line < LINES) {
+        while (hole_line < LINES && !line_free(b, hole_line))
+          hole_line++;
+
+        size_t end = hole_line;
+        while (end < LINES && line_free(b, end))
+          end++;
+
+        if ((end - hole_line) * LINE >= size) {
+          cursor = (char *)b + hole_line * LINE;
+          limit = (char *)b + end * LINE;
+          hole_line = end;
+          return;
+        }
+        hole_line = end;
+      }
+    }
+
+    new_blocks();
+  }
+}
+
+static obj_t *old_alloc(size_t size) {
+  if (cursor + size > limit)
+    next_hole(size);
+
+  obj_t *o = (obj_t *)cursor;
+  cursor += size;
+  since_cycle += size;
+  return o;
+}
+
+static obj_t *large_alloc(size_t size) {
+  large_t *l = map(sizeof(large_t) + size);
+  l->len = sizeof(large_t) + size;
+  l->prev = NULL;
+  l->next = larges;
+  if (larges)
+    larges->prev = l;
+  larges = l;
+
+  stats.large_live += l->len;
+  since_cycle += l->len;
+
+  obj_t *o = (obj_t *)(l + 1);
+  o->flags = F_OLD | F_LARGE;
+  o->mark = epoch; // allocated black while a cycle is running
+  return o;
+}
+
+//===---------------------------------------------------------------------===//
+// Marking
+//===---------------------------------------------------------------------===//
+
+static void shade(obj_t *o) {
+  if (!o || young(o) || o->mark == (uint16_t)epoch)
+    return;
+
+  o->mark = epoch;
+  if (!(o->flags & F_LARGE))
+    mark_lines(o, epoch);
+
+  marked_bytes += size_of(o);
+  if (o->flags & F_REFS)
+    push(&grey, o);
+}
+
+static obj_t *shade_root(obj_t *o) {
+  shade(o);
+  return o;
+}
+
+static void finish_cycle(void) {
+  marking = 0;
+  done = epoch;
+  stats.major++;
+
+  for (large_t *l = larges, *n; l; l = n) {
+    n = l->next;
+    obj_t *o = (obj_t *)(l + 1);
+    if (o->mark == (uint16_t)done)
+      continue;
+
+    if (l->prev)
+      l->prev->next = n;
+    else
+      larges = n;
+    if (n)
+      n->prev = l->prev;
+
+    stats.large_live -= l->len;
+    munmap(l, l->len);
+  }
+
+  // lines freed by this cycle become visible to the allocator again
+  hole_block = 0, hole_line = META_LINES;
+  cursor = limit = NULL;
+
+  stats.old_live = marked_bytes;
+  cycle_threshold = marked_bytes * 2 > CYCLE_MIN ? marked_bytes * 2 : CYCLE_MIN;
+  since_cycle = 0;
+}
+
+static void mark_slice(uint64_t budget) {
+  uint64_t scanned = 0;
+  stats.slices++;
+
+  while (grey.len && scanned < budget) {
+    obj_t *o = grey.items[--grey.len];
+    for (uint32_t i = 0; i < o->slots; i++)
+      shade(o->slot[i]);
+    scanned += size_of(o);
+  }
+
+  if (!grey.len)
+    finish_cycle();
+}
+
+//===---------------------------------------------------------------------===//
+// Minor collection
+//===---------------------------------------------------------------------===//
+
+static obj_t *forward(obj_t *o) {
+  if (!o || !young(o))
+    return o;
+  if (o->flags & F_FWD)
+    return o->fwd;
+
+  size_t size = size_of(o);
+  obj_t *n = old_alloc(size);
+  memcpy(n, o, size);
+  n->flags |= F_OLD;
+  n->mark = epoch; // promoted objects are allocated black during a cycle
+  mark_lines(n, epoch);
+
+  stats.bytes_promoted += size;
+  if (marking)
+    marked_bytes += size;
+
+  o->flags |= F_FWD;
+  o->fwd = n;
+
+  if (n->flags & F_REFS)
+    push(&scan, n);
+  return n;
+}
+
+static void record_pause(uint64_t start) {
+  uint64_t ns = now() - start, us = ns / 1000;
+  size_t b = 0;
+  while (b + 1 < ANX_GC_BUCKETS && us >= (1ull << b))
+    b++;
+
+  stats.pauses[b]++;
+  stats.pause_total_ns += ns;
+  if (ns > stats.pause_max_ns)
+    stats.pause_max_ns = ns;
+}
+
+static void minor(void **fp, int full) {
+  uint64_t start = now(), promoted = stats.bytes_promoted;
+  stats.minor++;
+
+  walk_stack(fp, forward);
+
+  for (size_t i = 0; i < remembered.len; i++) {
+    obj_t *o = remembered.items[i];
+    o->flags &= ~F_LOGGED;
+    for (uint32_t j = 0; j < o->slots; j++)
+      o->slot[j] = forward(o->slot[j]);
+  }
+  remembered.len = 0;
+
+  while (scan.len) {
+    obj_t *o = scan.items[--scan.len];
+    for (uint32_t j = 0; j < o->slots; j++)
+      o->slot[j] = forward(o->slot[j]);
+  }
+
+  nursery_top = nursery;
+
+  if (!marking && (full || since_cycle >= cycle_threshold)) {
+    // the nursery is empty, so the stack holds the whole snapshot
+    marking = 1;
+    epoch++;
+    marked_bytes = 0;
+    walk_stack(fp, shade_root);
+  }
+
+  if (marking) {
+    uint64_t budget = 2 * (stats.bytes_promoted - promoted);
+    mark_slice(full ? UINT64_MAX : budget > SLICE_MIN ? budget : SLICE_MIN);
+  }
+
+  record_pause(start);
+}
+
+static void report(void) {
+  const char *env = getenv("ANX_GC_STATS");
+  if (env && *env && *env != '0')
+    anx_gc_stats_print();
+}
+
+static void setup(void) {
+  size_t size = 4u << 20;
+  const char *env = getenv("ANX_GC_NURSERY");
+  if (env && atol(env) > 0)
+    size = (size_t)atol(env);
+
+  nursery = nursery_top = map(size);
+  nursery_end = nursery + size;
+  stats.nursery_size = size;
+
+  atexit(report);
+}
+
+//===---------------------------------------------------------------------===//
+// Runtime interface
+//===---------------------------------------------------------------------===//
+
+__attribute__((noinline)) void *anx_gc_new(uint64_t slots, uint8_t refs) {
+  if (!nursery)
+    setup();
+
+  size_t size = ANX_GC_HDR + slots * 8;
+  stats.bytes_allocated += size;
+
+  obj_t *o;
+  if (size > LARGE_OBJ) {
+    o = large_alloc(size);
+    if (marking)
+      marked_bytes += size;
+  } else {
+    if (nursery_top + size > nursery_end)
+      minor(__builtin_frame_address(0), 0);
+
+    o = (obj_t *)nursery_top;
+    nursery_top += size;
+    o->flags = 0;
+    o->mark = 0;
+  }
+
+  o->slots = slots;
+  o->fwd = NULL;
+  if (refs)
+    o->flags |= F_REFS;
+  memset(o->slot, 0, slots * 8);
+
+  return o;
+}
+
+void anx_gc_mismatch(uint8_t refs) {
+  anx_io_flush();
+  fputs(refs ? "anx gc: an object of integers was accessed as references\n"
+             : "anx gc: an object of references was accessed as integers\n",
+        stderr);
+  abort();
+}
+
+// slow path of the write barrier, only taken for stores into old objects
+void anx_gc_barrier(void *obj, void *prev, void *val) {
+  obj_t *o = obj;
+
+  if (marking)
+    shade(prev);
+
+  if (val && young(val) && !(o->flags & F_LOGGED)) {
+    o->flags |= F_LOGGED;
+    push(&remembered, o);
+  }
+}
+
+__attribute__((noinline)) void anx_gc_collect(void) {
+  if (!nursery)
+    setup();
+
+  // finish any running cycle, then run a complete one from scratch
+  if (marking)
+    mark_slice(UINT64_MAX);
+  minor(__builtin_frame_address(0), 1);
+}
+
+void anx_gc_stats(anx_gc_stats_t *out) {
+  *out = stats;
+}
+
+void anx_gc_stats_print(void) {
+  anx_gc_stats_t s;
+  anx_gc_stats(&s);
+
+  fprintf(stderr,
+          "anx gc: %llu minor, %llu major (%llu slices)\n"
+          "  bytes:   %llu allocated, %llu promoted\n"
+          "  heap:    %llu nursery, %llu old live, %llu large live\n"
+          "  pauses:  %.3f ms total, %.3f ms max\n",
+          (unsigned long long)s.minor, (unsigned long long)s.major,
+          (unsigned long long)s.slices, (unsigned long long)s.bytes_allocated,
+          (unsigned long long)s.bytes_promoted,
+          (unsigned long long)s.nursery_size, (unsigned long long)s.old_live,
+          (unsigned long long)s.large_live, s.pause_total_ns / 1e6,
+          s.pause_max_ns / 1e6);
+
+  for (size_t b = 0; b < ANX_GC_BUCKETS; b++)
+    if (s.pauses[b])
+      fprintf(stderr, "  < %8llu us: %llu\n", 1ull << b,
+              (unsigned long long)s.pauses[b]);
+}
@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// IO - This module implements buffered standard input and output.
+//
+// Every thread writes into its own output buffer, so writing a byte is a
+// store and a pointer increment that the code generator emits inline; only a
+// full buffer costs a system call. Buffers are flushed when they fill up,
+// before a thread blocks reading standard input, when their thread exits, and
+// for every thread still running at exit.
+// Standard input is read through a per-thread buffer in the same way.
+//===---------------------------------------------------------------------===//
+
+#define OUT_SIZE (1 << 16)
+#define IN_SIZE (1 << 16)
+
+__thread anx_out_t anx_out;
+
+typedef struct buffer {
+  anx_out_t *out; // the owning thread's cursor
+  char *data;
+  struct buffer *prev, *next;
+} buffer_t;
+
+static __thread buffer_t *self;
+static __thread struct {
+  char *data, *pos, *end;
+  uint8_t eof;
+} in;
+
+// the output buffers of the live threads in the order they first wrote, so
+// that they can all be flushed at exit. the lock also keeps the writes of
+// different threads from interleaving.
+static buffer_t *buffers, *last;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+static void write_all(const char *p, uint64_t n) {
+  while (n) {
+    ssize_t r = write(1, p, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0) // the output is gone, so is anything still buffered
+      return;
+
+    p += r;
+    n -= r;
+  }
+}
+
+static void flush(buffer_t *b) {
+  pthread_mutex_lock(&lock);
+  write_all(b->data, b->out->pos - b->data);
+  pthread_mutex_unlock(&lock);
+
+  b->out->pos = b->data;
+}
+
+static void flush_all(void) {
+  pthread_mutex_lock(&lock);
+  for (buffer_t *b = buffers; b; b = b->next) {
+    write_all(b->data, b->out->pos - b->data);
+    b->out->pos = b->data;
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+// flush the buffer of a thread that exits and drop it from the list, before
+// its cursor goes away with the rest of its thread locals
+static void retire(void *arg) {
+  buffer_t *b = arg;
+
+  pthread_mutex_lock(&lock);
+  write_all(b->data, b->out->pos - b->data);
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    buffers = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  else
+    last = b->prev;
+  pthread_mutex_unlock(&lock);
+
+  anx_out.pos = anx_out.end = NULL;
+  self = NULL;
+  anx_free(b->data);
+  anx_free(b);
+}
+
+static void setup(void) {
+  pthread_key_create(&key, retire);
+  atexit(flush_all);
+}
+
+// give the current thread an output buffer the first time it writes
+static buffer_t *buffer(void) {
+  if (self)
+    return self;
+
+  pthread_once(&once, setup);
+
+  self = anx_alloc(sizeof(buffer_t));
+  self->out = &anx_out;
+  self->data = anx_alloc(OUT_SIZE);
+  anx_out.pos = self->data;
+  anx_out.end = self->data + OUT_SIZE;
+  pthread_setspecific(key, self);
+
+  pthread_mutex_lock(&lock);
+  self->prev = last;
+  self->next = NULL;
+  if (last)
+    last->next = self;
+  else
+    buffers = self;
+  last = self;
+  pthread_mutex_unlock(&lock);
+
+  return self;
+}
+
+anx_out_t *anx_io_out(void) { return &anx_out; }
+
+int32_t anx_io_putc(int32_t c) {
+  buffer_t *b = buffer();
+  if (anx_out.pos == anx_out.end)
+    flush(b);
+
+  *anx_out.pos++ = (char)c;
+  return c;
+}
+
+void anx_io_write(const void *p, uint64_t n) {
+  buffer_t *b = buffer();
+
+  // writes that would not fit anyway bypass the buffer
+  if (n >= OUT_SIZE) {
+    flush(b);
+    pthread_mutex_lock(&lock);
+    write_all(p, n);
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+
+  if (n > (uint64_t)(anx_out.end - anx_out.pos))
+    flush(b);
+
+  memcpy(anx_out.pos, p, n);
+  anx_out.pos += n;
+}
+
+char *anx_io_room(uint64_t n) {
+  buffer_t *b = buffer();
+  if (n > (uint64_t)(anx_out.end - anx_out.pos))
+    flush(b);
+  return anx_out.pos;
+}
+
+void anx_io_print(const anx_str_t *s) {
+  anx_io_write(anx_str_data(s), anx_str_len(s));
+}
+
+void anx_io_flush(void) {
+  if (self)
+    flush(self);
+}
+
+// refill the input buffer, returning 0 at the end of the input
+static int refill(void) {
+  if (in.eof)
+    return 0;
+  if (!in.data)
+    in.data = anx_alloc(IN_SIZE);
+
+  // whoever is reading probably wants to see the prompt first
+  anx_io_flush();
+
+  ssize_t r;
+  do
+    r = read(0, in.data, IN_SIZE);
+  while (r < 0 && errno == EINTR);
+
+  if (r <= 0) {
+    in.eof = 1;
+    return 0;
+  }
+
+  in.pos = in.data;
+  in.end = in.data + r;
+  return 1;
+}
+
+int64_t anx_io_read(void *p, uint64_t n) {
+  uint64_t have = in.end - in.pos;
+
+  if (!have) {
+    // large reads go straight into the caller's memory
+    if (n >= IN_SIZE && !in.eof) {
+      anx_io_flush();
+
+      ssize_t r;
+      do
+        r = read(0, p, n);
+      while (r < 0 && errno == EINTR);
+      return r < 0 ? -errno : r;
+    }
+
+    if (!refill())
+      return 0;
+    have = in.end - in.pos;
+  }
+
+  if (n > have)
+    n = have;
+
+  memcpy(p, in.pos, n);
+  in.pos += n;
+  return n;
+}
+
+void anx_io_readline(anx_str_t *out) {
+  char *line = NULL;
+  uint64_t len = 0;
+
+  while (in.pos != in.end || refill()) {
+    char *nl = memchr(in.pos, '\n', in.end - in.pos);
+    uint64_t n = (nl ? nl + 1 : in.end) - in.pos;
+
+    // the whole line is in the buffer: no need to copy it twice
+    if (!line && nl) {
+      anx_str_from(out, in.pos, n);
+      in.pos += n;
+      return;
+    }
+
+    line = anx_realloc(line, len + n);
+    memcpy(line + len, in.pos, n);
+    len += n;
+    in.pos += n;
+
+    if (nl)
+      break;
+  }
+
+  anx_str_from(out, line, len);
+  if (line)
+    anx_free(line);
+}
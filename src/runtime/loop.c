@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Loop - This module implements the event loop behind `async` and `await`.
+//
+// Async functions are LLVM coroutines. A coroutine that has to wait for a
+// timer or a file descriptor registers its handle here and suspends; the loop
+// resumes it once epoll reports the descriptor ready or the timerfd expires.
+// A coroutine that finishes puts the coroutine awaiting it on the ready queue.
+//
+// Every thread that calls @block_on drives its own loop, so coroutines always
+// resume on the thread that started them. Descriptors are registered with
+// EPOLLONESHOT and re-armed only while someone is waiting on them.
+//===---------------------------------------------------------------------===//
+
+typedef struct {
+  void *reader, *writer;
+  uint8_t added, nonblock;
+} fd_t;
+
+typedef struct {
+  uint64_t deadline; // CLOCK_MONOTONIC nanoseconds
+  void *h;
+} sleep_t;
+
+typedef struct {
+  int epoll, timer;
+
+  void **ready; // ring of handles to resume, cap is a power of two
+  uint64_t head, tail, cap;
+
+  sleep_t *heap; // min-heap of pending sleeps by deadline
+  uint64_t ntimers, timers_cap;
+  uint64_t armed; // deadline the timerfd is set to, or 0
+
+  fd_t *fds;
+  uint64_t nfds, waiters;
+} loop_t;
+
+static __thread loop_t loop = {.epoll = -1, .timer = -1};
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void fail(const char *what) {
+  fprintf(stderr, "anx: event loop: %s: %s\n", what, strerror(errno));
+  abort();
+}
+
+static void init(void) {
+  if (loop.epoll >= 0)
+    return;
+
+  loop.epoll = epoll_create1(EPOLL_CLOEXEC);
+  loop.timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (loop.epoll < 0 || loop.timer < 0)
+    fail("cannot create the event loop");
+
+  // the timerfd is the only descriptor that stays registered permanently
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = loop.timer};
+  if (epoll_ctl(loop.epoll, EPOLL_CTL_ADD, loop.timer, &ev) < 0)
+    fail("cannot register the timer");
+}
+
+// the first field of a coroutine frame is its resume function
+static inline void resume(void *h) {
+  void (*fn)(void *);
+  memcpy(&fn, h, sizeof(fn));
+  fn(h);
+}
+
+void anx_async_ready(void *h) {
+  if (loop.tail - loop.head == loop.cap) {
+    uint64_t cap = loop.cap ? loop.cap * 2 : 64;
+    void **ready = anx_alloc(cap * sizeof(void *));
+
+    for (uint64_t i = loop.head; i < loop.tail; i++)
+      ready[i & (cap - 1)] = loop.ready[i & (loop.cap - 1)];
+
+    if (loop.ready)
+      anx_free(loop.ready);
+    loop.ready = ready;
+    loop.cap = cap;
+  }
+
+  loop.ready[loop.tail++ & (loop.cap - 1)] = h;
+}
+
+void anx_async_sleep(uint64_t ms, void *h) {
+  init();
+
+  if (loop.ntimers == loop.timers_cap) {
+    loop.timers_cap = loop.timers_cap ? loop.timers_cap * 2 : 16;
+    loop.heap = anx_realloc(loop.heap, loop.timers_cap * sizeof(sleep_t));
+  }
+
+  sleep_t t = {now() + ms * 1000000, h};
+  uint64_t i = loop.ntimers++;
+
+  for (; i && loop.heap[(i - 1) / 2].deadline > t.deadline; i = (i - 1) / 2)
+    loop.heap[i] = loop.heap[(i - 1) / 2];
+  loop.heap[i] = t;
+}
+
+static void pop_timer(void) {
+  sleep_t last = loop.heap[--loop.ntimers];
+  uint64_t i = 0, n = loop.ntimers;
+
+  for (uint64_t c; (c = 2 * i + 1) < n; i = c) {
+    if (c + 1 < n && loop.heap[c + 1].deadline < loop.heap[c].deadline)
+      c++;
+    if (last.deadline <= loop.heap[c].deadline)
+      break;
+    loop.heap[i] = loop.heap[c];
+  }
+
+  if (n)
+    loop.heap[i] = last;
+}
+
+static fd_t *fd_state(int32_t fd) {
+  if ((uint64_t)fd >= loop.nfds) {
+    uint64_t n = loop.nfds ? loop.nfds : 64;
+    while (n <= (uint64_t)fd)
+      n *= 2;
+
+    loop.fds = anx_realloc(loop.fds, n * sizeof(fd_t));
+    memset(loop.fds + loop.nfds, 0, (n - loop.nfds) * sizeof(fd_t));
+    loop.nfds = n;
+  }
+
+  return &loop.fds[fd];
+}
+
+static void arm(int32_t fd, fd_t *f) {
+  struct epoll_event ev = {.data.fd = fd};
+  ev.events = EPOLLONESHOT | (f->reader ? EPOLLIN : 0) |
+              (f->writer ? EPOLLOUT : 0);
+
+  if (epoll_ctl(loop.epoll, f->added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd,
+                &ev) < 0)
+    fail("cannot wait for a file descriptor");
+  f->added = 1;
+}
+
+void anx_async_wait(int32_t fd, uint8_t out, void *h) {
+  init();
+
+  fd_t *f = fd_state(fd);
+  void **slot = out ? &f->writer : &f->reader;
+  if (*slot) {
+    fprintf(stderr, "anx: event loop: descriptor %d already has a %s\n", fd,
+            out ? "writer" : "reader");
+    abort();
+  }
+
+  *slot = h;
+  loop.waiters++;
+  arm(fd, f);
+}
+
+int64_t anx_async_try(int32_t fd, void *buf, uint64_t n, uint8_t out) {
+  if (fd < 0)
+    return -EBADF;
+
+  // descriptors are switched to non-blocking mode the first time they are
+  // used asynchronously
+  fd_t *f = fd_state(fd);
+  if (!f->nonblock) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+      return -errno;
+    f->nonblock = 1;
+  }
+
+  for (;;) {
+    ssize_t r = out ? write(fd, buf, n) : read(fd, buf, n);
+    if (r >= 0)
+      return r;
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return ANX_ASYNC_AGAIN;
+    if (errno != EINTR)
+      return -errno;
+  }
+}
+
+static void wake(int32_t fd, uint32_t events) {
+  fd_t *f = &loop.fds[fd];
+  uint32_t err = events & (EPOLLERR | EPOLLHUP);
+
+  // errors wake both sides, whose next attempt then reports them
+  if (f->reader && (events & EPOLLIN || err)) {
+    anx_async_ready(f->reader);
+    f->reader = NULL;
+    loop.waiters--;
+  }
+  if (f->writer && (events & EPOLLOUT || err)) {
+    anx_async_ready(f->writer);
+    f->writer = NULL;
+    loop.waiters--;
+  }
+
+  if (f->reader || f->writer)
+    arm(fd, f);
+}
+
+static void expire(void) {
+  uint64_t exp, t = now();
+  if (read(loop.timer, &exp, sizeof(exp)) < 0 && errno != EAGAIN)
+    fail("cannot read the timer");
+
+  loop.armed = 0;
+  while (loop.ntimers && loop.heap[0].deadline <= t) {
+    anx_async_ready(loop.heap[0].h);
+    pop_timer();
+  }
+}
+
+static void poll(void) {
+  // resume what is ready now; anything that becomes ready meanwhile waits for
+  // the next poll so that a busy coroutine cannot starve the others
+  if (loop.tail != loop.head) {
+    for (uint64_t end = loop.tail; loop.head != end;)
+      resume(loop.ready[loop.head++ & (loop.cap - 1)]);
+    return;
+  }
+
+  if (!loop.ntimers && !loop.waiters) {
+    fprintf(stderr, "anx: event loop: blocked on a future that can never "
+                    "complete\n");
+    abort();
+  }
+
+  uint64_t deadline = loop.ntimers ? loop.heap[0].deadline : 0;
+  if (deadline != loop.armed) {
+    struct itimerspec its = {
+        .it_value = {deadline / 1000000000, deadline % 1000000000}};
+    if (timerfd_settime(loop.timer, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+      fail("cannot set the timer");
+    loop.armed = deadline;
+  }
+
+  struct epoll_event events[64];
+  int n = epoll_wait(loop.epoll, events, 64, -1);
+  if (n < 0 && errno != EINTR)
+    fail("cannot wait for events");
+
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.fd == loop.timer)
+      expire();
+    else
+      wake(events[i].data.fd, events[i].events);
+  }
+}
+
+void anx_async_run(void *h) {
+  void *fn;
+  for (memcpy(&fn, h, sizeof(fn)); fn; memcpy(&fn, h, sizeof(fn)))
+    poll();
+}
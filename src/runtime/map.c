@@ -0,0 +1,274 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Map - This module implements the open addressing hash tables behind `map`.
+//
+// Tables follow the SwissTable design: keys and values live side by side in a
+// flat array of slots, and a parallel array holds one control byte per slot.
+// A control byte is either EMPTY, DELETED, or the low 7 bits of the hash of
+// the key in the slot (h2), so a lookup compares a whole group of 16 control
+// bytes against h2 with a single SIMD comparison and only inspects the slots
+// that match. The remaining hash bits (h1) select the first group to probe.
+//
+// Groups are aligned, so a probe sequence ends at the first group that has an
+// EMPTY byte; such a group can never have been full, and erasing from it does
+// not need to leave a tombstone behind.
+//===---------------------------------------------------------------------===//
+
+#define GROUP 16
+#define EMPTY 0x80
+#define DELETED 0xfe
+#define MIN_CAP 16
+
+struct anx_map {
+  uint8_t *ctrl;   // cap control bytes, directly after the slots
+  char *slots;     // cap slots of slot_size bytes: the key, then the value
+  uint64_t size;   // live entries
+  uint64_t cap;    // slots, a power of two and a multiple of GROUP (or 0)
+  uint64_t growth; // inserts into EMPTY slots left before a rehash
+  uint32_t key_size, val_off, slot_size;
+  uint8_t str_keys;
+};
+
+static inline uint8_t h2(uint64_t hash) { return hash & 0x7f; }
+
+// at most 7/8 of the slots may be in use
+static inline uint64_t max_load(uint64_t cap) { return cap - cap / 8; }
+
+// bitmask of the bytes of a group that equal c
+static inline unsigned match(const uint8_t *g, uint8_t c) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_load_si128((const __m128i *)g);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+  unsigned m = 0;
+  for (int i = 0; i < GROUP; i++)
+    m |= (unsigned)(g[i] == c) << i;
+  return m;
+#endif
+}
+
+// bitmask of the EMPTY or DELETED bytes of a group, whose top bit is set
+static inline unsigned match_free(const uint8_t *g) {
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *)g));
+#else
+  unsigned m = 0;
+  for (int i = 0; i < GROUP; i++)
+    m |= (unsigned)(g[i] >> 7) << i;
+  return m;
+#endif
+}
+
+static inline char *slot(const anx_map_t *m, uint64_t i) {
+  return m->slots + i * m->slot_size;
+}
+
+// the code generator hashes keys inline, so this must agree with it
+static uint64_t hash_key(const anx_map_t *m, const void *key) {
+  if (m->str_keys)
+    return anx_str_hash(key);
+
+  uint64_t lo = 0, hi = 0;
+  if (m->key_size > 8) {
+    memcpy(&lo, key, 8);
+    memcpy(&hi, (const char *)key + 8, m->key_size - 8);
+  } else
+    memcpy(&lo, key, m->key_size);
+
+  return anx_hash_int(lo ^ hi);
+}
+
+// fixed size comparisons for the common key widths avoid a call to memcmp
+#define EQ(T)                                                                  \
+  do {                                                                         \
+    T x, y;                                                                    \
+    memcpy(&x, a, sizeof(T));                                                  \
+    memcpy(&y, b, sizeof(T));                                                  \
+    return x == y;                                                             \
+  } while (0)
+
+static inline int key_eq(const anx_map_t *m, const void *a, const void *b) {
+  switch (m->key_size) {
+  case 1:
+    EQ(uint8_t);
+  case 2:
+    EQ(uint16_t);
+  case 4:
+    EQ(uint32_t);
+  case 8:
+    EQ(uint64_t);
+  }
+
+  if (m->str_keys)
+    return anx_str_eq(a, b);
+  return memcmp(a, b, m->key_size) == 0;
+}
+
+anx_map_t *anx_map_new(uint32_t key_size, uint32_t val_size, uint8_t str_keys) {
+  anx_map_t *m = anx_alloc(sizeof(anx_map_t));
+  memset(m, 0, sizeof(anx_map_t));
+
+  m->key_size = key_size;
+  m->val_off = (key_size + 7) & ~7u;
+  m->slot_size = (m->val_off + val_size + 7) & ~7u;
+  m->str_keys = str_keys;
+
+  return m;
+}
+
+void *anx_map_find(anx_map_t *m, const void *key, uint64_t hash) {
+  if (!m->size)
+    return NULL;
+
+  uint64_t mask = m->cap / GROUP - 1, g = (hash >> 7) & mask;
+
+  // triangular probing visits every group once since their count is a power
+  // of two
+  for (uint64_t step = 1;; g = (g + step++) & mask) {
+    const uint8_t *ctrl = m->ctrl + g * GROUP;
+
+    for (unsigned bits = match(ctrl, h2(hash)); bits; bits &= bits - 1) {
+      char *s = slot(m, g * GROUP + __builtin_ctz(bits));
+      if (key_eq(m, s, key))
+        return s + m->val_off;
+    }
+
+    if (match(ctrl, EMPTY))
+      return NULL;
+  }
+}
+
+// index of the first EMPTY or DELETED slot along the probe sequence of hash
+static uint64_t find_free(const anx_map_t *m, uint64_t hash) {
+  uint64_t mask = m->cap / GROUP - 1, g = (hash >> 7) & mask;
+
+  for (uint64_t step = 1;; g = (g + step++) & mask) {
+    unsigned bits = match_free(m->ctrl + g * GROUP);
+    if (bits)
+      return g * GROUP + __builtin_ctz(bits);
+  }
+}
+
+// rebuild the table with enough room for n entries, dropping tombstones
+static void resize(anx_map_t *m, uint64_t n) {
+  if (n < m->size)
+    n = m->size;
+
+  uint64_t cap = MIN_CAP;
+  while (max_load(cap) < n)
+    cap *= 2;
+
+  uint8_t *old_ctrl = m->ctrl;
+  char *old_slots = m->slots;
+  uint64_t old_cap = m->cap;
+
+  // slots come first so the control bytes stay 16 byte aligned
+  m->slots = anx_alloc(cap * m->slot_size + cap);
+  m->ctrl = (uint8_t *)m->slots + cap * m->slot_size;
+  m->cap = cap;
+  m->growth = max_load(cap) - m->size;
+  memset(m->ctrl, EMPTY, cap);
+
+  for (uint64_t i = 0; i < old_cap; i++) {
+    if (old_ctrl[i] & 0x80)
+      continue;
+
+    char *s = old_slots + i * m->slot_size;
+    uint64_t hash = hash_key(m, s), j = find_free(m, hash);
+
+    m->ctrl[j] = h2(hash);
+    memcpy(slot(m, j), s, m->slot_size);
+  }
+
+  if (old_slots)
+    anx_free(old_slots);
+}
+
+void *anx_map_insert(anx_map_t *m, const void *key, uint64_t hash) {
+  void *v = anx_map_find(m, key, hash);
+  if (v)
+    return v;
+
+  uint64_t i = m->cap ? find_free(m, hash) : 0;
+
+  // reusing a tombstone does not consume growth
+  if (!m->cap || (m->ctrl[i] == EMPTY && !m->growth)) {
+    // grow when the table is mostly live entries, otherwise only clean out
+    // the tombstones in place
+    resize(m, m->size * 2 + 1 > max_load(m->cap) ? m->size * 2 + 1 : m->size);
+    i = find_free(m, hash);
+  }
+
+  if (m->ctrl[i] == EMPTY)
+    m->growth--;
+  m->ctrl[i] = h2(hash);
+  m->size++;
+
+  char *s = slot(m, i);
+  memcpy(s, key, m->key_size);
+  memset(s + m->val_off, 0, m->slot_size - m->val_off);
+
+  return s + m->val_off;
+}
+
+uint8_t anx_map_erase(anx_map_t *m, const void *key, uint64_t hash) {
+  char *v = anx_map_find(m, key, hash);
+  if (!v)
+    return 0;
+
+  uint64_t i = (uint64_t)(v - m->val_off - m->slots) / m->slot_size;
+  uint8_t *group = m->ctrl + i / GROUP * GROUP;
+
+  if (match(group, EMPTY)) {
+    m->ctrl[i] = EMPTY;
+    m->growth++;
+  } else
+    m->ctrl[i] = DELETED;
+
+  m->size--;
+  return 1;
+}
+
+uint64_t anx_map_size(const anx_map_t *m) { return m->size; }
+
+void anx_map_reserve(anx_map_t *m, uint64_t n) {
+  if (n > m->size + m->growth)
+    resize(m, n);
+}
+
+void anx_map_rehash(anx_map_t *m, uint64_t n) { resize(m, n); }
+
+int64_t anx_map_next(const anx_map_t *m, int64_t i) {
+  uint64_t j = (uint64_t)(i + 1);
+
+  while (j < m->cap) {
+    uint64_t g = j / GROUP * GROUP;
+    unsigned bits = ~match_free(m->ctrl + g) & 0xffff;
+    bits &= 0xffffu << (j - g);
+
+    if (bits)
+      return (int64_t)(g + __builtin_ctz(bits));
+    j = g + GROUP;
+  }
+
+  return -1;
+}
+
+void *anx_map_key(const anx_map_t *m, int64_t i) { return slot(m, i); }
+
+void *anx_map_val(const anx_map_t *m, int64_t i) {
+  return slot(m, i) + m->val_off;
+}
+
+void anx_map_free(anx_map_t *m) {
+  if (m->slots)
+    anx_free(m->slots);
+  anx_free(m);
+}
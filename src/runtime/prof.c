@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Prof - This module implements the profiler behind `--instrument`.
+//
+// Instrumented functions call in on entry and on exit, and instrumented loops
+// report how many times they went around once they are left. Every thread
+// builds its own calling context tree: one node per distinct chain of calls,
+// holding the number of calls and the time spent in them. At exit the trees
+// of all threads are folded into a report sorted by inclusive time on
+// standard error, and into a file of folded stacks for flamegraph tools.
+//===---------------------------------------------------------------------===//
+
+typedef struct node {
+  uint32_t site;
+  uint64_t calls, ns; // ns includes the time spent in callees
+  struct node *parent, *child, *next; // first callee, and next sibling
+} node_t;
+
+typedef struct thread {
+  node_t root, *cur;
+  uint64_t *starts, depth, cap; // entry time of every call still running
+  uint64_t *loops;              // entries and trips of every loop site
+  struct thread *next;
+} thread_t;
+
+static const char *const *sites;
+static uint32_t nsites;
+
+static __thread thread_t *self;
+
+// every thread that has run instrumented code, so that all of them can be
+// reported at exit
+static thread_t *threads;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static thread_t *thread(void) {
+  if (self)
+    return self;
+
+  self = anx_alloc(sizeof(thread_t));
+  memset(self, 0, sizeof(thread_t));
+  self->root.site = UINT32_MAX;
+  self->cur = &self->root;
+  self->loops = anx_alloc((2 * nsites + 1) * sizeof(uint64_t));
+  memset(self->loops, 0, (2 * nsites + 1) * sizeof(uint64_t));
+
+  pthread_mutex_lock(&lock);
+  self->next = threads;
+  threads = self;
+  pthread_mutex_unlock(&lock);
+
+  return self;
+}
+
+// totals of one site over every thread
+typedef struct {
+  uint32_t site;
+  uint64_t calls, ns, self_ns;
+} total_t;
+
+// add up the subtree at n. the time of a call nested inside another call of
+// the same function is already part of the outer one, and is not counted
+// twice.
+static void total(const node_t *n, total_t *totals, uint32_t *open) {
+  total_t *t = &totals[n->site];
+  t->calls += n->calls;
+  if (!open[n->site])
+    t->ns += n->ns;
+
+  uint64_t callees = 0;
+  open[n->site]++;
+  for (const node_t *c = n->child; c; c = c->next) {
+    total(c, totals, open);
+    callees += c->ns;
+  }
+  open[n->site]--;
+
+  t->self_ns += n->ns > callees ? n->ns - callees : 0;
+}
+
+// write the folded stack of every node under n with its own time, as in
+// "main;sort;swap 1234"
+static void fold(FILE *f, const node_t *n, uint32_t *path, uint64_t depth) {
+  uint64_t callees = 0;
+  for (const node_t *c = n->child; c; c = c->next)
+    callees += c->ns;
+
+  if (n->ns > callees) {
+    for (uint64_t i = 0; i < depth; i++)
+      fprintf(f, "%s%s", i ? ";" : "", sites[path[i]]);
+    fprintf(f, " %llu\n", (unsigned long long)(n->ns - callees));
+  }
+
+  for (const node_t *c = n->child; c; c = c->next) {
+    path[depth] = c->site;
+    fold(f, c, path, depth + 1);
+  }
+}
+
+static uint64_t height(const node_t *n) {
+  uint64_t h = 0;
+  for (const node_t *c = n->child; c; c = c->next) {
+    uint64_t ch = height(c);
+    if (ch > h)
+      h = ch;
+  }
+  return h + 1;
+}
+
+static int by_time(const void *a, const void *b) {
+  const total_t *x = a, *y = b;
+  if (x->ns != y->ns)
+    return x->ns < y->ns ? 1 : -1;
+  return x->calls < y->calls ? 1 : x->calls > y->calls ? -1 : 0;
+}
+
+static void report(void) {
+  total_t *totals = calloc(nsites + 1, sizeof(total_t));
+  uint32_t *open = calloc(nsites + 1, sizeof(uint32_t));
+  uint64_t *loops = calloc(2 * nsites + 1, sizeof(uint64_t));
+  if (!totals || !open || !loops)
+    return;
+
+  pthread_mutex_lock(&lock);
+  for (thread_t *t = threads; t; t = t->next) {
+    for (const node_t *c = t->root.child; c; c = c->next)
+      total(c, totals, open);
+    for (uint32_t i = 0; i < 2 * nsites; i++)
+      loops[i] += t->loops[i];
+  }
+
+  for (uint32_t i = 0; i < nsites; i++)
+    totals[i].site = i;
+  qsort(totals, nsites, sizeof(total_t), by_time);
+
+  fprintf(stderr, "anx prof: %10s %12s %12s  %s\n", "calls", "incl ms",
+          "self ms", "function");
+  for (uint32_t i = 0; i < nsites && totals[i].calls; i++)
+    fprintf(stderr, "          %10llu %12.3f %12.3f  %s\n",
+            (unsigned long long)totals[i].calls, totals[i].ns / 1e6,
+            totals[i].self_ns / 1e6, sites[totals[i].site]);
+
+  int header = 0;
+  for (uint32_t i = 0; i < nsites; i++) {
+    if (!loops[2 * i])
+      continue;
+    if (!header++)
+      fprintf(stderr, "  %18s %12s %12s  %s\n", "entries", "trips",
+              "trips/entry", "loop");
+    fprintf(stderr, "  %18llu %12llu %12.1f  %s\n",
+            (unsigned long long)loops[2 * i],
+            (unsigned long long)loops[2 * i + 1],
+            (double)loops[2 * i + 1] / loops[2 * i], sites[i]);
+  }
+
+  const char *path = getenv("ANX_PROF_FOLDED");
+  FILE *f = fopen(path && *path ? path : "anx.folded", "w");
+  if (f) {
+    for (thread_t *t = threads; t; t = t->next) {
+      uint32_t *stack = calloc(height(&t->root), sizeof(uint32_t));
+      if (stack)
+        fold(f, &t->root, stack, 0);
+      free(stack);
+    }
+    fclose(f);
+  } else
+    perror(path && *path ? path : "anx.folded");
+  pthread_mutex_unlock(&lock);
+
+  free(totals);
+  free(open);
+  free(loops);
+}
+
+//===---------------------------------------------------------------------===//
+// Runtime interface
+//===---------------------------------------------------------------------===//
+
+void anx_prof_init(const char *const *names, uint32_t n) {
+  sites = names;
+  nsites = n;
+  atexit(report);
+}
+
+void anx_prof_enter(uint32_t site) {
+  thread_t *t = thread();
+
+  // the callee met most recently is moved to the front, so that hot calls
+  // are found right away
+  node_t **link = &t->cur->child, *n;
+  while ((n = *link) && n->site != site)
+    link = &n->next;
+
+  if (n)
+    *link = n->next;
+  else {
+    n = anx_alloc(sizeof(node_t));
+    memset(n, 0, sizeof(node_t));
+    n->site = site;
+    n->parent = t->cur;
+  }
+  n->next = t->cur->child;
+  t->cur->child = n;
+  t->cur = n;
+
+  if (t->depth == t->cap) {
+    t->cap = t->cap ? t->cap * 2 : 64;
+    t->starts = anx_realloc(t->starts, t->cap * sizeof(uint64_t));
+  }
+  t->starts[t->depth++] = now();
+}
+
+void anx_prof_exit(void) {
+  thread_t *t = self;
+  if (!t || !t->depth)
+    return;
+
+  node_t *n = t->cur;
+  n->calls++;
+  n->ns += now() - t->starts[--t->depth];
+  t->cur = n->parent;
+}
+
+void anx_prof_loop(uint32_t site, uint64_t trips) {
+  thread_t *t = thread();
+  t->loops[2 * site]++;
+  t->loops[2 * site + 1] += trips;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//===---------------------------------------------------------------------===//
+// Runtime - The native support library linked into every Anx executable.
+//
+// Everything in here is plain C with an unmangled `anx_` prefix so that the
+// code generator can declare these symbols directly from intrinsics.
+//===---------------------------------------------------------------------===//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// allocator statistics, aggregated over every thread that has allocated
+typedef struct {
+  uint64_t allocs, frees, reallocs;
+  uint64_t cache_hits, cache_misses; // thread cache fast path vs refills
+  uint64_t large_allocs, huge_allocs; // direct mappings (huge = 2MiB pages)
+  uint64_t bytes_live, bytes_mapped;
+} anx_alloc_stats_t;
+
+void *anx_alloc(uint64_t size);
+void *anx_realloc(void *ptr, uint64_t size);
+void anx_free(void *ptr);
+
+void anx_alloc_stats(anx_alloc_stats_t *out);
+void anx_alloc_stats_print(void);
+
+// register a callback that receives the final statistics at process exit
+void anx_alloc_set_hook(void (*hook)(const anx_alloc_stats_t *));
+
+// garbage collected objects: a 16 byte header followed by 8 byte slots. the
+// code generator accesses slots and the header flags inline, so the layout is
+// shared with it through these constants.
+#define ANX_GC_HDR 16
+#define ANX_GC_FLAGS 4
+#define ANX_GC_OLD 1
+#define ANX_GC_REFS 2
+
+// collector statistics, including a histogram of pause times where bucket i
+// counts pauses shorter than 2^i microseconds
+#define ANX_GC_BUCKETS 24
+
+typedef struct {
+  uint64_t minor, major, slices;
+  uint64_t bytes_allocated, bytes_promoted;
+  uint64_t nursery_size, old_live, large_live;
+  uint64_t pause_total_ns, pause_max_ns;
+  uint64_t pauses[ANX_GC_BUCKETS];
+} anx_gc_stats_t;
+
+void *anx_gc_new(uint64_t slots, uint8_t refs);
+void anx_gc_barrier(void *obj, void *prev, void *val);
+void anx_gc_collect(void);
+
+// report an object accessed as holding references when it holds integers,
+// or the reverse, and abort
+void anx_gc_mismatch(uint8_t refs) __attribute__((noreturn, cold));
+
+void anx_gc_stats(anx_gc_stats_t *out);
+void anx_gc_stats_print(void);
+
+// strings are 24 byte values. strings of up to ANX_STR_INLINE bytes are stored
+// inline, with their length in the last byte and its top bit set. otherwise
+// the value points at its bytes, and cap is the capacity of the runtime
+// allocated buffer it owns, or 0 for literals and slices that share another
+// string's bytes. owned buffers are prefixed by the number of bytes in use.
+#define ANX_STR_INLINE 23
+#define ANX_STR_TAG 0x80
+
+typedef struct {
+  const char *data;
+  uint64_t len;
+  uint64_t cap;
+} anx_str_t;
+
+static inline const char *anx_str_data(const anx_str_t *s) {
+  return ((const unsigned char *)s)[23] & ANX_STR_TAG ? (const char *)s
+                                                      : s->data;
+}
+
+static inline uint64_t anx_str_len(const anx_str_t *s) {
+  const unsigned char tag = ((const unsigned char *)s)[23];
+  return tag & ANX_STR_TAG ? tag & ~ANX_STR_TAG : s->len;
+}
+
+void anx_str_from(anx_str_t *out, const char *p, uint64_t n);
+void anx_str_slice(anx_str_t *out, const anx_str_t *s, uint64_t from,
+                   uint64_t to);
+void anx_str_concat(anx_str_t *out, const anx_str_t *a, const anx_str_t *b);
+uint8_t anx_str_eq(const anx_str_t *a, const anx_str_t *b);
+int32_t anx_str_cmp(const anx_str_t *a, const anx_str_t *b);
+int64_t anx_str_find(const anx_str_t *hay, const anx_str_t *needle);
+void anx_str_free(anx_str_t *s);
+uint64_t anx_str_hash(const anx_str_t *s);
+
+// maps are open addressing hash tables. keys of up to 16 bytes are hashed by
+// the code generator itself with the same mixing function as anx_hash_int
+typedef struct anx_map anx_map_t;
+
+static inline uint64_t anx_hash_int(uint64_t x) {
+  uint64_t h = x * 0x9e3779b97f4a7c15ull;
+  return h ^ (h >> 32);
+}
+
+anx_map_t *anx_map_new(uint32_t key_size, uint32_t val_size, uint8_t str_keys);
+void *anx_map_find(anx_map_t *m, const void *key, uint64_t hash);
+void *anx_map_insert(anx_map_t *m, const void *key, uint64_t hash);
+uint8_t anx_map_erase(anx_map_t *m, const void *key, uint64_t hash);
+uint64_t anx_map_size(const anx_map_t *m);
+void anx_map_reserve(anx_map_t *m, uint64_t n);
+void anx_map_rehash(anx_map_t *m, uint64_t n);
+int64_t anx_map_next(const anx_map_t *m, int64_t i);
+void *anx_map_key(const anx_map_t *m, int64_t i);
+void *anx_map_val(const anx_map_t *m, int64_t i);
+void anx_map_free(anx_map_t *m);
+
+// tasks run on a pool of worker threads. a spawned task calls fn(env), and
+// joining it waits for that call to return and hands env back to the caller.
+typedef struct anx_task anx_task_t;
+
+typedef struct {
+  uint64_t workers;
+  uint64_t spawned, executed;
+  uint64_t steals, failed_steals; // tasks taken from other deques, and scans
+                                  // of every deque that found nothing
+  uint64_t idle_ns;               // time workers spent without work
+  uint64_t max_depth;             // deepest any worker's deque has been
+} anx_sched_stats_t;
+
+anx_task_t *anx_spawn(void (*fn)(void *), void *env);
+void *anx_join(anx_task_t *task);
+
+void anx_sched_stats(anx_sched_stats_t *out);
+void anx_sched_stats_print(void);
+
+// standard output is buffered per thread. the code generator appends single
+// bytes inline through the current thread's cursor, and calls anx_io_putc
+// only once the buffer is full (or not allocated yet).
+typedef struct {
+  char *pos, *end;
+} anx_out_t;
+
+extern __thread anx_out_t anx_out;
+
+// the current thread's cursor, for code that cannot address anx_out itself
+// because it is linked into the process at run time
+anx_out_t *anx_io_out(void);
+
+int32_t anx_io_putc(int32_t c);
+void anx_io_write(const void *p, uint64_t n);
+void anx_io_flush(void);
+char *anx_io_room(uint64_t n);
+int64_t anx_io_read(void *p, uint64_t n);
+void anx_io_readline(anx_str_t *out);
+void anx_io_print(const anx_str_t *s);
+
+// numbers are formatted into a caller provided buffer of ANX_FMT_MAX bytes,
+// and every function returns the number of bytes written
+#define ANX_FMT_MAX 48
+
+__extension__ typedef __int128 anx_i128_t;
+__extension__ typedef unsigned __int128 anx_u128_t;
+
+uint64_t anx_fmt_u64(char *out, uint64_t x);
+uint64_t anx_fmt_i64(char *out, int64_t x);
+uint64_t anx_fmt_u128(char *out, anx_u128_t x);
+uint64_t anx_fmt_i128(char *out, anx_i128_t x);
+uint64_t anx_fmt_f64(char *out, double x);
+uint64_t anx_fmt_f32(char *out, float x);
+uint64_t anx_fmt_bool(char *out, uint8_t x);
+uint64_t anx_fmt_ptr(char *out, const void *p);
+
+int64_t anx_parse_i64(const anx_str_t *s);
+double anx_parse_f64(const anx_str_t *s);
+
+// async functions are coroutines resumed by a per-thread event loop. a handle
+// is an LLVM coroutine frame, whose first field is its resume function, or
+// null once the coroutine has completed.
+#define ANX_ASYNC_AGAIN (-11)
+
+void anx_async_ready(void *h);
+void anx_async_sleep(uint64_t ms, void *h);
+void anx_async_wait(int32_t fd, uint8_t out, void *h);
+int64_t anx_async_try(int32_t fd, void *buf, uint64_t n, uint8_t out);
+void anx_async_run(void *h);
+
+// --instrument profiles functions and loops, each identified by the index of
+// its site in the table of names registered before main runs. loops report
+// their trip count once they are left.
+void anx_prof_init(const char *const *sites, uint32_t n);
+void anx_prof_enter(uint32_t site);
+void anx_prof_exit(void);
+void anx_prof_loop(uint32_t site, uint64_t trips);
+
+#ifdef __cplusplus
+}
+#endif
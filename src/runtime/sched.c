@@ -0,0 +1,417 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Sched - This module implements the work-stealing scheduler behind `spawn`.
+//
+// One worker thread is started per core the first time a task is spawned.
+// Every worker owns a Chase-Lev deque: it pushes and pops tasks at the bottom
+// without any locks, while idle workers steal from the top of other deques.
+// Threads that are not workers (such as the main thread) hand their tasks to
+// a shared injection queue instead, which workers drain in batches.
+//
+// Joining a task that has not finished yet does not block the thread: it runs
+// other tasks until the joined one completes, so nested spawns cannot
+// deadlock the pool. Workers with nothing to do spin briefly and then sleep
+// until more work is spawned.
+//===---------------------------------------------------------------------===//
+
+#define MAX_WORKERS 256
+#define DEQUE_MIN 256
+#define SPIN 64
+#define INJECT_BATCH 32
+
+struct anx_task {
+  void (*fn)(void *);
+  void *env;
+  struct anx_task *next; // link in the injection queue
+  atomic_int done;
+};
+
+typedef struct array {
+  int64_t size;       // a power of two
+  struct array *prev; // arrays replaced by this one, which thieves may still
+                      // be reading; they are never freed
+  _Atomic(anx_task_t *) buf[];
+} array_t;
+
+typedef struct {
+  _Alignas(64) atomic_int_fast64_t top;
+  _Alignas(64) atomic_int_fast64_t bottom;
+  _Atomic(array_t *) array;
+
+  atomic_uint_fast64_t spawned, executed, steals, failed_steals;
+  atomic_uint_fast64_t idle_ns, max_depth;
+  pthread_t thread;
+} worker_t;
+
+static worker_t workers[MAX_WORKERS];
+static int nworkers;
+static __thread int self = -1; // index of the current worker, if any
+
+// tasks spawned by threads that are not workers
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+static anx_task_t *inject_head, *inject_tail;
+static atomic_uint_fast64_t injected;
+
+// idle workers sleep until the epoch changes
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static atomic_uint_fast64_t epoch;
+static atomic_int sleepers;
+
+// counters of the threads that are not workers
+static atomic_uint_fast64_t ext_spawned, ext_executed, ext_steals;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static uint64_t now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline void add(atomic_uint_fast64_t *c, uint64_t n) {
+  atomic_fetch_add_explicit(c, n, memory_order_relaxed);
+}
+
+//===---------------------------------------------------------------------===//
+// Chase-Lev deques, following the C11 formulation by Le et al. (PPoPP 2013)
+//===---------------------------------------------------------------------===//
+
+static array_t *array_new(int64_t size) {
+  array_t *a = anx_alloc(sizeof(array_t) + size * sizeof(anx_task_t *));
+  a->size = size;
+  a->prev = NULL;
+  return a;
+}
+
+static void push(worker_t *w, anx_task_t *t) {
+  int64_t b = atomic_load_explicit(&w->bottom, memory_order_relaxed);
+  int64_t top = atomic_load_explicit(&w->top, memory_order_acquire);
+  array_t *a = atomic_load_explicit(&w->array, memory_order_relaxed);
+
+  if (b - top > a->size - 1) {
+    array_t *g = array_new(a->size * 2);
+    for (int64_t i = top; i < b; i++)
+      atomic_store_explicit(
+          &g->buf[i & (g->size - 1)],
+          atomic_load_explicit(&a->buf[i & (a->size - 1)],
+                               memory_order_relaxed),
+          memory_order_relaxed);
+
+    g->prev = a;
+    atomic_store_explicit(&w->array, g, memory_order_release);
+    a = g;
+  }
+
+  if ((uint64_t)(b - top + 1) >
+      atomic_load_explicit(&w->max_depth, memory_order_relaxed))
+    atomic_store_explicit(&w->max_depth, b - top + 1, memory_order_relaxed);
+
+  atomic_store_explicit(&a->buf[b & (a->size - 1)], t, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+}
+
+static anx_task_t *take(worker_t *w) {
+  int64_t b = atomic_load_explicit(&w->bottom, memory_order_relaxed) - 1;
+  array_t *a = atomic_load_explicit(&w->array, memory_order_relaxed);
+  atomic_store_explicit(&w->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&w->top, memory_order_relaxed);
+
+  if (t > b) { // empty
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  anx_task_t *x =
+      atomic_load_explicit(&a->buf[b & (a->size - 1)], memory_order_relaxed);
+
+  // the last task may be stolen concurrently; whoever moves top wins it
+  if (t == b) {
+    if (!atomic_compare_exchange_strong_explicit(&w->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+      x = NULL;
+    atomic_store_explicit(&w->bottom, b + 1, memory_order_relaxed);
+  }
+
+  return x;
+}
+
+static anx_task_t *steal(worker_t *w) {
+  int64_t t = atomic_load_explicit(&w->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&w->bottom, memory_order_acquire);
+
+  if (t >= b)
+    return NULL;
+
+  array_t *a = atomic_load_explicit(&w->array, memory_order_acquire);
+  anx_task_t *x =
+      atomic_load_explicit(&a->buf[t & (a->size - 1)], memory_order_relaxed);
+
+  if (!atomic_compare_exchange_strong_explicit(
+          &w->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+    return NULL;
+
+  return x;
+}
+
+//===---------------------------------------------------------------------===//
+// Workers
+//===---------------------------------------------------------------------===//
+
+// take a batch of tasks from the injection queue. a worker keeps the first
+// and pushes the rest onto its own deque, where other workers can steal them.
+static anx_task_t *drain(void) {
+  if (!atomic_load_explicit(&injected, memory_order_relaxed))
+    return NULL;
+
+  pthread_mutex_lock(&inject_lock);
+
+  uint64_t n = atomic_load_explicit(&injected, memory_order_relaxed);
+  uint64_t want = self < 0 ? 1 : n / nworkers + 1;
+  if (want > INJECT_BATCH)
+    want = INJECT_BATCH;
+  if (want > n)
+    want = n;
+
+  anx_task_t *first = inject_head, *last = first;
+  for (uint64_t i = 1; i < want; i++)
+    last = last->next;
+
+  if (first) {
+    inject_head = last->next;
+    if (!inject_head)
+      inject_tail = NULL;
+    last->next = NULL;
+  }
+
+  atomic_store_explicit(&injected, n - want, memory_order_relaxed);
+  pthread_mutex_unlock(&inject_lock);
+
+  // read each link before pushing, since a pushed task may be stolen, run
+  // and freed right away
+  if (first && self >= 0)
+    for (anx_task_t *t = first->next, *next; t; t = next) {
+      next = t->next;
+      push(&workers[self], t);
+    }
+
+  return first;
+}
+
+static anx_task_t *find_work(uint64_t *seed) {
+  anx_task_t *t;
+
+  if (self >= 0 && (t = take(&workers[self])))
+    return t;
+  if ((t = drain()))
+    return t;
+
+  // probe the other deques starting from a random victim
+  *seed ^= *seed << 13, *seed ^= *seed >> 7, *seed ^= *seed << 17;
+  for (int i = 0; i < nworkers; i++) {
+    int v = (*seed + i) % nworkers;
+    if (v == self)
+      continue;
+
+    if ((t = steal(&workers[v]))) {
+      add(self >= 0 ? &workers[self].steals : &ext_steals, 1);
+      return t;
+    }
+  }
+
+  if (self >= 0)
+    add(&workers[self].failed_steals, 1);
+  return NULL;
+}
+
+static void run(anx_task_t *t) {
+  t->fn(t->env);
+  atomic_store_explicit(&t->done, 1, memory_order_release);
+  add(self >= 0 ? &workers[self].executed : &ext_executed, 1);
+}
+
+static void *worker(void *arg) {
+  self = (int)(intptr_t)arg;
+  worker_t *w = &workers[self];
+  uint64_t seed = (uintptr_t)w | 1;
+
+  while (1) {
+    anx_task_t *t = find_work(&seed);
+    if (t) {
+      run(t);
+      continue;
+    }
+
+    uint64_t start = now();
+
+    for (int i = 0; i < SPIN && !t; i++) {
+      relax();
+      t = find_work(&seed);
+    }
+
+    // sleep until a task is spawned. the epoch is read before the last look
+    // for work, so a spawn in between is never missed.
+    while (!t) {
+      uint64_t e = atomic_load(&epoch);
+      if ((t = find_work(&seed)))
+        break;
+
+      pthread_mutex_lock(&sleep_lock);
+      atomic_fetch_add(&sleepers, 1);
+      while (atomic_load(&epoch) == e)
+        pthread_cond_wait(&wake, &sleep_lock);
+      atomic_fetch_sub(&sleepers, 1);
+      pthread_mutex_unlock(&sleep_lock);
+    }
+
+    add(&w->idle_ns, now() - start);
+    run(t);
+  }
+
+  return NULL;
+}
+
+static void report(void) {
+  const char *env = getenv("ANX_SCHED_STATS");
+  if (env && *env && *env != '0')
+    anx_sched_stats_print();
+}
+
+static void setup(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *env = getenv("ANX_WORKERS");
+  if (env && atol(env) > 0)
+    n = atol(env);
+  if (n < 1)
+    n = 1;
+  if (n > MAX_WORKERS)
+    n = MAX_WORKERS;
+
+  nworkers = (int)n;
+  for (int i = 0; i < nworkers; i++)
+    workers[i].array = array_new(DEQUE_MIN);
+
+  for (int i = 0; i < nworkers; i++) {
+    pthread_create(&workers[i].thread, NULL, worker, (void *)(intptr_t)i);
+    pthread_detach(workers[i].thread);
+  }
+
+  atexit(report);
+}
+
+//===---------------------------------------------------------------------===//
+// Runtime interface
+//===---------------------------------------------------------------------===//
+
+anx_task_t *anx_spawn(void (*fn)(void *), void *env) {
+  pthread_once(&once, setup);
+
+  anx_task_t *t = anx_alloc(sizeof(anx_task_t));
+  t->fn = fn;
+  t->env = env;
+  t->next = NULL;
+  atomic_init(&t->done, 0);
+
+  if (self >= 0) {
+    push(&workers[self], t);
+    add(&workers[self].spawned, 1);
+  } else {
+    pthread_mutex_lock(&inject_lock);
+    if (inject_tail)
+      inject_tail->next = t;
+    else
+      inject_head = t;
+    inject_tail = t;
+    atomic_fetch_add_explicit(&injected, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&inject_lock);
+    add(&ext_spawned, 1);
+  }
+
+  atomic_fetch_add(&epoch, 1);
+  if (atomic_load(&sleepers)) {
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&sleep_lock);
+  }
+
+  return t;
+}
+
+void *anx_join(anx_task_t *t) {
+  uint64_t seed = (uintptr_t)&seed | 1;
+
+  // help with other work until the task is done
+  while (!atomic_load_explicit(&t->done, memory_order_acquire)) {
+    anx_task_t *o = find_work(&seed);
+    if (o)
+      run(o);
+    else
+      sched_yield();
+  }
+
+  void *env = t->env;
+  anx_free(t);
+  return env;
+}
+
+void anx_sched_stats(anx_sched_stats_t *out) {
+  anx_sched_stats_t s = {0};
+  s.workers = nworkers;
+  s.spawned = ext_spawned;
+  s.executed = ext_executed;
+  s.steals = ext_steals;
+
+  for (int i = 0; i < nworkers; i++) {
+    worker_t *w = &workers[i];
+    s.spawned += w->spawned;
+    s.executed += w->executed;
+    s.steals += w->steals;
+    s.failed_steals += w->failed_steals;
+    s.idle_ns += w->idle_ns;
+    if (w->max_depth > s.max_depth)
+      s.max_depth = w->max_depth;
+  }
+
+  *out = s;
+}
+
+void anx_sched_stats_print(void) {
+  anx_sched_stats_t s;
+  anx_sched_stats(&s);
+
+  fprintf(stderr,
+          "anx sched: %llu workers, %llu spawned, %llu executed\n"
+          "  steals:  %llu, %llu failed attempts\n"
+          "  idle:    %.3f ms total\n"
+          "  queues:  %llu max depth\n",
+          (unsigned long long)s.workers, (unsigned long long)s.spawned,
+          (unsigned long long)s.executed, (unsigned long long)s.steals,
+          (unsigned long long)s.failed_steals, s.idle_ns / 1e6,
+          (unsigned long long)s.max_depth);
+
+  for (int i = 0; i < nworkers; i++)
+    fprintf(stderr, "  worker %3d: %llu executed, %llu steals, %.3f ms idle\n",
+            i, (unsigned long long)workers[i].executed,
+            (unsigned long long)workers[i].steals, workers[i].idle_ns / 1e6);
+}
@@ -0,0 +1,194 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "rt.h"
+
+//===---------------------------------------------------------------------===//
+// Str - This module implements the string operations behind `str`.
+//
+// Short strings never touch the allocator: they are stored inline in the
+// value itself (see rt.h). Slicing a longer string produces a view that shares
+// its bytes, and appending to the string that ends an owned buffer grows that
+// buffer in place, so building a string up piece by piece is amortized O(1).
+//===---------------------------------------------------------------------===//
+
+static inline int is_inline(const anx_str_t *s) {
+  return ((const unsigned char *)s)[23] & ANX_STR_TAG;
+}
+
+static inline const char *data(const anx_str_t *s) { return anx_str_data(s); }
+static inline uint64_t len(const anx_str_t *s) { return anx_str_len(s); }
+
+// bytes in use of the owned buffer a string points into
+static inline uint64_t *used(const anx_str_t *s) {
+  return (uint64_t *)s->data - 1;
+}
+
+static void make_inline(anx_str_t *out, const char *p, uint64_t n) {
+  char tmp[24] = {0};
+  memcpy(tmp, p, n);
+  tmp[23] = (char)(ANX_STR_TAG | n);
+  memcpy(out, tmp, 24);
+}
+
+// index of the first differing byte of a and b, or n if they are equal
+static uint64_t mismatch(const char *a, const char *b, uint64_t n) {
+  uint64_t i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+    if (m)
+      return i + __builtin_ctz(m);
+  }
+#endif
+
+  while (i < n && a[i] == b[i])
+    i++;
+  return i;
+}
+
+void anx_str_from(anx_str_t *out, const char *p, uint64_t n) {
+  if (n <= ANX_STR_INLINE) {
+    make_inline(out, p, n);
+    return;
+  }
+
+  uint64_t *buf = anx_alloc(sizeof(uint64_t) + n);
+  memcpy(buf + 1, p, n);
+  *buf = n;
+
+  out->data = (const char *)(buf + 1);
+  out->len = n;
+  out->cap = n;
+}
+
+void anx_str_slice(anx_str_t *out, const anx_str_t *s, uint64_t from,
+                   uint64_t to) {
+  uint64_t n = len(s);
+  if (to > n)
+    to = n;
+  if (from > to)
+    from = to;
+
+  if (is_inline(s) || to - from <= ANX_STR_INLINE) {
+    make_inline(out, data(s) + from, to - from);
+    return;
+  }
+
+  out->data = s->data + from;
+  out->len = to - from;
+  out->cap = 0;
+}
+
+void anx_str_concat(anx_str_t *out, const anx_str_t *a, const anx_str_t *b) {
+  uint64_t an = len(a), bn = len(b), n = an + bn;
+
+  if (n <= ANX_STR_INLINE) {
+    char tmp[ANX_STR_INLINE];
+    memcpy(tmp, data(a), an);
+    memcpy(tmp + an, data(b), bn);
+    make_inline(out, tmp, n);
+    return;
+  }
+
+  // a ends its owned buffer and there is room: append in place. the result
+  // owns the buffer from then on, and the code generator leaves the variable
+  // a came from as a view of it, with a cap of 0 (see intr::appended)
+  if (!is_inline(a) && a->cap && *used(a) == an && n <= a->cap) {
+    memcpy((char *)a->data + an, data(b), bn);
+    *used(a) = n;
+
+    out->data = a->data;
+    out->len = n;
+    out->cap = a->cap;
+    return;
+  }
+
+  uint64_t cap = n * 2 < 64 ? 64 : n * 2;
+  uint64_t *buf = anx_alloc(sizeof(uint64_t) + cap);
+  char *p = (char *)(buf + 1);
+
+  memcpy(p, data(a), an);
+  memcpy(p + an, data(b), bn);
+  *buf = n;
+
+  out->data = p;
+  out->len = n;
+  out->cap = cap;
+}
+
+uint8_t anx_str_eq(const anx_str_t *a, const anx_str_t *b) {
+  uint64_t n = len(a);
+  return n == len(b) && mismatch(data(a), data(b), n) == n;
+}
+
+int32_t anx_str_cmp(const anx_str_t *a, const anx_str_t *b) {
+  uint64_t an = len(a), bn = len(b), n = an < bn ? an : bn;
+  uint64_t i = mismatch(data(a), data(b), n);
+
+  if (i < n)
+    return (unsigned char)data(a)[i] < (unsigned char)data(b)[i] ? -1 : 1;
+
+  return an < bn ? -1 : an > bn;
+}
+
+int64_t anx_str_find(const anx_str_t *hay, const anx_str_t *needle) {
+  const char *h = data(hay), *s = data(needle);
+  uint64_t hn = len(hay), sn = len(needle), i = 0;
+
+  if (!sn)
+    return 0;
+  if (sn > hn)
+    return -1;
+
+#ifdef __SSE2__
+  // compare the first and last needle bytes against 16 positions at once and
+  // only verify the candidates where both match
+  __m128i first = _mm_set1_epi8(s[0]), last = _mm_set1_epi8(s[sn - 1]);
+
+  for (; i + sn - 1 + 16 <= hn; i += 16) {
+    __m128i f = _mm_loadu_si128((const __m128i *)(h + i));
+    __m128i l = _mm_loadu_si128((const __m128i *)(h + i + sn - 1));
+    unsigned m = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+
+    while (m) {
+      unsigned bit = __builtin_ctz(m);
+      if (mismatch(h + i + bit, s, sn) == sn)
+        return i + bit;
+      m &= m - 1;
+    }
+  }
+#endif
+
+  for (; i + sn <= hn; i++)
+    if (h[i] == s[0] && mismatch(h + i, s, sn) == sn)
+      return i;
+
+  return -1;
+}
+
+void anx_str_free(anx_str_t *s) {
+  if (!is_inline(s) && s->cap)
+    anx_free(used(s));
+}
+
+uint64_t anx_str_hash(const anx_str_t *s) {
+  const unsigned char *p = (const unsigned char *)data(s);
+  uint64_t n = len(s), h = n * 0x9e3779b97f4a7c15ull, w;
+
+  for (; n >= 8; p += 8, n -= 8) {
+    memcpy(&w, p, 8);
+    h = anx_hash_int(h ^ w);
+  }
+
+  w = 0;
+  memcpy(&w, p, n);
+  return anx_hash_int(h ^ w);
+}
@@ -0,0 +1,299 @@
+#include <mutex>
+#include <pthread.h>
+#include <sstream>
+#include <unistd.h>
+
+#include "session.h"
+#include "anx.h"
+#include "assembly/printer.h"
+#include "codegen/ir.h"
+#include "frontend/ast.h"
+#include "frontend/lexer.h"
+#include "runtime/rt.h"
+
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+//===---------------------------------------------------------------------===//
+// Session - This module embeds the compiler in other programs.
+//
+// A unit is compiled as anx.cpp compiles a module, into object code, but on
+// a thread of its own that the session waits for. The compiler's state is
+// thread local, so every unit starts from a clean slate whatever else is
+// being compiled, and an error can end the thread without ending the
+// program. The object code is then linked into the process by an ORC JIT.
+//===---------------------------------------------------------------------===//
+
+// the runtime functions generated code calls, which the program that links
+// libanx.a need not export. the garbage collector and the --instrument
+// profiler are left out, as their tables are only found in executables.
+const std::pair<const char *, void *> runtime[] = {
+    {"anx_alloc", (void *)anx_alloc},
+    {"anx_realloc", (void *)anx_realloc},
+    {"anx_free", (void *)anx_free},
+    {"anx_alloc_stats_print", (void *)anx_alloc_stats_print},
+    {"anx_str_from", (void *)anx_str_from},
+    {"anx_str_slice", (void *)anx_str_slice},
+    {"anx_str_concat", (void *)anx_str_concat},
+    {"anx_str_eq", (void *)anx_str_eq},
+    {"anx_str_cmp", (void *)anx_str_cmp},
+    {"anx_str_find", (void *)anx_str_find},
+    {"anx_str_free", (void *)anx_str_free},
+    {"anx_str_hash", (void *)anx_str_hash},
+    {"anx_map_new", (void *)anx_map_new},
+    {"anx_map_find", (void *)anx_map_find},
+    {"anx_map_insert", (void *)anx_map_insert},
+    {"anx_map_erase", (void *)anx_map_erase},
+    {"anx_map_size", (void *)anx_map_size},
+    {"anx_map_reserve", (void *)anx_map_reserve},
+    {"anx_map_rehash", (void *)anx_map_rehash},
+    {"anx_map_next", (void *)anx_map_next},
+    {"anx_map_key", (void *)anx_map_key},
+    {"anx_map_val", (void *)anx_map_val},
+    {"anx_map_free", (void *)anx_map_free},
+    {"anx_spawn", (void *)anx_spawn},
+    {"anx_join", (void *)anx_join},
+    {"anx_sched_stats_print", (void *)anx_sched_stats_print},
+    {"anx_io_out", (void *)anx_io_out},
+    {"anx_io_putc", (void *)anx_io_putc},
+    {"anx_io_write", (void *)anx_io_write},
+    {"anx_io_flush", (void *)anx_io_flush},
+    {"anx_io_room", (void *)anx_io_room},
+    {"anx_io_read", (void *)anx_io_read},
+    {"anx_io_readline", (void *)anx_io_readline},
+    {"anx_io_print", (void *)anx_io_print},
+    {"anx_fmt_bool", (void *)anx_fmt_bool},
+    {"anx_fmt_ptr", (void *)anx_fmt_ptr},
+    {"anx_fmt_i64", (void *)anx_fmt_i64},
+    {"anx_fmt_u64", (void *)anx_fmt_u64},
+    {"anx_fmt_i128", (void *)anx_fmt_i128},
+    {"anx_fmt_u128", (void *)anx_fmt_u128},
+    {"anx_fmt_f32", (void *)anx_fmt_f32},
+    {"anx_fmt_f64", (void *)anx_fmt_f64},
+    {"anx_parse_i64", (void *)anx_parse_i64},
+    {"anx_parse_f64", (void *)anx_parse_f64},
+    {"anx_async_ready", (void *)anx_async_ready},
+    {"anx_async_sleep", (void *)anx_async_sleep},
+    {"anx_async_wait", (void *)anx_async_wait},
+    {"anx_async_try", (void *)anx_async_try},
+    {"anx_async_run", (void *)anx_async_run}};
+
+struct anx::CompilerSession::Impl {
+  Options opts;
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  std::vector<Diagnostic> diags;
+
+  void error(llvm::Error err) {
+    diags.push_back({Diagnostic::error, llvm::toString(std::move(err)), 0, 0,
+                     0});
+  }
+};
+
+// lists the functions of the objects the JIT loads in /tmp/perf-<pid>.map,
+// one "address size name" line each, which perf reads to name the samples
+// that fall into memory no file is mapped to. all sessions share the file.
+class PerfMap : public llvm::JITEventListener {
+  std::mutex lock;
+
+  void notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile &obj,
+                          const llvm::RuntimeDyld::LoadedObjectInfo &info)
+      override {
+    // a copy of the object with its sections at the addresses they got
+    auto loaded = info.getObjectForDebug(obj);
+    if (!loaded.getBinary())
+      return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    FILE *f = fopen(("/tmp/perf-" + std::to_string(getpid()) + ".map").c_str(),
+                    "a");
+    if (!f)
+      return;
+
+    for (auto [sym, size] :
+         llvm::object::computeSymbolSizes(*loaded.getBinary())) {
+      auto type = sym.getType();
+      if (!type || *type != llvm::object::SymbolRef::ST_Function) {
+        llvm::consumeError(type.takeError());
+        continue;
+      }
+
+      auto name = sym.getName();
+      auto addr = sym.getAddress();
+      if (name && addr && size)
+        fprintf(f, "%llx %llx %s\n", (unsigned long long)*addr,
+                (unsigned long long)size, name->str().c_str());
+      llvm::consumeError(name.takeError());
+      llvm::consumeError(addr.takeError());
+    }
+
+    fclose(f);
+  }
+};
+
+// a unit to compile, as handed to the thread that compiles it
+struct Job {
+  const std::string &source, &name;
+  anx::CompilerSession::Options opts;
+  std::vector<anx::Diagnostic> &diags;
+  llvm::SmallVector<char, 0> object;
+};
+
+// compile a unit into object code, or return null if it has errors. anx::perr
+// ends the thread before this returns, unwinding it so that the AST, the
+// module and everything else the compile allocated is freed.
+void *build(void *arg) {
+  Job &job = *(Job *)arg;
+
+  anx::diagnostics = &job.diags;
+  anx::file = job.name;
+  ir::is_module = true; // there is no main() to call
+  ir::jit = true;
+  ir::nsw = job.opts.no_overflow;
+  if (job.opts.fast_math)
+    ir::fmf.setFast();
+
+  std::istringstream in(job.source);
+  anx::stream = &in;
+
+  lex::eat(); // generate the first token
+  auto prog = ast::unit();
+
+  printer::init();
+  ir::init(printer::machine.get());
+  // jitdump records carry the source lines of the code they describe
+  if (job.opts.perf)
+    ir::dwarf(job.name);
+
+  prog->codegen();
+
+  // the collector finds its roots through stack maps, which are only
+  // registered for executables
+  if (ir::mod->getFunction("anx_gc_new"))
+    anx::perr("garbage collected objects cannot be allocated in a session");
+
+  llvm::raw_svector_ostream dest(job.object);
+  printer::emit(dest);
+  return &job;
+}
+
+anx::CompilerSession::CompilerSession() : CompilerSession(Options()) {}
+
+anx::CompilerSession::CompilerSession(Options opts)
+    : impl(std::make_unique<Impl>()) {
+  impl->opts = opts;
+
+  printer::targets();
+
+  llvm::orc::LLJITBuilder builder;
+
+  // JIT event listeners are only told about code that RuntimeDyld links
+  if (opts.perf_map || opts.perf)
+    builder.setObjectLinkingLayerCreator(
+        [opts](llvm::orc::ExecutionSession &ES, const llvm::Triple &)
+            -> llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>> {
+          auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+              ES, [] { return std::make_unique<llvm::SectionMemoryManager>(); });
+          static PerfMap map;
+          if (opts.perf_map)
+            layer->registerJITEventListener(map);
+          // creating the jitdump listener opens its file
+          if (opts.perf)
+            if (auto *perf =
+                    llvm::JITEventListener::createPerfJITEventListener())
+              layer->registerJITEventListener(*perf);
+          return std::move(layer);
+        });
+
+  auto jit = builder.create();
+  if (!jit) {
+    impl->error(jit.takeError());
+    return;
+  }
+  impl->jit = std::move(*jit);
+
+  // symbols that cannot be resolved are reported by the lookup that needs
+  // them, instead of on standard error
+  Impl *self = impl.get();
+  impl->jit->getExecutionSession().setErrorReporter(
+      [self](llvm::Error err) { self->error(std::move(err)); });
+
+  for (auto [name, addr] : runtime)
+    define(name, addr);
+
+  // C functions come from the libraries the program is linked with
+  auto process =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          impl->jit->getDataLayout().getGlobalPrefix());
+  if (!process) {
+    impl->error(process.takeError());
+    return;
+  }
+  impl->jit->getMainJITDylib().addGenerator(std::move(*process));
+}
+
+anx::CompilerSession::~CompilerSession() = default;
+
+bool anx::CompilerSession::compile(const std::string &source,
+                                   const std::string &name) {
+  if (!impl->jit)
+    return false;
+  impl->diags.clear();
+
+  Job job{source, name, impl->opts, impl->diags, {}};
+
+  pthread_t thread;
+  void *done = nullptr;
+  if (pthread_create(&thread, nullptr, build, &job)) {
+    impl->diags.push_back({Diagnostic::error,
+                           "could not start a thread to compile on", 0, 0, 0});
+    return false;
+  }
+  pthread_join(thread, &done);
+  if (!done)
+    return false;
+
+  auto object = llvm::MemoryBuffer::getMemBufferCopy(
+      llvm::StringRef(job.object.data(), job.object.size()), name);
+  if (llvm::Error err = impl->jit->addObjectFile(std::move(object))) {
+    impl->error(std::move(err));
+    return false;
+  }
+
+  return true;
+}
+
+void *anx::CompilerSession::lookup(const std::string &name) {
+  if (!impl->jit)
+    return nullptr;
+
+  auto addr = impl->jit->lookup(ir::mangle(name));
+  if (!addr) {
+    impl->error(addr.takeError());
+    return nullptr;
+  }
+
+  return addr->toPtr<void *>();
+}
+
+void anx::CompilerSession::define(const std::string &name, void *addr) {
+  if (!impl->jit)
+    return;
+
+  llvm::orc::SymbolMap symbols;
+  symbols[impl->jit->mangleAndIntern(name)] = llvm::orc::ExecutorSymbolDef(
+      llvm::orc::ExecutorAddr::fromPtr(addr), llvm::JITSymbolFlags::Exported);
+  if (llvm::Error err =
+          impl->jit->getMainJITDylib().define(llvm::orc::absoluteSymbols(
+              symbols)))
+    impl->error(std::move(err));
+}
+
+const std::vector<anx::Diagnostic> &
+anx::CompilerSession::diagnostics() const {
+  return impl->diags;
+}
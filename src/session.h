@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+//===---------------------------------------------------------------------===//
+// Session - This module embeds the compiler in other programs.
+//
+// A CompilerSession compiles Anx source held in a string and links the code
+// into the running process, where its pub functions are called through
+// plain function pointers. Errors are returned as diagnostics instead of
+// ending the process, and sessions on different threads compile at the same
+// time. Programs that embed the compiler link with bin/libanx.a, which holds
+// the runtime too, and with LLVM.
+//
+// It is not safe to use one session from several threads at once.
+//===---------------------------------------------------------------------===//
+
+namespace anx {
+struct Diagnostic {
+  enum Kind { error, warning, note } kind;
+  std::string msg;
+  size_t line, col, size; // the source pointed at, or all 0 for none
+};
+
+class CompilerSession {
+public:
+  struct Options {
+    bool no_overflow = false; // as --no-overflow
+    bool fast_math = false;   // as --fast-math
+    // list the functions compiled in /tmp/perf-<pid>.map, where perf looks
+    // up the names of code the JIT generated
+    bool perf_map = true;
+    // also compile with DWARF line tables and write a jitdump file with the
+    // code and its source lines, for `perf inject --jit`, if LLVM was built
+    // with perf support
+    bool perf = false;
+  };
+
+  CompilerSession();
+  CompilerSession(Options opts);
+  ~CompilerSession();
+
+  // compile a unit and link it into the process, and whether that
+  // succeeded. name is the file diagnostics are reported in.
+  bool compile(const std::string &source, const std::string &name = "input");
+
+  // the address of the pub function name of the units compiled so far, or
+  // null if there is none, to be cast to a pointer to its C signature
+  void *lookup(const std::string &name);
+
+  // let the units compiled after this call the host's function name, at
+  // addr, as an extern "C" function. functions exported by the process are
+  // found without it.
+  void define(const std::string &name, void *addr);
+
+  // the diagnostics of the last compile
+  const std::vector<Diagnostic> &diagnostics() const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+} // namespace anx
@@ -130,6 +130,14 @@ ir::Symbol ir::Symbol::coerce(ty::Type toType, anx::Pos pos, size_t s) {
               "cmp"),
           toType);
     }
+  } else if (isPtr(fromType) || isRef(fromType)) {
+    if (toType == fromType)
+      return *this;
+    else if (isBool(toType))
+      return Symbol(ir::builder->CreateIsNotNull(v, "cmp"), toType);
+  } else if (isStr(fromType) || fromType >= ty::ty_compound) {
+    if (toType == fromType)
+      return *this;
   }
 
   anx::perr("cannot coerce type '" + toString(fromType) + "' to '" +
@@ -137,6 +145,115 @@ ir::Symbol ir::Symbol::coerce(ty::Type toType, anx::Pos pos, size_t s) {
             pos, s);
 }
 
+thread_local std::vector<ty::Compound> compounds;
+
+ty::Type intern(ty::Kind kind, std::vector<ty::Type> params) {
+  for (size_t i = 0; i < compounds.size(); i++)
+    if (compounds[i].kind == kind && compounds[i].params == params)
+      return (ty::Type)(ty::ty_compound + i);
+
+  compounds.push_back({kind, params});
+  return (ty::Type)(ty::ty_compound + compounds.size() - 1);
+}
+
+ty::Type ty::map(Type key, Type val) { return intern(kind_map, {key, val}); }
+
+ty::Type ty::task(Type ret) { return intern(kind_task, {ret}); }
+
+ty::Type ty::future(Type ret) { return intern(kind_future, {ret}); }
+
+ty::Type ty::arr(Type elem) { return intern(kind_arr, {elem}); }
+
+ty::Type ty::structure(std::string name, std::vector<std::string> fields,
+                       std::vector<Type> types, bool soa) {
+  compounds.push_back({kind_struct, types, name, fields, soa});
+  return (ty::Type)(ty::ty_compound + compounds.size() - 1);
+}
+
+// the struct declared as name, or void if there is none
+ty::Type ty::named(std::string name) {
+  for (size_t i = 0; i < compounds.size(); i++)
+    if (compounds[i].kind == kind_struct && compounds[i].name == name)
+      return (ty::Type)(ty::ty_compound + i);
+
+  return ty_void;
+}
+
+// every struct declared so far, each after the structs its fields use
+std::vector<ty::Type> ty::structs() {
+  std::vector<Type> all;
+  for (size_t i = 0; i < compounds.size(); i++)
+    if (compounds[i].kind == kind_struct)
+      all.push_back((ty::Type)(ty::ty_compound + i));
+
+  return all;
+}
+
+ty::Type ty::param(std::string name) {
+  compounds.push_back({kind_param, {}, name});
+  return (ty::Type)(ty::ty_compound + compounds.size() - 1);
+}
+
+// ty with the type parameters in it replaced by the types they are bound to,
+// or void if that makes a compound type that could not have been written
+// out, such as a map keyed by a struct
+ty::Type ty::subst(Type ty, const std::map<Type, Type> &bound) {
+  if (isParam(ty)) {
+    auto it = bound.find(ty);
+    return it == bound.end() ? ty : it->second;
+  }
+  if (ty < ty_compound || isStruct(ty) || bound.empty())
+    return ty;
+
+  std::vector<Type> params;
+  for (Type t : compound(ty).params) {
+    params.push_back(subst(t, bound));
+    if ((isVoid(params.back()) && !isVoid(t)) || isRef(params.back()))
+      return ty_void;
+  }
+
+  switch (compound(ty).kind) {
+  case kind_map:
+    if (isMap(params[0]) || isStruct(params[0]) || isArr(params[0]))
+      return ty_void;
+    return map(params[0], params[1]);
+  case kind_task:
+    return task(params[0]);
+  case kind_future:
+    return future(params[0]);
+  default:
+    return arr(params[0]);
+  }
+}
+
+const ty::Compound &ty::compound(Type ty) {
+  return compounds[ty - ty_compound];
+}
+
+bool ty::isMap(Type ty) {
+  return ty >= ty_compound && compound(ty).kind == kind_map;
+}
+
+bool ty::isTask(Type ty) {
+  return ty >= ty_compound && compound(ty).kind == kind_task;
+}
+
+bool ty::isFuture(Type ty) {
+  return ty >= ty_compound && compound(ty).kind == kind_future;
+}
+
+bool ty::isArr(Type ty) {
+  return ty >= ty_compound && compound(ty).kind == kind_arr;
+}
+
+bool ty::isStruct(Type ty) {
+  return ty >= ty_compound && compound(ty).kind == kind_struct;
+}
+
+bool ty::isParam(Type ty) {
+  return ty >= ty_compound && compound(ty).kind == kind_param;
+}
+
 bool ty::isSingle(Type ty) { return ty == ty_f32; }
 
 bool ty::isDouble(Type ty) { return ty == ty_f64; }
@@ -155,7 +272,19 @@ bool ty::isVoid(Type ty) { return ty == ty_void; }
 
 bool ty::isBool(Type ty) { return ty == ty_bool; }
 
+bool ty::isPtr(Type ty) { return ty == ty_ptr; }
+
+bool ty::isRef(Type ty) { return ty == ty_ref; }
+
+bool ty::isStr(Type ty) { return ty == ty_str; }
+
 uint32_t ty::width(Type ty) {
+  // structs and arrays are values as large as their fields
+  if (isStruct(ty) || isArr(ty))
+    return ir::mod->getDataLayout().getTypeAllocSizeInBits(toLLVM(ty, false));
+  if (ty >= ty_compound)
+    return 64;
+
   switch (ty) {
   case ty_void:
     return 0;
@@ -180,9 +309,19 @@ uint32_t ty::width(Type ty) {
   case ty_i128:
   case ty_u128:
     return 128;
+  case ty_ptr:
+  case ty_ref:
+    return 64;
+  case ty_str:
+    return 192;
+  case ty_compound:
+    return 64;
   }
 }
 
+// size in bytes of a value of this type when stored in memory
+uint32_t ty::size(Type ty) { return (width(ty) + 7) / 8; }
+
 ty::Type ty::fromString(std::string type, bool allow_void, anx::Pos pos,
                         size_t s) {
   if (type == "void") {
@@ -221,10 +360,33 @@ ty::Type ty::fromString(std::string type, bool allow_void, anx::Pos pos,
   if (type == "f64")
     return ty_f64;
 
+  if (type == "ptr")
+    return ty_ptr;
+  if (type == "ref")
+    return ty_ref;
+
+  if (type == "str")
+    return ty_str;
+
+  if (Type st = named(type))
+    return st;
+
   anx::perr("unrecognized type", pos, s);
 }
 
 std::string ty::toString(Type type) {
+  if (isMap(type))
+    return "map<" + toString(compound(type).params[0]) + ", " +
+           toString(compound(type).params[1]) + ">";
+  if (isTask(type))
+    return "task<" + toString(compound(type).params[0]) + ">";
+  if (isFuture(type))
+    return "future<" + toString(compound(type).params[0]) + ">";
+  if (isArr(type))
+    return "arr<" + toString(compound(type).params[0]) + ">";
+  if (isStruct(type) || isParam(type))
+    return compound(type).name;
+
   switch (type) {
   case ty_void:
     return "void";
@@ -254,10 +416,49 @@ std::string ty::toString(Type type) {
     return "i128";
   case ty_u128:
     return "u128";
+  case ty_ptr:
+    return "ptr";
+  case ty_ref:
+    return "ref";
+  case ty_str:
+    return "str";
+  case ty_compound:
+    return "compound";
   }
 }
 
 llvm::Type *ty::toLLVM(Type ty, bool allow_void, anx::Pos pos, size_t s) {
+  if (isStruct(ty)) {
+    const Compound &c = compound(ty);
+    std::string name = "struct." + c.name;
+    if (auto *ST = llvm::StructType::getTypeByName(*ir::ctx, name))
+      return ST;
+
+    std::vector<llvm::Type *> fields;
+    for (Type t : c.params)
+      fields.push_back(toLLVM(t, false));
+    return llvm::StructType::create(*ir::ctx, fields, name);
+  }
+
+  // arrays are the addresses of their buffers, followed by their length and
+  // capacity
+  if (isArr(ty)) {
+    Type et = compound(ty).params[0];
+    size_t buffers =
+        isStruct(et) && compound(et).soa ? compound(et).params.size() : 1;
+
+    std::vector<llvm::Type *> fields(buffers,
+                                     llvm::PointerType::get(*ir::ctx, 0));
+    fields.push_back(llvm::Type::getInt64Ty(*ir::ctx));
+    fields.push_back(llvm::Type::getInt64Ty(*ir::ctx));
+    return llvm::StructType::get(*ir::ctx, fields);
+  }
+
+  // maps, tasks and futures are handles to runtime hash tables, tasks and
+  // coroutine frames
+  if (ty >= ty_compound)
+    return llvm::PointerType::get(*ir::ctx, 0);
+
   switch (ty) {
   case ty_bool:
     return llvm::Type::getInt1Ty(*ir::ctx);
@@ -280,6 +481,19 @@ llvm::Type *ty::toLLVM(Type ty, bool allow_void, anx::Pos pos, size_t s) {
   case ty_i128:
   case ty_u128:
     return llvm::Type::getInt128Ty(*ir::ctx);
+  case ty_ptr:
+  case ty_compound:
+    return llvm::PointerType::get(*ir::ctx, 0);
+  case ty_ref: // garbage collected references live in their own address space
+    return llvm::PointerType::get(*ir::ctx, 1);
+  case ty_str: // data pointer, length and capacity (see runtime/rt.h)
+    if (auto *ST = llvm::StructType::getTypeByName(*ir::ctx, "str"))
+      return ST;
+    return llvm::StructType::create(*ir::ctx,
+                                    {llvm::PointerType::get(*ir::ctx, 0),
+                                     llvm::Type::getInt64Ty(*ir::ctx),
+                                     llvm::Type::getInt64Ty(*ir::ctx)},
+                                    "str");
   case ty_void:
     if (allow_void)
       return llvm::Type::getVoidTy(*ir::ctx);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+
 #include "llvm/IR/BasicBlock.h"
 
 #include "anx.h"
@@ -23,15 +25,66 @@ enum Type {
 
   ty_f32,
   ty_f64,
+
+  ty_ptr,
+  ty_ref,
+
+  ty_str,
+
+  ty_compound, // first id of the interned compound types below
 };
 
+// compound types are parameterized by other types, and are interned so that
+// each distinct instantiation gets a single id past ty_compound
+enum Kind {
+  kind_map,
+  kind_task,
+  kind_future,
+  kind_arr,
+  kind_struct,
+  kind_param,
+};
+
+// structs are not interned but declared: their params are the types of their
+// fields, and each declaration is a distinct type. so are the type parameters
+// of generic functions, which only have a name.
+struct Compound {
+  Kind kind;
+  std::vector<Type> params;
+  std::string name;
+  std::vector<std::string> fields;
+  bool soa = false; // arrays of it keep each field in its own buffer
+};
+
+Type map(Type key, Type val);
+Type task(Type ret);
+Type future(Type ret);
+Type arr(Type elem);
+Type structure(std::string name, std::vector<std::string> fields,
+               std::vector<Type> types, bool soa);
+Type named(std::string name);
+std::vector<Type> structs();
+Type param(std::string name);
+Type subst(Type ty, const std::map<Type, Type> &bound);
+const Compound &compound(Type ty);
+bool isMap(Type ty);
+bool isTask(Type ty);
+bool isFuture(Type ty);
+bool isArr(Type ty);
+bool isStruct(Type ty);
+bool isParam(Type ty);
+
 bool isSInt(Type ty);
 bool isUInt(Type ty);
 bool isSingle(Type ty);
 bool isDouble(Type ty);
 bool isVoid(Type ty);
 bool isBool(Type ty);
+bool isPtr(Type ty);
+bool isRef(Type ty);
+bool isStr(Type ty);
 uint32_t width(Type ty);
+uint32_t size(Type ty);
 
 std::string toString(Type type);
 Type fromString(std::string type, bool allow_void, anx::Pos pos = {},